@@ -0,0 +1,130 @@
+// Micro-benchmark of the per-site kernels: scalar vs AVX2.
+// Usage: bench_kernels [n_cells_per_axis=32] [reps=50]
+#include "fields.h"
+#include "integrator.h"
+#include "kernels_avx2.h"
+#include "lattice.h"
+#include "math_utils.h"
+#include "params.h"
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+    double time_ms(const std::function<void()>& kernel, const int reps) {
+        kernel(); // warm-up
+        const auto t0 = std::chrono::steady_clock::now();
+        for (int r = 0; r < reps; ++r) kernel();
+        const auto t1 = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::milli>(t1 - t0).count() / reps;
+    }
+}
+
+int main(int argc, char** argv) {
+    const int n_cells = (argc > 1) ? std::atoi(argv[1]) : 32;
+    const int reps    = (argc > 2) ? std::atoi(argv[2]) : 50;
+
+    MatParams mat[2]{};
+    mat[0] = {1.92e-23, 0.02, 1.76e11, 8.07e-24, {0, 0, 1}};
+    mat[1] = {7.63e-23, 0.02, 1.76e11, 8.07e-24, {0, 0, 1}};
+    const double J[2][2] = {{2.835e-21, -1.09e-21}, {-1.09e-21, 1.26e-21}};
+
+    std::vector<std::array<int, constants::FCC_NN_COUNT>> nearest_neighbors;
+    build_fcc_nn(n_cells, n_cells, n_cells, nearest_neighbors);
+    const int N = static_cast<int>(nearest_neighbors.size());
+    std::vector<uint8_t> species;
+    assign_species_by_fraction(N, 0.25, species, 1);
+
+    std::mt19937 gen(7);
+    std::normal_distribution<double> normal(0.0, 1.0);
+    std::vector<double> mx(N), my(N), mz(N);
+    for (int i = 0; i < N; ++i) {
+        mx[i] = normal(gen); my[i] = normal(gen); mz[i] = normal(gen);
+        normalize3(mx[i], my[i], mz[i]);
+    }
+    std::vector<double> Hx(N), Hy(N), Hz(N), dmx(N), dmy(N), dmz(N);
+    std::vector<double> Hx_ther(N, 1.0), Hy_ther(N, -1.0), Hz_ther(N, 0.5);
+    std::vector<double> mx_out(N), my_out(N), mz_out(N);
+    std::vector<double> mx_w = mx, my_w = my, mz_w = mz;
+    const FccNeighbors table =
+        FccNeighbors::from_table(nearest_neighbors, n_cells, n_cells, n_cells);
+    const FccNeighbors stencil =
+        FccNeighbors::stencil(n_cells, n_cells, n_cells);
+    // Species-partitioned copy (site_order=species); the moments are reused
+    // as is, only the memory order differs.
+    std::vector<uint8_t> species_part = species;
+    std::vector<FccNeighbors::List> nn_part = nearest_neighbors;
+    SitePermutation perm{};
+    partition_sites_by_species(species_part, nn_part, perm);
+    const FccNeighbors partitioned = FccNeighbors::from_table(nn_part,
+        n_cells, n_cells, n_cells, perm.n_Fe);
+    compute_exch_field<PrecDouble>(mat, J, nearest_neighbors, species, mx, my, mz,
+        Hx, Hy, Hz);
+    compute_dm_dt_kernel<PrecDouble>(mat, species, mx, my, mz, Hx, Hy, Hz, dmx, dmy, dmz);
+
+    const std::vector<std::pair<const char*, std::function<void()>>> kernels = {
+        {"exch_field", [&] {
+            compute_exch_field<PrecDouble>(mat, J, nearest_neighbors, species,
+                mx, my, mz, Hx, Hy, Hz); }},
+        {"dm_dt (torque)", [&] {
+            compute_dm_dt_kernel<PrecDouble>(mat, species, mx, my, mz, Hx, Hy, Hz,
+                dmx, dmy, dmz); }},
+        {"advance+normalize3", [&] {
+            advance_and_normalize_m<PrecDouble>(mx, my, mz, mx_out, my_out, mz_out,
+                dmx, dmy, dmz, 1e-16); }},
+        {"heun_predictor_fused", [&] {
+            heun_predictor_fused<PrecDouble>(mat, J, table, species,
+                mx, my, mz, mx, my, mz, 0.0, 0.0, 0.0,
+                Hx_ther, Hy_ther, Hz_ther, 1e-16, dmx, dmy, dmz,
+                mx_out, my_out, mz_out); }},
+        {"heun_corrector_fused", [&] {
+            heun_corrector_fused<PrecDouble>(mat, J, table, species,
+                mx, my, mz, 0.0, 0.0, 0.0,
+                Hx_ther, Hy_ther, Hz_ther, dmx, dmy, dmz, 1e-16,
+                mx_w, my_w, mz_w, mx_out, my_out, mz_out); }},
+        {"heun_predictor_stencil", [&] {
+            heun_predictor_fused<PrecDouble>(mat, J, stencil, species,
+                mx, my, mz, mx, my, mz, 0.0, 0.0, 0.0,
+                Hx_ther, Hy_ther, Hz_ther, 1e-16, dmx, dmy, dmz,
+                mx_out, my_out, mz_out); }},
+        {"heun_corrector_stencil", [&] {
+            heun_corrector_fused<PrecDouble>(mat, J, stencil, species,
+                mx, my, mz, 0.0, 0.0, 0.0,
+                Hx_ther, Hy_ther, Hz_ther, dmx, dmy, dmz, 1e-16,
+                mx_w, my_w, mz_w, mx_out, my_out, mz_out); }},
+        {"heun_predictor_species", [&] {
+            heun_predictor_fused<PrecDouble>(mat, J, partitioned, species_part,
+                mx, my, mz, mx, my, mz, 0.0, 0.0, 0.0,
+                Hx_ther, Hy_ther, Hz_ther, 1e-16, dmx, dmy, dmz,
+                mx_out, my_out, mz_out); }},
+        {"heun_corrector_species", [&] {
+            heun_corrector_fused<PrecDouble>(mat, J, partitioned, species_part,
+                mx, my, mz, 0.0, 0.0, 0.0,
+                Hx_ther, Hy_ther, Hz_ther, dmx, dmy, dmz, 1e-16,
+                mx_w, my_w, mz_w, mx_out, my_out, mz_out); }},
+    };
+
+    std::cout << "N = " << N << " sites, " << reps << " reps, avx2 "
+              << (simd::avx2_supported() ? "supported" : "not supported")
+              << "\n";
+    std::cout << std::left << std::setw(24) << "kernel"
+              << std::right << std::setw(12) << "scalar ms"
+              << std::setw(12) << "avx2 ms" << std::setw(10) << "speedup"
+              << "\n";
+    for (const auto& [name, kernel] : kernels) {
+        simd::configure(SimdMode::SCALAR);
+        const double t_scalar = time_ms(kernel, reps);
+        simd::configure(SimdMode::AVX2);
+        const double t_avx2 = time_ms(kernel, reps);
+        std::cout << std::left << std::setw(24) << name << std::right
+                  << std::fixed << std::setprecision(3)
+                  << std::setw(12) << t_scalar << std::setw(12) << t_avx2
+                  << std::setprecision(2) << std::setw(9)
+                  << t_scalar / t_avx2 << "x\n";
+    }
+    return 0;
+}
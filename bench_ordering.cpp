@@ -0,0 +1,196 @@
+// Cache behaviour of the exchange gathers for the cell orders of build_fcc_nn.
+// Usage: bench_ordering [n_cells_per_axis ...] (default: 64 128)
+// Reports the time of compute_exch_field (scalar), the L2 miss rate of its
+// neighbor loads from a simulated 1 MiB, 8-way LRU cache (deterministic, so
+// it works on any machine), and last-level-cache read misses from the
+// hardware counters when perf_event_open is available.
+#include "fields.h"
+#include "kernels_avx2.h"
+#include "lattice.h"
+#include "math_utils.h"
+#include "params.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    /// Set-associative LRU cache model fed with byte addresses.
+    class CacheModel {
+    public:
+        CacheModel(const size_t bytes, const int ways)
+            : ways_(ways), n_sets_(bytes / (LINE * ways)),
+              tags_(n_sets_ * ways, UINT64_MAX), age_(n_sets_ * ways, 0) {}
+
+        void access(const uint64_t addr) {
+            const uint64_t line = addr / LINE;
+            const size_t set = line % n_sets_;
+            uint64_t* tags = &tags_[set * ways_];
+            uint64_t* age  = &age_[set * ways_];
+            ++clock_;
+            ++accesses_;
+            int victim = 0;
+            for (int w = 0; w < ways_; ++w) {
+                if (tags[w] == line) { age[w] = clock_; return; }
+                if (age[w] < age[victim]) victim = w;
+            }
+            ++misses_;
+            tags[victim] = line;
+            age[victim]  = clock_;
+        }
+        double miss_rate() const {
+            return accesses_ ? static_cast<double>(misses_) / accesses_ : 0.0;
+        }
+
+    private:
+        static constexpr size_t LINE = 64;
+        int ways_;
+        size_t n_sets_;
+        std::vector<uint64_t> tags_, age_;
+        uint64_t clock_{0}, accesses_{0}, misses_{0};
+    };
+
+    /// Last-level-cache read misses of this thread; -1 if unavailable.
+    class LlcMissCounter {
+    public:
+        LlcMissCounter() {
+#ifdef __linux__
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_LL
+                | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd_ = static_cast<int>(
+                syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+        }
+        ~LlcMissCounter() {
+#ifdef __linux__
+            if (fd_ >= 0) close(fd_);
+#endif
+        }
+        bool available() const { return fd_ >= 0; }
+        void start() {
+#ifdef __linux__
+            if (fd_ < 0) return;
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+        }
+        long long stop() {
+            long long count = -1;
+#ifdef __linux__
+            if (fd_ < 0) return -1;
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd_, &count, sizeof(count)) != sizeof(count)) count = -1;
+#endif
+            return count;
+        }
+
+    private:
+        int fd_{-1};
+    };
+
+    const char* order_name(const CellOrder order) {
+        switch (order) {
+            case CellOrder::MORTON:  return "morton";
+            case CellOrder::HILBERT: return "hilbert";
+            default:                 return "row";
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<int> sizes;
+    for (int a = 1; a < argc; ++a) sizes.push_back(std::atoi(argv[a]));
+    if (sizes.empty()) sizes = {64, 128};
+
+    MatParams mat[2]{};
+    mat[0] = {1.92e-23, 0.02, 1.76e11, 8.07e-24, {0, 0, 1}};
+    mat[1] = {7.63e-23, 0.02, 1.76e11, 8.07e-24, {0, 0, 1}};
+    const double J[2][2] = {{2.835e-21, -1.09e-21}, {-1.09e-21, 1.26e-21}};
+    simd::configure(SimdMode::SCALAR);
+
+    LlcMissCounter llc;
+    std::cout << "simulated L2: 1 MiB, 8-way, 64 B lines; hardware LLC "
+              << "counter " << (llc.available() ? "available" : "not available")
+              << "\n";
+    std::cout << std::left << std::setw(8) << "cells" << std::setw(10) << "order"
+              << std::right << std::setw(12) << "exch ms" << std::setw(14)
+              << "sim L2 miss" << std::setw(16) << "LLC misses" << "\n";
+
+    for (const int n_cells : sizes) {
+        for (const CellOrder order :
+            {CellOrder::ROW_MAJOR, CellOrder::MORTON, CellOrder::HILBERT})
+        {
+            std::vector<std::array<int, constants::FCC_NN_COUNT>> nn;
+            SitePermutation perm{};
+            build_fcc_nn(n_cells, n_cells, n_cells, nn, order, &perm);
+            const int N = static_cast<int>(nn.size());
+            std::vector<uint8_t> species;
+            assign_species_by_fraction(N, 0.25, species, 1);
+            species = to_site_order(perm, species);
+
+            std::mt19937 gen(7);
+            std::normal_distribution<double> normal(0.0, 1.0);
+            std::vector<double> mx(N), my(N), mz(N), Hx(N), Hy(N), Hz(N);
+            for (int i = 0; i < N; ++i) {
+                mx[i] = normal(gen); my[i] = normal(gen); mz[i] = normal(gen);
+                normalize3(mx[i], my[i], mz[i]);
+            }
+
+            // Warm-up, then count one sweep and keep the best of three times.
+            compute_exch_field<PrecDouble>(mat, J, nn, species, mx, my, mz, Hx, Hy, Hz);
+            double best_ms = 1e300;
+            long long llc_misses = -1;
+            for (int rep = 0; rep < 3; ++rep) {
+                if (rep == 0) llc.start();
+                const auto t0 = std::chrono::steady_clock::now();
+                compute_exch_field<PrecDouble>(mat, J, nn, species, mx, my, mz, Hx, Hy, Hz);
+                const auto t1 = std::chrono::steady_clock::now();
+                if (rep == 0) llc_misses = llc.stop();
+                best_ms = std::min(best_ms,
+                    std::chrono::duration<double, std::milli>(t1 - t0).count());
+            }
+
+            // Neighbor loads of the sweep: species[j], mx[j], my[j], mz[j].
+            CacheModel l2(1 << 20, 8);
+            const uint64_t base_s = 0, base_x = 1ull << 40,
+                base_y = 2ull << 40, base_z = 3ull << 40;
+            for (int i = 0; i < N; ++i) {
+                for (const int j : nn[i]) {
+                    l2.access(base_s + j);
+                    l2.access(base_x + 8ull*j);
+                    l2.access(base_y + 8ull*j);
+                    l2.access(base_z + 8ull*j);
+                }
+            }
+
+            std::cout << std::left << std::setw(8) << n_cells
+                      << std::setw(10) << order_name(order) << std::right
+                      << std::fixed << std::setprecision(2) << std::setw(12)
+                      << best_ms
+                      << std::setprecision(4) << std::setw(14) << l2.miss_rate();
+            if (llc_misses >= 0) std::cout << std::setw(16) << llc_misses;
+            else                 std::cout << std::setw(16) << "n/a";
+            std::cout << "\n";
+        }
+    }
+    return 0;
+}
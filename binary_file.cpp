@@ -0,0 +1,164 @@
+#include "binary_file.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr std::size_t HASH_BLOCK_BYTES = std::size_t(1) << 20;
+
+    uint64_t mix(uint64_t h, const uint64_t w) {
+        h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+        return h ^ (h >> 29);
+    }
+}
+
+namespace binary_file {
+    uint64_t hash(const void* data, const std::size_t n) {
+        const auto* p = static_cast<const unsigned char*>(data);
+        const long long n_blocks = static_cast<long long>(
+            (n + HASH_BLOCK_BYTES - 1) / HASH_BLOCK_BYTES);
+        std::vector<uint64_t> block_hashes(static_cast<std::size_t>(n_blocks));
+        #pragma omp parallel for schedule(static)
+        for (long long blk = 0; blk < n_blocks; ++blk) {
+            const std::size_t a = static_cast<std::size_t>(blk)*HASH_BLOCK_BYTES;
+            const std::size_t e = std::min(a + HASH_BLOCK_BYTES, n);
+            uint64_t h = 0xCBF29CE484222325ULL ^ (e - a);
+            std::size_t i = a;
+            for (; i + 8 <= e; i += 8) {
+                uint64_t w;
+                std::memcpy(&w, p + i, 8);
+                h = mix(h, w);
+            }
+            uint64_t tail = 0;
+            std::memcpy(&tail, p + i, e - i);
+            block_hashes[blk] = mix(h, tail);
+        }
+        uint64_t h = 0x84222325CBF29CE4ULL ^ n;
+        for (const uint64_t b : block_hashes) h = mix(h, b);
+        return h;
+    }
+
+    void write_atomic(const std::string& path,
+        std::span<const Section> sections, const uint64_t file_bytes,
+        const char* who)
+    {
+        AtomicWriter file(path, who);
+        std::ofstream& ofs = file.stream();
+        uint64_t pos = 0;
+        const auto pad_to = [&](const uint64_t offset) {
+            static const char zeros[SECTION_ALIGN] = {};
+            while (pos < offset) {
+                const uint64_t n = std::min<uint64_t>(offset - pos,
+                    SECTION_ALIGN);
+                ofs.write(zeros, static_cast<std::streamsize>(n));
+                pos += n;
+            }
+        };
+        for (const Section& s : sections) {
+            pad_to(s.offset);
+            if (s.bytes > 0) {
+                ofs.write(static_cast<const char*>(s.data),
+                    static_cast<std::streamsize>(s.bytes));
+            }
+            pos += s.bytes;
+        }
+        pad_to(file_bytes);
+        file.commit();
+    }
+
+    AtomicWriter::AtomicWriter(const std::string& path, const char* who)
+        : path_(path), prefix_(std::string(who) + ": ")
+    {
+        try {
+            if (const std::filesystem::path p(path); !p.parent_path().empty()) {
+                std::filesystem::create_directories(p.parent_path());
+            }
+        }
+        catch (const std::exception& e) {
+            throw std::runtime_error(prefix_ +
+                "Failed to create directories: " + e.what());
+        }
+        // Unique per process, so concurrent writers do not share a file.
+#ifdef __linux__
+        tmp_ = path + ".tmp" + std::to_string(getpid());
+#else
+        tmp_ = path + ".tmp";
+#endif
+        ofs_.open(tmp_, std::ios::binary | std::ios::trunc);
+        if (!ofs_) {
+            throw std::runtime_error(prefix_ + "Failed to open file: " + tmp_);
+        }
+    }
+
+    AtomicWriter::~AtomicWriter() {
+        if (committed_) return;
+        ofs_.close();
+        std::error_code ec;
+        std::filesystem::remove(tmp_, ec);
+    }
+
+    void AtomicWriter::commit() {
+        if (!ofs_.flush()) {
+            throw std::runtime_error(prefix_ + "Failed to write file: " + tmp_);
+        }
+        ofs_.close();
+        std::error_code ec;
+        std::filesystem::rename(tmp_, path_, ec);
+        if (ec) {
+            throw std::runtime_error(prefix_ + "Failed to rename " + tmp_ +
+                " to " + path_ + ": " + ec.message());
+        }
+        committed_ = true;
+    }
+
+    Mapping::Mapping(const std::string& path) {
+#ifdef __linux__
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        struct stat st{};
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+            close(fd);
+            return;
+        }
+        const std::size_t bytes = static_cast<std::size_t>(st.st_size);
+        void* p = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd); // the mapping keeps the file open
+        if (p == MAP_FAILED) return;
+        base_ = static_cast<const unsigned char*>(p);
+        bytes_ = bytes;
+#else
+        (void)path;
+#endif
+    }
+
+    Mapping::~Mapping() { reset(); }
+
+    void Mapping::reset() {
+#ifdef __linux__
+        if (base_) munmap(const_cast<unsigned char*>(base_), bytes_);
+#endif
+        base_ = nullptr;
+        bytes_ = 0;
+    }
+
+    Mapping::Mapping(Mapping&& o) noexcept : base_(o.base_), bytes_(o.bytes_) {
+        o.base_ = nullptr;
+        o.bytes_ = 0;
+    }
+
+    Mapping& Mapping::operator=(Mapping&& o) noexcept {
+        std::swap(base_, o.base_);
+        std::swap(bytes_, o.bytes_);
+        return *this;
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef BINARY_FILE_H
+#define BINARY_FILE_H
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <span>
+#include <string>
+
+/// Pieces shared by the binary state files (lattice cache, checkpoints):
+/// a thread-count independent hash, atomic writes and read-only mappings.
+namespace binary_file {
+    constexpr uint64_t SECTION_ALIGN = 4096;
+
+    inline uint64_t align_up(const uint64_t v) {
+        return (v + SECTION_ALIGN - 1) / SECTION_ALIGN * SECTION_ALIGN;
+    }
+
+    /// Hash of bytes [p, p + n): fixed 1 MiB blocks hashed in parallel, then
+    /// combined in block order, so the value does not depend on the thread
+    /// count. Detects corruption, not tampering.
+    uint64_t hash(const void* p, std::size_t n);
+    inline uint64_t hash_combine(const uint64_t h, const uint64_t v) {
+        return h*31 + v;
+    }
+
+    /// Bytes [offset, offset + bytes) of a file.
+    struct Section {
+        uint64_t offset;
+        const void* data;
+        uint64_t bytes;
+    };
+
+    /// Write sections (ascending, non-overlapping; gaps and the tail up to
+    /// file_bytes are zero) to a per-process temporary file, then rename it
+    /// to path, so readers see either the old file or the complete new one.
+    /// Throws std::runtime_error("<who>: ...").
+    void write_atomic(const std::string& path,
+        std::span<const Section> sections, uint64_t file_bytes,
+        const char* who);
+
+    /// Streaming form of write_atomic for files too large to stage in
+    /// memory: write to stream() (a per-process temporary file), then
+    /// commit() renames it to path. Without commit the temporary file is
+    /// removed. Throws std::runtime_error("<who>: ...").
+    class AtomicWriter {
+    public:
+        AtomicWriter(const std::string& path, const char* who);
+        ~AtomicWriter();
+        AtomicWriter(const AtomicWriter&) = delete;
+        AtomicWriter& operator=(const AtomicWriter&) = delete;
+
+        std::ofstream& stream() { return ofs_; }
+        void commit();
+
+    private:
+        std::string path_, tmp_, prefix_;
+        std::ofstream ofs_;
+        bool committed_{false};
+    };
+
+    /// Read-only shared mapping of a whole file; concurrent mappings of one
+    /// file share its page cache pages.
+    class Mapping {
+    public:
+        Mapping() = default;
+        /// Empty (!valid()) if the file cannot be opened or mapped.
+        explicit Mapping(const std::string& path);
+        ~Mapping();
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+        Mapping(Mapping&& o) noexcept;
+        Mapping& operator=(Mapping&& o) noexcept;
+
+        bool valid() const { return base_ != nullptr; }
+        const unsigned char* data() const { return base_; }
+        std::size_t size() const { return bytes_; }
+        void reset();
+
+    private:
+        const unsigned char* base_{nullptr};
+        std::size_t bytes_{0};
+    };
+}
+
+#endif //BINARY_FILE_H
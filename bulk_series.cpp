@@ -0,0 +1,299 @@
+#include "bulk_series.h"
+#include "binary_file.h"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    constexpr char MAGIC[8] = {'G', 'D', 'F', 'E', 'B', 'T', 'S', '\0'};
+    constexpr char CHUNK_MAGIC[4] = {'G', 'D', 'C', 'K'};
+    constexpr uint32_t VERSION = 1;
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t header_bytes; // including the column table
+        uint32_t n_columns;
+        uint32_t record_bytes;
+    };
+    struct ColumnDesc {
+        char name[24];
+        char unit[8];
+        char type[4];          // "i8" (int64) or "f8" (double)
+        uint32_t offset;       // in the record
+    };
+    struct ChunkHeader {
+        char magic[4];
+        uint32_t n_records;
+        uint64_t checksum;     // binary_file::hash of the records
+    };
+    using bulk_series::Record;
+    static_assert(sizeof(Record) == 8 + 8*bulk_series::N_VALUES,
+        "Record must be packed");
+    static_assert(std::endian::native == std::endian::little,
+        "the binary bulk format is little-endian");
+
+    /// File header and column table of the binary format.
+    std::string binary_header() {
+        const auto& cols = bulk_series::columns();
+        FileHeader h{};
+        std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+        h.version = VERSION;
+        h.header_bytes = static_cast<uint32_t>(sizeof(FileHeader) +
+            cols.size()*sizeof(ColumnDesc));
+        h.n_columns = static_cast<uint32_t>(cols.size());
+        h.record_bytes = sizeof(Record);
+        std::string out(reinterpret_cast<const char*>(&h), sizeof(h));
+        for (std::size_t c = 0; c < cols.size(); ++c) {
+            ColumnDesc d{};
+            std::strncpy(d.name, cols[c].name, sizeof(d.name) - 1);
+            std::strncpy(d.unit, cols[c].unit, sizeof(d.unit) - 1);
+            std::memcpy(d.type, c == 0 ? "i8" : "f8", 3);
+            d.offset = static_cast<uint32_t>(c == 0 ? 0 :
+                offsetof(Record, values) + (c - 1)*sizeof(double));
+            out.append(reinterpret_cast<const char*>(&d), sizeof(d));
+        }
+        return out;
+    }
+
+    /// Appends v as %.10g (std::defaultfloat, setprecision(10)) and sep.
+    char* put(char* p, char* end, const double v, const char sep) {
+        p = std::to_chars(p, end, v, std::chars_format::general, 10).ptr;
+        *p++ = sep;
+        return p;
+    }
+}
+
+namespace bulk_series {
+    const std::array<Column, N_VALUES + 1>& columns() {
+        static const std::array<Column, N_VALUES + 1> cols{{
+            {"time_step", "step"}, {"T_kelvin", "K"},
+            {"mx_Fe", "1"}, {"my_Fe", "1"}, {"mz_Fe", "1"},
+            {"mx_Gd", "1"}, {"my_Gd", "1"}, {"mz_Gd", "1"},
+            {"mx_bulk", "1"}, {"my_bulk", "1"}, {"mz_bulk", "1"},
+            {"Hx_exch_tesla_Fe", "T"}, {"Hy_exch_tesla_Fe", "T"}, {"Hz_exch_tesla_Fe", "T"},
+            {"Hx_anis_tesla_Fe", "T"}, {"Hy_anis_tesla_Fe", "T"}, {"Hz_anis_tesla_Fe", "T"},
+            {"Hx_ther_tesla_Fe", "T"}, {"Hy_ther_tesla_Fe", "T"}, {"Hz_ther_tesla_Fe", "T"},
+            {"Hx_exch_tesla_Gd", "T"}, {"Hy_exch_tesla_Gd", "T"}, {"Hz_exch_tesla_Gd", "T"},
+            {"Hx_anis_tesla_Gd", "T"}, {"Hy_anis_tesla_Gd", "T"}, {"Hz_anis_tesla_Gd", "T"},
+            {"Hx_ther_tesla_Gd", "T"}, {"Hy_ther_tesla_Gd", "T"}, {"Hz_ther_tesla_Gd", "T"}}};
+        return cols;
+    }
+
+    Record make_record(const int time_step, const double T_kelvin,
+        const BulkValues& bulk_vals, const BulkFields& bulk_fields)
+    {
+        return {time_step, {T_kelvin,
+            bulk_vals.mx_Fe, bulk_vals.my_Fe, bulk_vals.mz_Fe,
+            bulk_vals.mx_Gd, bulk_vals.my_Gd, bulk_vals.mz_Gd,
+            bulk_vals.mx_bulk, bulk_vals.my_bulk, bulk_vals.mz_bulk,
+            bulk_fields.Hx_exch_tesla_Fe, bulk_fields.Hy_exch_tesla_Fe, bulk_fields.Hz_exch_tesla_Fe,
+            bulk_fields.Hx_anis_tesla_Fe, bulk_fields.Hy_anis_tesla_Fe, bulk_fields.Hz_anis_tesla_Fe,
+            bulk_fields.Hx_ther_tesla_Fe, bulk_fields.Hy_ther_tesla_Fe, bulk_fields.Hz_ther_tesla_Fe,
+            bulk_fields.Hx_exch_tesla_Gd, bulk_fields.Hy_exch_tesla_Gd, bulk_fields.Hz_exch_tesla_Gd,
+            bulk_fields.Hx_anis_tesla_Gd, bulk_fields.Hy_anis_tesla_Gd, bulk_fields.Hz_anis_tesla_Gd,
+            bulk_fields.Hx_ther_tesla_Gd, bulk_fields.Hy_ther_tesla_Gd, bulk_fields.Hz_ther_tesla_Gd}};
+    }
+
+    std::string csv_header() {
+        std::string out;
+        for (const Column& c : columns()) {
+            if (!out.empty()) out += ',';
+            out += c.name;
+        }
+        return out + '\n';
+    }
+
+    char* format_csv_row(const Record& r, char* out) {
+        char* const end = out + CSV_ROW_CHARS;
+        char* p = std::to_chars(out, end, r.time_step).ptr;
+        *p++ = ',';
+        for (int c = 0; c < N_VALUES; ++c) {
+            p = put(p, end, r.values[c], c + 1 < N_VALUES ? ',' : '\n');
+        }
+        return p;
+    }
+
+    std::vector<Record> read_binary(const std::string& path,
+        uint64_t* valid_bytes)
+    {
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs) {
+            throw std::runtime_error(
+                "bulk_series:read_binary: Failed to open file: " + path);
+        }
+        const std::string bytes((std::istreambuf_iterator<char>(ifs)),
+            std::istreambuf_iterator<char>());
+        const std::string head = binary_header();
+        if (bytes.compare(0, head.size(), head) != 0) {
+            throw std::runtime_error("bulk_series:read_binary: " + path +
+                ": not a bulk series file of this version");
+        }
+        std::vector<Record> records;
+        std::size_t pos = head.size();
+        while (pos + sizeof(ChunkHeader) <= bytes.size()) {
+            ChunkHeader ch;
+            std::memcpy(&ch, bytes.data() + pos, sizeof(ch));
+            const std::size_t n_bytes =
+                static_cast<std::size_t>(ch.n_records)*sizeof(Record);
+            const std::size_t begin = pos + sizeof(ChunkHeader);
+            if (std::memcmp(ch.magic, CHUNK_MAGIC, sizeof(CHUNK_MAGIC)) != 0 ||
+                n_bytes > bytes.size() - begin ||
+                binary_file::hash(bytes.data() + begin, n_bytes) != ch.checksum) {
+                break; // damaged last chunk
+            }
+            const std::size_t first = records.size();
+            records.resize(first + ch.n_records);
+            std::memcpy(records.data() + first, bytes.data() + begin, n_bytes);
+            pos = begin + n_bytes;
+        }
+        if (valid_bytes) *valid_bytes = pos;
+        return records;
+    }
+
+    void truncate_binary(const std::string& path, const int from_step) {
+        if (!std::filesystem::exists(path)) return;
+        std::vector<Record> records = read_binary(path);
+        records.erase(std::find_if(records.begin(), records.end(),
+            [from_step](const Record& r) { return r.time_step >= from_step; }),
+            records.end());
+        const std::string head = binary_header();
+        ChunkHeader ch{};
+        std::memcpy(ch.magic, CHUNK_MAGIC, sizeof(CHUNK_MAGIC));
+        ch.n_records = static_cast<uint32_t>(records.size());
+        ch.checksum = binary_file::hash(records.data(),
+            records.size()*sizeof(Record));
+        const binary_file::Section sections[] = {
+            {0, head.data(), head.size()},
+            {head.size(), &ch, sizeof(ch)},
+            {head.size() + sizeof(ch), records.data(),
+                records.size()*sizeof(Record)}};
+        binary_file::write_atomic(path, sections, head.size() + sizeof(ch) +
+            records.size()*sizeof(Record), "bulk_series:truncate_binary");
+    }
+}
+
+BulkSeriesWriter::BulkSeriesWriter(const std::string& path,
+    const BulkFormat format, const std::size_t flush_bytes,
+    const std::chrono::milliseconds flush_interval)
+    : path_(path), format_(format), flush_bytes_(flush_bytes),
+      flush_interval_(flush_interval)
+{
+    try {
+        if (const std::filesystem::path p(path_); !p.parent_path().empty()) {
+            std::filesystem::create_directories(p.parent_path());
+        }
+    } catch (const std::exception& e) {
+        throw std::runtime_error(std::string(
+            "io:BulkSeriesWriter: Failed to create directories: ") + e.what());
+    }
+    const bool need_header = !std::filesystem::exists(path_) ||
+        std::filesystem::file_size(path_) == 0;
+    if (!need_header && format_ == BulkFormat::BINARY) {
+        // Cut off a chunk left damaged by a crash, so appended chunks stay
+        // readable; a file of another format or version is an error.
+        uint64_t valid_bytes = 0;
+        try {
+            bulk_series::read_binary(path_, &valid_bytes);
+        } catch (const std::exception& e) {
+            throw std::runtime_error(std::string(
+                "io:BulkSeriesWriter: Cannot append: ") + e.what());
+        }
+        if (valid_bytes < std::filesystem::file_size(path_)) {
+            std::filesystem::resize_file(path_, valid_bytes);
+        }
+    }
+    ofs_.open(path_, std::ios::out | std::ios::app | std::ios::binary);
+    if (!ofs_) {
+        throw std::runtime_error(
+            "io:BulkSeriesWriter: Failed to open file: " + path_);
+    }
+    if (need_header) {
+        ofs_ << (format_ == BulkFormat::BINARY ? binary_header() :
+            bulk_series::csv_header()) << std::flush;
+    }
+    const std::size_t row_bytes = format_ == BulkFormat::BINARY ?
+        sizeof(Record) : bulk_series::CSV_ROW_CHARS;
+    front_.reserve(flush_bytes_ + row_bytes);
+    back_.reserve(flush_bytes_ + row_bytes);
+    thread_ = std::thread(&BulkSeriesWriter::run, this);
+}
+
+BulkSeriesWriter::~BulkSeriesWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+void BulkSeriesWriter::append(const int time_step, const double T_kelvin,
+    const BulkValues& bulk_vals, const BulkFields& bulk_fields)
+{
+    const Record r = bulk_series::make_record(time_step, T_kelvin, bulk_vals,
+        bulk_fields);
+    char row[bulk_series::CSV_ROW_CHARS];
+    const char* begin = reinterpret_cast<const char*>(&r);
+    const char* end = begin + sizeof(r);
+    if (format_ == BulkFormat::CSV) {
+        begin = row;
+        end = bulk_series::format_csv_row(r, row);
+    }
+
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        front_.append(begin, end);
+        wake = front_.size() >= flush_bytes_ && !writing_;
+    }
+    if (wake) cv_.notify_all();
+}
+
+void BulkSeriesWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    flush_requested_ = true;
+    cv_.notify_all();
+    cv_.wait(lock, [this] { return front_.empty() && !writing_; });
+}
+
+void BulkSeriesWriter::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        cv_.wait_for(lock, flush_interval_, [this] {
+            return stop_ || flush_requested_ || front_.size() >= flush_bytes_;
+        });
+        flush_requested_ = false;
+        if (!front_.empty()) {
+            std::swap(front_, back_);
+            writing_ = true;
+            lock.unlock();
+            if (format_ == BulkFormat::BINARY) {
+                ChunkHeader ch{};
+                std::memcpy(ch.magic, CHUNK_MAGIC, sizeof(CHUNK_MAGIC));
+                ch.n_records = static_cast<uint32_t>(back_.size()/sizeof(Record));
+                ch.checksum = binary_file::hash(back_.data(), back_.size());
+                ofs_.write(reinterpret_cast<const char*>(&ch), sizeof(ch));
+            }
+            ofs_.write(back_.data(), static_cast<std::streamsize>(back_.size()));
+            ofs_.flush();
+            if (!ofs_) {
+                std::cerr << "Warning: io:BulkSeriesWriter: Failed to write "
+                          << path_ << "\n";
+                ofs_.clear();
+            }
+            back_.clear();
+            lock.lock();
+            writing_ = false;
+            cv_.notify_all();
+        }
+        if (stop_ && front_.empty()) return;
+    }
+}
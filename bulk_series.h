@@ -0,0 +1,101 @@
+#ifndef BULK_SERIES_H
+#define BULK_SERIES_H
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "params.h"
+
+/// Bulk time series (BulkValues and BulkFields per saved step) as CSV or as
+/// a binary columnar file. Binary layout (little-endian):
+/// - header: magic "GDFEBTS", version, header_bytes, n_columns,
+///   record_bytes, then per column name, unit, type ("i8" / "f8"), offset
+/// - chunks: magic "GDCK", n_records, checksum of the records, then
+///   n_records fixed-width Records
+/// A chunk is written whole, so a crash leaves at most one damaged last
+/// chunk; readers skip it and the next writer cuts it off before appending.
+namespace bulk_series {
+    constexpr int N_VALUES = 28; // T_kelvin, 9 magnetizations, 18 fields
+
+    struct Record {
+        int64_t time_step;
+        double values[N_VALUES]; // order of columns()[1..]
+    };
+
+    struct Column {
+        const char* name;
+        const char* unit;
+    };
+    /// time_step, then the values in Record order.
+    const std::array<Column, N_VALUES + 1>& columns();
+
+    Record make_record(int time_step, double T_kelvin,
+        const BulkValues& bulk_vals, const BulkFields& bulk_fields);
+
+    /// CSV header line of the columns (with '\n').
+    std::string csv_header();
+    /// Writes the CSV line of r (%.10g, with '\n') at out, which holds at
+    /// least CSV_ROW_CHARS chars; returns the end.
+    constexpr std::size_t CSV_ROW_CHARS = (N_VALUES + 1)*25 + 16;
+    char* format_csv_row(const Record& r, char* out);
+
+    /// Records of a binary file, in file order. A damaged last chunk is
+    /// skipped (*valid_bytes = end of the last good chunk, if given).
+    /// Throws std::runtime_error("bulk_series:read_binary: ...") if the
+    /// file cannot be read or its header is not this format.
+    std::vector<Record> read_binary(const std::string& path,
+        uint64_t* valid_bytes = nullptr);
+
+    /// Drop the records of time_step >= from_step from a binary file (a
+    /// restart writes them again). No-op if the file does not exist.
+    void truncate_binary(const std::string& path, int from_step);
+}
+
+/// Writer of the bulk time series for the whole run: the file is opened
+/// once, each row goes into a front buffer (CSV: formatted with
+/// std::to_chars, same text as the iostream writer; binary: one Record
+/// memcpy), and a background thread writes the back buffer (binary: as one
+/// chunk) when the front holds flush_bytes or every flush_interval. The
+/// destructor writes what is left, so a loop leaving normally, by an
+/// exception or after a stop signal (shutdown.h) loses no rows.
+class BulkSeriesWriter {
+public:
+    /// Appends to path (header if the file is new or empty). Throws
+    /// std::runtime_error("io:BulkSeriesWriter: ...").
+    explicit BulkSeriesWriter(const std::string& path,
+        BulkFormat format = BulkFormat::CSV,
+        std::size_t flush_bytes = std::size_t(1) << 20,
+        std::chrono::milliseconds flush_interval = std::chrono::seconds(1));
+    ~BulkSeriesWriter();
+    BulkSeriesWriter(const BulkSeriesWriter&) = delete;
+    BulkSeriesWriter& operator=(const BulkSeriesWriter&) = delete;
+
+    void append(int time_step, double T_kelvin,
+        const BulkValues& bulk_vals, const BulkFields& bulk_fields);
+    /// Block until every appended row is written and flushed.
+    void flush();
+
+private:
+    void run();
+
+    std::string path_;
+    BulkFormat format_;
+    std::ofstream ofs_;
+    std::size_t flush_bytes_;
+    std::chrono::milliseconds flush_interval_;
+    std::string front_, back_;   // filled by append / written by the thread
+    bool writing_{false};        // thread owns back_
+    bool flush_requested_{false};
+    bool stop_{false};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread thread_;
+};
+
+#endif //BULK_SERIES_H
@@ -0,0 +1,48 @@
+// Convert a binary bulk time series (bulk_format=binary) to the CSV text of
+// bulk_format=csv.
+// Usage: bulk_to_csv <bulk_values_vs_time.bin> [out.csv]   (default: stdout)
+//        bulk_to_csv --columns <file>                      (names and units)
+#include "bulk_series.h"
+#include <cstdio>
+#include <exception>
+#include <stdexcept>
+#include <iostream>
+#include <string>
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "Usage: " << argv[0] << " <file.bin> [out.csv]\n"
+                  << "       " << argv[0] << " --columns <file.bin>\n";
+        return 2;
+    }
+    try {
+        if (std::string(argv[1]) == "--columns") {
+            if (argc != 3) throw std::runtime_error("--columns needs a file");
+            const auto records = bulk_series::read_binary(argv[2]);
+            for (const bulk_series::Column& c : bulk_series::columns()) {
+                std::cout << c.name << " [" << c.unit << "]\n";
+            }
+            std::cout << records.size() << " records\n";
+            return 0;
+        }
+        uint64_t valid_bytes = 0;
+        const auto records = bulk_series::read_binary(argv[1], &valid_bytes);
+        std::FILE* out = argc == 3 ? std::fopen(argv[2], "wb") : stdout;
+        if (!out) throw std::runtime_error(std::string("cannot open ") + argv[2]);
+        const std::string header = bulk_series::csv_header();
+        std::fwrite(header.data(), 1, header.size(), out);
+        char row[bulk_series::CSV_ROW_CHARS];
+        for (const bulk_series::Record& r : records) {
+            const char* end = bulk_series::format_csv_row(r, row);
+            std::fwrite(row, 1, static_cast<std::size_t>(end - row), out);
+        }
+        if (out != stdout && std::fclose(out) != 0) {
+            throw std::runtime_error(std::string("cannot write ") + argv[2]);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "bulk_to_csv: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,281 @@
+#include "checkpoint.h"
+#include "site_memory.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    constexpr char MAGIC[8] = {'G', 'D', 'F', 'E', 'C', 'K', 'P', '\0'};
+    constexpr uint32_t VERSION = 3; // 2: save cadence state, 3: step control
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t header_bytes;
+        uint32_t real_bytes;  // sizeof(Real) of the arrays
+        int32_t rng_kind;
+        int64_t n_sites;
+        int64_t next_step;    // first step the restart runs
+        uint64_t input_hash;
+        SaveCadence::State cadence;
+        StepControl::State steps;
+        uint64_t mt_offset, mt_bytes; // MT19937 state as text (operator<<)
+        uint64_t m_offset;    // array k at m_offset + k*m_stride
+        uint64_t m_stride;
+        uint64_t file_bytes;
+        uint64_t checksum;    // of the sections
+    };
+
+    using binary_file::align_up;
+
+    /// Header with the section layout (checksum not set).
+    Header layout(const int64_t n_sites, const uint32_t real_bytes,
+        const uint64_t mt_bytes)
+    {
+        Header h{};
+        std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+        h.version = VERSION;
+        h.header_bytes = sizeof(Header);
+        h.real_bytes = real_bytes;
+        h.n_sites = n_sites;
+        h.mt_offset = align_up(sizeof(Header));
+        h.mt_bytes = mt_bytes;
+        h.m_offset = align_up(h.mt_offset + mt_bytes);
+        h.m_stride = align_up(static_cast<uint64_t>(n_sites)*real_bytes);
+        h.file_bytes = h.m_offset +
+            (checkpoint::N_ARRAYS - 1)*h.m_stride +
+            static_cast<uint64_t>(n_sites)*real_bytes;
+        return h;
+    }
+
+    uint64_t checksum(const void* mt, const uint64_t mt_bytes,
+        const void* const (&m)[checkpoint::N_ARRAYS], const uint64_t m_bytes)
+    {
+        uint64_t h = binary_file::hash(mt, mt_bytes);
+        for (const void* a : m) {
+            h = binary_file::hash_combine(h, binary_file::hash(a, m_bytes));
+        }
+        return h;
+    }
+
+    Header read_header(const binary_file::Mapping& file) {
+        Header h;
+        std::memcpy(&h, file.data(), sizeof(h));
+        return h;
+    }
+}
+
+namespace checkpoint {
+    uint64_t input_hash(const ControlParams& control, const LatParams& lat,
+        const MatParams mat[2], const std::vector<double>& Te_kelvin_arr,
+        const int next_step, const char* precision)
+    {
+        std::vector<unsigned char> bytes;
+        const auto put = [&bytes](const auto& v) {
+            const auto* p = reinterpret_cast<const unsigned char*>(&v);
+            bytes.insert(bytes.end(), p, p + sizeof(v));
+        };
+        put(control.seed); put(control.pre_steps); put(control.dt_sec);
+        put(control.pre_Te_kelvin); put(control.rng_kind);
+        put(control.integrator);
+        put(control.dt_tol); put(control.dt_min_sec); put(control.dt_max_sec);
+        put(control.dt_max_dT_kelvin); put(control.pre_mc_sweeps);
+        put(control.site_order); put(control.cell_order);
+        put(lat.nx); put(lat.ny); put(lat.nz); put(lat.a_m); put(lat.frac_Gd);
+        put(lat.J_joule_per_link);
+        put(lat.mx_init_Fe); put(lat.my_init_Fe); put(lat.mz_init_Fe);
+        put(lat.mx_init_Gd); put(lat.my_init_Gd); put(lat.mz_init_Gd);
+        put(lat.Hx_appl_tesla); put(lat.Hy_appl_tesla); put(lat.Hz_appl_tesla);
+        for (int s = 0; s < 2; ++s) {
+            put(mat[s].mu_ampere_m2); put(mat[s].alpha);
+            put(mat[s].gamma_rad_per_tesla_sec); put(mat[s].ku_joule_per_atom);
+            put(mat[s].easy_axis.x); put(mat[s].easy_axis.y);
+            put(mat[s].easy_axis.z);
+        }
+        bytes.insert(bytes.end(), precision, precision + std::strlen(precision));
+        // Temperatures of the run steps already done (adaptive steps also
+        // interpolate towards the one at next_step).
+        const int n_used = next_step - control.pre_steps +
+            (control.dt_tol > 0.0 ? 1 : 0);
+        const std::size_t n_Te = static_cast<std::size_t>(std::clamp(
+            n_used, 0,
+            static_cast<int>(Te_kelvin_arr.size())));
+        return binary_file::hash_combine(
+            binary_file::hash(bytes.data(), bytes.size()),
+            binary_file::hash(Te_kelvin_arr.data(), n_Te*sizeof(double)));
+    }
+
+    //--------------------------------------------------------------------------
+    template <typename Real>
+    Writer<Real>::Writer(std::string path, const SiteIndex N,
+        const int row_sites)
+        : path_(std::move(path)), row_sites_(row_sites),
+          snapshot_(static_cast<std::size_t>(N) * N_ARRAYS)
+    {
+        thread_ = std::thread(&Writer::run, this);
+    }
+
+    template <typename Real>
+    Writer<Real>::~Writer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    template <typename Real>
+    void Writer<Real>::wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return !pending_; });
+    }
+
+    template <typename Real>
+    void Writer<Real>::submit(const int next_step, const uint64_t input_hash,
+        const RngKind rng_kind, const RNG& rng,
+        const std::span<const Real> (&m)[N_ARRAYS],
+        const SaveCadence::State& cadence, const StepControl::State& steps)
+    {
+        wait(); // the thread no longer reads the snapshot
+        const std::size_t n = snapshot_.size() / N_ARRAYS;
+        for (int k = 0; k < N_ARRAYS; ++k) {
+            site_memory::first_touch(snapshot_.data() + k*n, n,
+                static_cast<std::size_t>(row_sites_), Real(0), m[k].data());
+        }
+        std::ostringstream mt;
+        if (rng_kind == RngKind::MT19937) mt << rng.gen;
+        const std::string mt_state = mt.str();
+        // Hashed here with the loop's threads, so the writer thread only
+        // does I/O and does not compete with the kernels for cores.
+        const void* arrays[N_ARRAYS];
+        for (int k = 0; k < N_ARRAYS; ++k) arrays[k] = snapshot_.data() + k*n;
+        const uint64_t sum = checksum(mt_state.data(), mt_state.size(), arrays,
+            n*sizeof(Real));
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            mt_state_ = mt_state;
+            checksum_ = sum;
+            next_step_ = next_step;
+            input_hash_ = input_hash;
+            rng_kind_ = rng_kind;
+            cadence_ = cadence;
+            steps_ = steps;
+            pending_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    template <typename Real>
+    void Writer<Real>::run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            cv_.wait(lock, [this] { return pending_ || stop_; });
+            if (!pending_) return;
+            // submit() waits for !pending_, so the snapshot is ours unlocked.
+            lock.unlock();
+            const std::size_t n = snapshot_.size() / N_ARRAYS;
+            Header h = layout(static_cast<int64_t>(n), sizeof(Real),
+                mt_state_.size());
+            h.rng_kind = static_cast<int32_t>(rng_kind_);
+            h.next_step = next_step_;
+            h.input_hash = input_hash_;
+            h.cadence = cadence_;
+            h.steps = steps_;
+            const void* arrays[N_ARRAYS];
+            for (int k = 0; k < N_ARRAYS; ++k) arrays[k] = snapshot_.data() + k*n;
+            h.checksum = checksum_;
+            std::vector<binary_file::Section> sections{
+                {0, &h, sizeof(h)},
+                {h.mt_offset, mt_state_.data(), mt_state_.size()}};
+            for (int k = 0; k < N_ARRAYS; ++k) {
+                sections.push_back({h.m_offset + k*h.m_stride, arrays[k],
+                    n*sizeof(Real)});
+            }
+            try {
+                binary_file::write_atomic(path_, sections, h.file_bytes,
+                    "checkpoint:write");
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Warning: " << e.what() << "\n";
+            }
+            lock.lock();
+            pending_ = false;
+            cv_.notify_all();
+        }
+    }
+
+    template class Writer<double>;
+    template class Writer<float>;
+
+    //--------------------------------------------------------------------------
+    Reader::Reader(const std::string& path) : file_(path) {
+        const auto fail = [&path](const std::string& why) {
+            throw std::runtime_error("checkpoint:load: " + path + ": " + why);
+        };
+        if (!file_.valid()) fail("cannot open or map the file");
+        if (file_.size() < sizeof(Header)) fail("truncated header");
+        const Header h = read_header(file_);
+        if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            h.version != VERSION || h.header_bytes != sizeof(Header)) {
+            fail("unknown format or version");
+        }
+        if (h.n_sites < 0 || (h.real_bytes != sizeof(float) &&
+            h.real_bytes != sizeof(double))) {
+            fail("corrupt header");
+        }
+        const Header expect = layout(h.n_sites, h.real_bytes, h.mt_bytes);
+        if (h.mt_offset != expect.mt_offset || h.m_offset != expect.m_offset ||
+            h.m_stride != expect.m_stride ||
+            h.file_bytes != expect.file_bytes || h.file_bytes != file_.size()) {
+            fail("corrupt layout");
+        }
+        const void* arrays[N_ARRAYS];
+        for (int k = 0; k < N_ARRAYS; ++k) {
+            arrays[k] = file_.data() + h.m_offset + k*h.m_stride;
+        }
+        if (checksum(file_.data() + h.mt_offset, h.mt_bytes, arrays,
+            static_cast<uint64_t>(h.n_sites)*h.real_bytes) != h.checksum) {
+            fail("checksum mismatch");
+        }
+    }
+
+    int Reader::next_step() const {
+        return static_cast<int>(read_header(file_).next_step);
+    }
+    uint64_t Reader::input_hash() const { return read_header(file_).input_hash; }
+    RngKind Reader::rng_kind() const {
+        return static_cast<RngKind>(read_header(file_).rng_kind);
+    }
+    SaveCadence::State Reader::cadence() const {
+        return read_header(file_).cadence;
+    }
+    StepControl::State Reader::steps() const {
+        return read_header(file_).steps;
+    }
+    SiteIndex Reader::n_sites() const { return read_header(file_).n_sites; }
+    std::size_t Reader::real_bytes() const {
+        return read_header(file_).real_bytes;
+    }
+
+    std::string_view Reader::mt_state() const {
+        const Header h = read_header(file_);
+        return {reinterpret_cast<const char*>(file_.data() + h.mt_offset),
+            static_cast<std::size_t>(h.mt_bytes)};
+    }
+
+    template <typename Real>
+    std::span<const Real> Reader::array(const int k) const {
+        const Header h = read_header(file_);
+        if (h.real_bytes != sizeof(Real) || k < 0 || k >= N_ARRAYS) return {};
+        return {reinterpret_cast<const Real*>(
+            file_.data() + h.m_offset + k*h.m_stride),
+            static_cast<std::size_t>(h.n_sites)};
+    }
+
+    template std::span<const double> Reader::array<double>(int) const;
+    template std::span<const float> Reader::array<float>(int) const;
+}
@@ -0,0 +1,95 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "binary_file.h"
+#include "params.h"
+#include "rng.h"
+#include "save_cadence.h"
+#include "step_control.h"
+
+/// Binary checkpoints of the time loop, taken between two steps: the spin
+/// arrays m and m_mid (storage order, the build's Real), the MT19937 state
+/// (Philox needs none: its counter is the step), the save cadence and step
+/// control states, the next step and a hash of the inputs that fix the
+/// trajectory up to it. Layout: fixed header, then page-aligned sections (RNG state, 6 arrays of N Real), checksum over the
+/// sections. A restart from it continues bit-identically.
+namespace checkpoint {
+    constexpr int N_ARRAYS = 6; // mx, my, mz, mx_mid, my_mid, mz_mid
+
+    /// Hash of what determines the trajectory before next_step: seed, rng,
+    /// integrator, dt and its control, pre-steps (LLG or Monte Carlo), lattice, site order, material and field parameters,
+    /// precision and the temperatures of the steps before next_step.
+    uint64_t input_hash(const ControlParams& control, const LatParams& lat,
+        const MatParams mat[2], const std::vector<double>& Te_kelvin_arr,
+        int next_step, const char* precision);
+
+    /// Writes checkpoints on a background thread: submit copies the state
+    /// into a snapshot buffer (waiting for the previous write, if still
+    /// running) and returns, the thread writes it with write-then-rename.
+    /// Write errors are reported on stderr; the run goes on.
+    template <typename Real>
+    class Writer {
+    public:
+        Writer(std::string path, SiteIndex N, int row_sites);
+        ~Writer();
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        void submit(int next_step, uint64_t input_hash, RngKind rng_kind,
+            const RNG& rng, const std::span<const Real> (&m)[N_ARRAYS],
+            const SaveCadence::State& cadence, const StepControl::State& steps);
+        /// Block until the pending write (if any) is on disk.
+        void wait();
+
+    private:
+        void run();
+
+        std::string path_;
+        int row_sites_;
+        std::vector<Real> snapshot_;
+        std::string mt_state_;
+        int next_step_{0};
+        uint64_t input_hash_{0};
+        uint64_t checksum_{0};
+        RngKind rng_kind_{RngKind::MT19937};
+        SaveCadence::State cadence_;
+        StepControl::State steps_;
+        bool pending_{false};
+        bool stop_{false};
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::thread thread_;
+    };
+
+    /// Read-only mapping of a checkpoint file; the arrays are read in place.
+    class Reader {
+    public:
+        /// Throws std::runtime_error("checkpoint:load: ...") if the file is
+        /// missing, truncated, of another format or fails its checksum.
+        explicit Reader(const std::string& path);
+
+        int next_step() const;
+        uint64_t input_hash() const;
+        RngKind rng_kind() const;
+        SaveCadence::State cadence() const;
+        StepControl::State steps() const;
+        SiteIndex n_sites() const;
+        std::size_t real_bytes() const;
+        std::string_view mt_state() const;
+        /// Array k of N_ARRAYS; Real must match real_bytes().
+        template <typename Real>
+        std::span<const Real> array(int k) const;
+
+    private:
+        binary_file::Mapping file_;
+    };
+}
+
+#endif //CHECKPOINT_H
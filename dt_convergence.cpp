@@ -0,0 +1,236 @@
+// Timestep convergence of the integrators on the setup of an input.csv:
+// Heun at dt_sec is the reference; Heun and Depondt-Mertens then run at
+// dt_sec * 2, 4, ..., max_factor (same physical times and temperatures,
+// Philox noise) and the Fe and Gd sublattice curves are compared with the
+// reference every sample interval. Reports per run the RMS of |dm_Fe| and
+// |dm_Gd| over these points and the time per ps, and per integrator the
+// largest dt within tol.
+// Usage: dt_convergence [input.csv] [max_factor=32] [tol=auto]
+//   tol=auto: twice the statistical floor of the curves, the largest
+//   deviation of three reference runs with independent noise from the
+//   reference. The verdict is statistical: on small lattices the floor is
+//   large and hides the dt error of the first few factors.
+#include "fields.h"
+#include "init.h"
+#include "integrator.h"
+#include "io.h"
+#include "io_temperature_csv.h"
+#include "kernels_avx2.h"
+#include "lattice.h"
+#include "parallel_utils.h"
+#include "params.h"
+#include "reductions.h"
+#include "rng.h"
+#include "workspace.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+    struct Setup {
+        ControlParams control{};
+        LatParams lat{};
+        MatParams mat[2]{};
+        FccNeighbors neighbors{};
+        std::vector<FccNeighbors::List> table;
+        std::vector<uint8_t> species;
+        std::vector<double> Te_kelvin_arr;
+        int total_steps{0};   // reference steps (pre + run)
+        int sample_steps{0};  // reference steps between compared points
+
+        double T_kelvin(const int ref_step) const {
+            if (ref_step < control.pre_steps || Te_kelvin_arr.empty()) {
+                return control.pre_Te_kelvin;
+            }
+            return Te_kelvin_arr[std::min<std::size_t>(
+                static_cast<std::size_t>(ref_step - control.pre_steps),
+                Te_kelvin_arr.size() - 1)];
+        }
+    };
+
+    struct Curve {
+        std::vector<BulkValues> points; // every sample_steps reference steps
+        double seconds{0.0};
+    };
+
+    /// Run the setup with the integrator at dt_sec * factor and noise
+    /// stream; bulk m at the sample points.
+    Curve run(const Setup& su, const Integrator integrator, const int factor,
+        const uint32_t stream)
+    {
+        using P = PrecDouble;
+        const SiteIndex N = su.lat.N;
+        const int row_sites = su.lat.nz * constants::FCC_BASIS_COUNT;
+        HeunWorkspace<double> ws(N, row_sites);
+        initialize_m(su.species.data(), N, ws.mx.data(), ws.my.data(),
+            ws.mz.data(), su.lat.mx_init_Fe, su.lat.my_init_Fe,
+            su.lat.mz_init_Fe, su.lat.mx_init_Gd, su.lat.my_init_Gd,
+            su.lat.mz_init_Gd);
+        advance_and_normalize_m<P>(ws.mx, ws.my, ws.mz,
+            ws.mx_mid, ws.my_mid, ws.mz_mid,
+            ws.dmx_dt_st1, ws.dmy_dt_st1, ws.dmz_dt_st1, 0.0);
+        const CounterRNG rng(su.control.seed, stream);
+        const double dt = su.control.dt_sec * factor;
+        const auto& Jl = su.lat.J_joule_per_link;
+        const double Hx = su.lat.Hx_appl_tesla, Hy = su.lat.Hy_appl_tesla,
+            Hz = su.lat.Hz_appl_tesla;
+
+        Curve curve;
+        const auto t0 = std::chrono::steady_clock::now();
+        const int n_steps = su.total_steps / factor;
+        for (int n = 0; n <= n_steps; ++n) {
+            const int ref_step = n * factor;
+            if (ref_step % su.sample_steps == 0) {
+                BulkValues bulk{};
+                compute_bulk_m<double>(su.species, ws.mx, ws.my, ws.mz, bulk);
+                curve.points.push_back(bulk);
+            }
+            if (n == n_steps) break;
+            compute_ther_field_counter<P>(su.mat, su.species,
+                su.T_kelvin(ref_step), dt, rng, static_cast<uint64_t>(n),
+                ws.Hx_ther_tesla, ws.Hy_ther_tesla, ws.Hz_ther_tesla);
+            if (integrator == Integrator::DEPONDT) {
+                depondt_predictor_fused<P>(su.mat, Jl, su.neighbors,
+                    su.species, ws.mx, ws.my, ws.mz,
+                    ws.mx_mid, ws.my_mid, ws.mz_mid, Hx, Hy, Hz,
+                    ws.Hx_ther_tesla, ws.Hy_ther_tesla, ws.Hz_ther_tesla, dt,
+                    ws.dmx_dt_st1, ws.dmy_dt_st1, ws.dmz_dt_st1,
+                    ws.mx_pred, ws.my_pred, ws.mz_pred);
+                depondt_corrector_fused<P>(su.mat, Jl, su.neighbors,
+                    su.species, ws.mx_pred, ws.my_pred, ws.mz_pred, Hx, Hy, Hz,
+                    ws.Hx_ther_tesla, ws.Hy_ther_tesla, ws.Hz_ther_tesla,
+                    ws.dmx_dt_st1, ws.dmy_dt_st1, ws.dmz_dt_st1, dt,
+                    ws.mx, ws.my, ws.mz, ws.mx_mid, ws.my_mid, ws.mz_mid);
+            }
+            else {
+                heun_predictor_fused<P>(su.mat, Jl, su.neighbors,
+                    su.species, ws.mx, ws.my, ws.mz,
+                    ws.mx_mid, ws.my_mid, ws.mz_mid, Hx, Hy, Hz,
+                    ws.Hx_ther_tesla, ws.Hy_ther_tesla, ws.Hz_ther_tesla, dt,
+                    ws.dmx_dt_st1, ws.dmy_dt_st1, ws.dmz_dt_st1,
+                    ws.mx_pred, ws.my_pred, ws.mz_pred);
+                heun_corrector_fused<P>(su.mat, Jl, su.neighbors,
+                    su.species, ws.mx_pred, ws.my_pred, ws.mz_pred, Hx, Hy, Hz,
+                    ws.Hx_ther_tesla, ws.Hy_ther_tesla, ws.Hz_ther_tesla,
+                    ws.dmx_dt_st1, ws.dmy_dt_st1, ws.dmz_dt_st1, dt,
+                    ws.mx, ws.my, ws.mz, ws.mx_mid, ws.my_mid, ws.mz_mid);
+            }
+        }
+        curve.seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - t0).count();
+        return curve;
+    }
+
+    /// RMS over the sample points of |dm_Fe| and |dm_Gd| between two curves
+    /// (a NaN point counts as 2). The RMS, unlike the largest deviation, is
+    /// a stable statistic of the noise between two realizations.
+    void deviation(const Curve& a, const Curve& b, double& d_Fe, double& d_Gd) {
+        const auto dist = [](const double ax, const double ay, const double az,
+            const double bx, const double by, const double bz)
+        {
+            const double d = std::sqrt((ax-bx)*(ax-bx) + (ay-by)*(ay-by) +
+                (az-bz)*(az-bz));
+            return std::isfinite(d) ? d : 2.0;
+        };
+        d_Fe = d_Gd = 0.0;
+        const std::size_t n = std::min(a.points.size(), b.points.size());
+        for (std::size_t r = 0; r < n; ++r) {
+            const BulkValues& p = a.points[r];
+            const BulkValues& q = b.points[r];
+            const double e_Fe = dist(p.mx_Fe, p.my_Fe, p.mz_Fe,
+                q.mx_Fe, q.my_Fe, q.mz_Fe);
+            const double e_Gd = dist(p.mx_Gd, p.my_Gd, p.mz_Gd,
+                q.mx_Gd, q.my_Gd, q.mz_Gd);
+            d_Fe += e_Fe*e_Fe;
+            d_Gd += e_Gd*e_Gd;
+        }
+        d_Fe = std::sqrt(d_Fe / static_cast<double>(std::max<std::size_t>(n, 1)));
+        d_Gd = std::sqrt(d_Gd / static_cast<double>(std::max<std::size_t>(n, 1)));
+    }
+}
+
+int main(int argc, char** argv) {
+    const std::string input = argc > 1 ? argv[1] : "input.csv";
+    const int max_factor = argc > 2 ? std::atoi(argv[2]) : 32;
+    const double tol_arg = argc > 3 ? std::atof(argv[3]) : 0.0;
+    if (max_factor < 2) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [input.csv] [max_factor=32] [tol=auto]\n";
+        return 2;
+    }
+    try {
+        Setup su;
+        if (!read_input_csv(input, su.control, su.lat, su.mat)) return 1;
+        process_input(su.lat, su.mat);
+        set_num_threads(su.control.num_threads);
+        simd::configure(su.control.simd_mode);
+        build_fcc_nn(su.lat.nx, su.lat.ny, su.lat.nz, su.table);
+        su.neighbors = FccNeighbors::from_table(su.table,
+            su.lat.nx, su.lat.ny, su.lat.nz);
+        assign_species_by_fraction(su.lat.N, su.lat.frac_Gd, su.species,
+            su.control.seed);
+        read_temperature_series_csv(su.control.Te_filepath, su.Te_kelvin_arr);
+        su.total_steps = su.control.pre_steps + su.control.run_steps;
+        su.sample_steps = std::max(max_factor, (su.control.save_steps +
+            max_factor - 1) / max_factor * max_factor);
+        su.total_steps = su.total_steps / su.sample_steps * su.sample_steps;
+        if (su.total_steps == 0) {
+            throw std::runtime_error("pre_steps + run_steps < max_factor");
+        }
+
+        const double dt0_fs = su.control.dt_sec * 1e15;
+        const double ps = su.total_steps * su.control.dt_sec * 1e12;
+        std::cout << su.lat.N << " sites, " << su.total_steps
+                  << " reference steps of " << dt0_fs << " fs, compared every "
+                  << su.sample_steps << " steps\n";
+        const Curve ref = run(su, Integrator::HEUN, 1, 0);
+        double floor_Fe = 0.0, floor_Gd = 0.0;
+        for (uint32_t stream = 1; stream <= 3; ++stream) {
+            double d_Fe, d_Gd;
+            deviation(ref, run(su, Integrator::HEUN, 1, stream), d_Fe, d_Gd);
+            floor_Fe = std::max(floor_Fe, d_Fe);
+            floor_Gd = std::max(floor_Gd, d_Gd);
+        }
+        const double tol = tol_arg > 0.0 ? tol_arg :
+            2.0 * std::max(floor_Fe, floor_Gd);
+        std::cout << "Noise floor |dm_Fe| = " << floor_Fe << ", |dm_Gd| = "
+                  << floor_Gd << ", tol = " << tol << "\n"
+                  << "integrator,dt_fs,rms_dm_Fe,rms_dm_Gd,sec_per_ps,ok\n";
+        std::cout << "heun," << dt0_fs << ",0,0," << ref.seconds / ps
+                  << ",ref\n";
+
+        const Integrator schemes[2] = {Integrator::HEUN, Integrator::DEPONDT};
+        const char* names[2] = {"heun", "depondt"};
+        int best[2] = {1, 1};
+        for (int k = 0; k < 2; ++k) {
+            bool ok_so_far = true;
+            for (int f = 2; f <= max_factor; f *= 2) {
+                const Curve c = run(su, schemes[k], f, 0);
+                double d_Fe, d_Gd;
+                deviation(ref, c, d_Fe, d_Gd);
+                const bool ok = d_Fe <= tol && d_Gd <= tol;
+                if (ok && ok_so_far) best[k] = f;
+                ok_so_far = ok_so_far && ok;
+                std::cout << names[k] << "," << dt0_fs * f << "," << d_Fe
+                          << "," << d_Gd << "," << c.seconds / ps << ","
+                          << (ok ? "yes" : "no") << "\n";
+            }
+        }
+        for (int k = 0; k < 2; ++k) {
+            std::cout << "Largest dt reproducing the reference: " << names[k]
+                      << " " << dt0_fs * best[k] << " fs (" << best[k]
+                      << " x dt_sec)\n";
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "dt_convergence: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
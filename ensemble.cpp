@@ -0,0 +1,391 @@
+#include "ensemble.h"
+#include "integrator.h"
+#include "kernels_avx2.h"
+#include "math_utils.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iomanip>
+#include <locale>
+#include <stdexcept>
+#include <type_traits>
+
+namespace {
+    /// Replicas per chunk of the portable kernels: their exchange sums stay
+    /// in registers/L1.
+    constexpr int CHUNK = 8;
+
+    /// Per-species constants of a Heun stage in Acc, cast exactly as in
+    /// exch_field_at, anis_field_at and LlgConst, so each replica gets the
+    /// bits of the single run.
+    template <typename Acc>
+    struct StageConst {
+        Acc J[2][2], inv_mu[2];
+        Acc mu[2], ku[2], ex[2], ey[2], ez[2];
+        Acc gamma_prime[2], alpha[2];
+        Acc Hx_appl, Hy_appl, Hz_appl, h;
+
+        StageConst(const MatParams mat[2], const double J_joule_per_link[2][2],
+            const double Hx_appl_tesla, const double Hy_appl_tesla,
+            const double Hz_appl_tesla, const double h_sec)
+            : Hx_appl(static_cast<Acc>(Hx_appl_tesla)),
+              Hy_appl(static_cast<Acc>(Hy_appl_tesla)),
+              Hz_appl(static_cast<Acc>(Hz_appl_tesla)),
+              h(static_cast<Acc>(h_sec))
+        {
+            const LlgConst<Acc> llg(mat);
+            for (int a = 0; a < 2; ++a) {
+                for (int b = 0; b < 2; ++b) {
+                    J[a][b] = static_cast<Acc>(J_joule_per_link[a][b] *
+                        constants::EXCH_FACTOR);
+                }
+                inv_mu[a] = static_cast<Acc>(1.0 / mat[a].mu_ampere_m2);
+                mu[a] = static_cast<Acc>(mat[a].mu_ampere_m2);
+                ku[a] = static_cast<Acc>(mat[a].ku_joule_per_atom);
+                ex[a] = static_cast<Acc>(mat[a].easy_axis.x);
+                ey[a] = static_cast<Acc>(mat[a].easy_axis.y);
+                ez[a] = static_cast<Acc>(mat[a].easy_axis.z);
+                gamma_prime[a] = llg.gamma_prime[a];
+                alpha[a] = llg.alpha[a];
+            }
+        }
+    };
+
+    /// Arrays of a stage. Predictor: exchange and fields at m_mid (f*),
+    /// writes dm/dt_st1 and m_pred (out*). Corrector: at m_pred (f*),
+    /// advances m and writes m_mid (out*).
+    template <typename Real>
+    struct StageArrays {
+        const uint8_t* species;
+        const Real *fx, *fy, *fz;
+        const Real *Hx_ther, *Hy_ther, *Hz_ther;
+        Real *mx, *my, *mz;
+        Real *dmx_st1, *dmy_st1, *dmz_st1;
+        Real *outx, *outy, *outz;
+    };
+
+    /// One Heun stage for replicas r0 .. r0 + n - 1 (n <= CHUNK) of one site,
+    /// k0 = i*R + r0, whose neighbors' values start at o[j]: exchange sums
+    /// over the 12 neighbors, then the LLG step of each replica.
+    template <bool CORRECTOR, typename Acc, typename Real>
+    inline void stage_chunk(const StageConst<Acc>& c, const StageArrays<Real>& a,
+        const SiteIndex k0, const SiteIndex o[constants::FCC_NN_COUNT],
+        const int n)
+    {
+        const uint8_t* sp = a.species;
+        Acc hx[CHUNK]{}, hy[CHUNK]{}, hz[CHUNK]{};
+        for (int j = 0; j < constants::FCC_NN_COUNT; ++j) {
+            const SiteIndex oj = o[j];
+            for (int r = 0; r < n; ++r) {
+                const Acc J_ij = c.J[sp[k0 + r]][sp[oj + r]];
+                hx[r] += J_ij * static_cast<Acc>(a.fx[oj + r]);
+                hy[r] += J_ij * static_cast<Acc>(a.fy[oj + r]);
+                hz[r] += J_ij * static_cast<Acc>(a.fz[oj + r]);
+            }
+        }
+
+        for (int r = 0; r < n; ++r) {
+            const SiteIndex k = k0 + r;
+            const int s = sp[k];
+            const Acc mx_k = a.fx[k], my_k = a.fy[k], mz_k = a.fz[k];
+            // anis_field_at
+            const Acc dot = mx_k*c.ex[s] + my_k*c.ey[s] + mz_k*c.ez[s];
+            const Acc Hx_anis = Acc(2.)*c.ku[s]*dot*c.ex[s] / c.mu[s];
+            const Acc Hy_anis = Acc(2.)*c.ku[s]*dot*c.ey[s] / c.mu[s];
+            const Acc Hz_anis = Acc(2.)*c.ku[s]*dot*c.ez[s] / c.mu[s];
+            const Acc Hx_total = c.Hx_appl + hx[r]*c.inv_mu[s] + Hx_anis + Acc(a.Hx_ther[k]);
+            const Acc Hy_total = c.Hy_appl + hy[r]*c.inv_mu[s] + Hy_anis + Acc(a.Hy_ther[k]);
+            const Acc Hz_total = c.Hz_appl + hz[r]*c.inv_mu[s] + Hz_anis + Acc(a.Hz_ther[k]);
+
+            Acc dmx_dt, dmy_dt, dmz_dt;
+            llg_rhs_at<Acc>(c.gamma_prime[s], c.alpha[s],
+                mx_k, my_k, mz_k, Hx_total, Hy_total, Hz_total,
+                dmx_dt, dmy_dt, dmz_dt);
+
+            if constexpr (!CORRECTOR) {
+                a.dmx_st1[k] = dmx_dt;
+                a.dmy_st1[k] = dmy_dt;
+                a.dmz_st1[k] = dmz_dt;
+                Acc mx_p = Acc(a.mx[k]) + c.h * dmx_dt;
+                Acc my_p = Acc(a.my[k]) + c.h * dmy_dt;
+                Acc mz_p = Acc(a.mz[k]) + c.h * dmz_dt;
+                normalize3(mx_p, my_p, mz_p);
+                a.outx[k] = mx_p;
+                a.outy[k] = my_p;
+                a.outz[k] = mz_p;
+            }
+            else {
+                Acc mx_n = Acc(a.mx[k]) + c.h * Acc(0.5) * (Acc(a.dmx_st1[k]) + dmx_dt);
+                Acc my_n = Acc(a.my[k]) + c.h * Acc(0.5) * (Acc(a.dmy_st1[k]) + dmy_dt);
+                Acc mz_n = Acc(a.mz[k]) + c.h * Acc(0.5) * (Acc(a.dmz_st1[k]) + dmz_dt);
+                normalize3(mx_n, my_n, mz_n);
+                a.mx[k] = mx_n;
+                a.my[k] = my_n;
+                a.mz[k] = mz_n;
+                normalize3(mx_n, my_n, mz_n);
+                a.outx[k] = mx_n;
+                a.outy[k] = my_n;
+                a.outz[k] = mz_n;
+            }
+        }
+    }
+
+    /// One Heun stage of the replica values k = i*R + r, r >= r_begin:
+    /// cell by cell (the row partition of the single-run kernels), per site
+    /// in chunks of replicas. Per replica the exchange sum is the one of
+    /// exch_field_at (same J, order and rounding).
+    template <bool CORRECTOR, typename Acc, typename Real>
+    void sweep_stage(const FccNeighbors& neighbors, const int R,
+        const int r_begin, const StageConst<Acc>& c, const StageArrays<Real>& a)
+    {
+        #pragma omp parallel for schedule(static)
+        for (int row=0; row < neighbors.n_rows(); ++row) {
+            const int ci = row / neighbors.ny, cj = row % neighbors.ny;
+            FccNeighbors::WideList scratch[constants::FCC_BASIS_COUNT];
+            for (int ck=0; ck < neighbors.nz; ++ck) {
+                const SiteIndex p = neighbors.first_site(row, ck);
+                neighbors.visit_cell(p, ci, cj, ck, scratch,
+                    [&](const auto* nb4) {
+                    for (int b=0; b < constants::FCC_BASIS_COUNT; ++b) {
+                        const SiteIndex i = p + b;
+                        for (int r0 = r_begin; r0 < R; r0 += CHUNK) {
+                            SiteIndex o[constants::FCC_NN_COUNT];
+                            for (int j = 0; j < constants::FCC_NN_COUNT; ++j) {
+                                o[j] = static_cast<SiteIndex>(nb4[b][j])*R + r0;
+                            }
+                            stage_chunk<CORRECTOR>(c, a, i*R + r0, o,
+                                std::min(CHUNK, R - r0));
+                        }
+                    }
+                });
+            }
+        }
+    }
+}
+
+namespace ensemble {
+    template <typename P>
+    void ther_field(const MatParams mat[2], std::span<const uint8_t> species,
+        const int R, const double T_kelvin, const double dt_sec,
+        const uint32_t seed, const uint64_t step,
+        std::span<typename P::real> Hx_ther_tesla,
+        std::span<typename P::real> Hy_ther_tesla,
+        std::span<typename P::real> Hz_ther_tesla,
+        const SitePermutation* perm)
+    {
+        double sigma_tesla[2];
+        for (int s=0; s < 2; ++s) {
+            sigma_tesla[s] =
+                std::sqrt(2. * mat[s].alpha * constants::KB_JOULE_PER_KELVIN
+                    * T_kelvin / (mat[s].gamma_rad_per_tesla_sec
+                    * mat[s].mu_ampere_m2 * dt_sec));
+        }
+        const SiteIndex N = static_cast<SiteIndex>(species.size()) / R;
+        const int* to_lattice = (perm && !perm->is_identity()) ?
+            perm->to_lattice.data() : nullptr;
+        #pragma omp parallel for schedule(static)
+        for (SiteIndex i=0; i < N; ++i) {
+            const SiteIndex p = to_lattice ? to_lattice[i] : i;
+            for (int r = 0; r < R; ++r) {
+                const SiteIndex k = i*R + r;
+                const double sigma = sigma_tesla[species[k]];
+                double zx, zy, zz;
+                CounterRNG(seed, static_cast<uint32_t>(r)).normal3(step,
+                    static_cast<uint64_t>(p), zx, zy, zz);
+                Hx_ther_tesla[k] = static_cast<typename P::real>(sigma * zx);
+                Hy_ther_tesla[k] = static_cast<typename P::real>(sigma * zy);
+                Hz_ther_tesla[k] = static_cast<typename P::real>(sigma * zz);
+            }
+        }
+    }
+
+    template <typename P>
+    void heun_predictor(const MatParams mat[2],
+        const double J_joule_per_link[2][2], const FccNeighbors& neighbors,
+        std::span<const uint8_t> species, const int R,
+        std::span<const typename P::real> mx,
+        std::span<const typename P::real> my,
+        std::span<const typename P::real> mz,
+        std::span<const typename P::real> mx_mid,
+        std::span<const typename P::real> my_mid,
+        std::span<const typename P::real> mz_mid,
+        const double Hx_appl_tesla, const double Hy_appl_tesla,
+        const double Hz_appl_tesla,
+        std::span<const typename P::real> Hx_ther_tesla,
+        std::span<const typename P::real> Hy_ther_tesla,
+        std::span<const typename P::real> Hz_ther_tesla,
+        const double h_sec,
+        std::span<typename P::real> dmx_dt_st1,
+        std::span<typename P::real> dmy_dt_st1,
+        std::span<typename P::real> dmz_dt_st1,
+        std::span<typename P::real> mx_pred,
+        std::span<typename P::real> my_pred,
+        std::span<typename P::real> mz_pred)
+    {
+        using Real = typename P::real;
+        const StageConst<typename P::acc> c(mat, J_joule_per_link,
+            Hx_appl_tesla, Hy_appl_tesla, Hz_appl_tesla, h_sec);
+        // m is only read by the predictor.
+        const StageArrays<Real> a{species.data(),
+            mx_mid.data(), my_mid.data(), mz_mid.data(),
+            Hx_ther_tesla.data(), Hy_ther_tesla.data(), Hz_ther_tesla.data(),
+            const_cast<Real*>(mx.data()), const_cast<Real*>(my.data()),
+            const_cast<Real*>(mz.data()),
+            dmx_dt_st1.data(), dmy_dt_st1.data(), dmz_dt_st1.data(),
+            mx_pred.data(), my_pred.data(), mz_pred.data()};
+        int r_begin = 0;
+        if constexpr (std::is_same_v<P, PrecDouble>) {
+            const double H_appl_tesla[3] = {Hx_appl_tesla, Hy_appl_tesla,
+                Hz_appl_tesla};
+            r_begin = simd::ensemble_heun_predictor(R, mat, J_joule_per_link,
+                neighbors, species.data(), mx.data(), my.data(), mz.data(),
+                mx_mid.data(), my_mid.data(), mz_mid.data(), H_appl_tesla,
+                Hx_ther_tesla.data(), Hy_ther_tesla.data(),
+                Hz_ther_tesla.data(), h_sec,
+                dmx_dt_st1.data(), dmy_dt_st1.data(), dmz_dt_st1.data(),
+                mx_pred.data(), my_pred.data(), mz_pred.data());
+        }
+        if (r_begin < R) sweep_stage<false>(neighbors, R, r_begin, c, a);
+    }
+
+    template <typename P>
+    void heun_corrector(const MatParams mat[2],
+        const double J_joule_per_link[2][2], const FccNeighbors& neighbors,
+        std::span<const uint8_t> species, const int R,
+        std::span<const typename P::real> mx_pred,
+        std::span<const typename P::real> my_pred,
+        std::span<const typename P::real> mz_pred,
+        const double Hx_appl_tesla, const double Hy_appl_tesla,
+        const double Hz_appl_tesla,
+        std::span<const typename P::real> Hx_ther_tesla,
+        std::span<const typename P::real> Hy_ther_tesla,
+        std::span<const typename P::real> Hz_ther_tesla,
+        std::span<const typename P::real> dmx_dt_st1,
+        std::span<const typename P::real> dmy_dt_st1,
+        std::span<const typename P::real> dmz_dt_st1,
+        const double h_sec,
+        std::span<typename P::real> mx,
+        std::span<typename P::real> my,
+        std::span<typename P::real> mz,
+        std::span<typename P::real> mx_mid,
+        std::span<typename P::real> my_mid,
+        std::span<typename P::real> mz_mid)
+    {
+        using Real = typename P::real;
+        const StageConst<typename P::acc> c(mat, J_joule_per_link,
+            Hx_appl_tesla, Hy_appl_tesla, Hz_appl_tesla, h_sec);
+        // dm/dt_st1 is only read by the corrector.
+        const StageArrays<Real> a{species.data(),
+            mx_pred.data(), my_pred.data(), mz_pred.data(),
+            Hx_ther_tesla.data(), Hy_ther_tesla.data(), Hz_ther_tesla.data(),
+            mx.data(), my.data(), mz.data(),
+            const_cast<Real*>(dmx_dt_st1.data()),
+            const_cast<Real*>(dmy_dt_st1.data()),
+            const_cast<Real*>(dmz_dt_st1.data()),
+            mx_mid.data(), my_mid.data(), mz_mid.data()};
+        int r_begin = 0;
+        if constexpr (std::is_same_v<P, PrecDouble>) {
+            const double H_appl_tesla[3] = {Hx_appl_tesla, Hy_appl_tesla,
+                Hz_appl_tesla};
+            r_begin = simd::ensemble_heun_corrector(R, mat, J_joule_per_link,
+                neighbors, species.data(), mx_pred.data(), my_pred.data(),
+                mz_pred.data(), H_appl_tesla,
+                Hx_ther_tesla.data(), Hy_ther_tesla.data(),
+                Hz_ther_tesla.data(),
+                dmx_dt_st1.data(), dmy_dt_st1.data(), dmz_dt_st1.data(),
+                h_sec, mx.data(), my.data(), mz.data(),
+                mx_mid.data(), my_mid.data(), mz_mid.data());
+        }
+        if (r_begin < R) sweep_stage<true>(neighbors, R, r_begin, c, a);
+    }
+
+    template <typename T>
+    void gather(std::span<const T> a, const int R, const int r,
+        std::span<T> out)
+    {
+        const SiteIndex N = static_cast<SiteIndex>(out.size());
+        #pragma omp parallel for schedule(static)
+        for (SiteIndex i = 0; i < N; ++i) out[i] = a[i*R + r];
+    }
+
+    void Moments::add(const BulkValues& b) {
+        const double v[9] = {b.mx_Fe, b.my_Fe, b.mz_Fe, b.mx_Gd, b.my_Gd,
+            b.mz_Gd, b.mx_bulk, b.my_bulk, b.mz_bulk};
+        ++n_;
+        for (int c = 0; c < 9; ++c) {
+            const double d = v[c] - mean_[c];
+            mean_[c] += d / n_;
+            m2_[c] += d * (v[c] - mean_[c]);
+        }
+    }
+
+    MomentsWriter::MomentsWriter(const std::string& path) {
+        try {
+            if (const std::filesystem::path p(path); !p.parent_path().empty()) {
+                std::filesystem::create_directories(p.parent_path());
+            }
+        } catch (const std::exception& e) {
+            throw std::runtime_error(std::string(
+                "ensemble:MomentsWriter: Failed to create directories: ")
+                + e.what());
+        }
+        ofs_.open(path, std::ios::out | std::ios::trunc);
+        if (!ofs_) {
+            throw std::runtime_error(
+                "ensemble:MomentsWriter: Failed to open file: " + path);
+        }
+        ofs_.imbue(std::locale::classic());
+        ofs_ << std::defaultfloat << std::setprecision(10);
+        ofs_ << "time_step,T_kelvin,n_replicas";
+        for (const char* c : {"mx_Fe", "my_Fe", "mz_Fe", "mx_Gd", "my_Gd",
+            "mz_Gd", "mx_bulk", "my_bulk", "mz_bulk"}) {
+            ofs_ << ',' << c << "_mean," << c << "_var";
+        }
+        ofs_ << '\n';
+    }
+
+    void MomentsWriter::append(const int time_step, const double T_kelvin,
+        const Moments& m)
+    {
+        ofs_ << time_step << ',' << T_kelvin << ',' << m.count();
+        for (int c = 0; c < 9; ++c) {
+            ofs_ << ',' << m.mean(c) << ',' << m.variance(c);
+        }
+        ofs_ << '\n';
+    }
+
+#define INSTANTIATE_ENSEMBLE(P) \
+    template void ther_field<P>(const MatParams[2], std::span<const uint8_t>, \
+        int, double, double, uint32_t, uint64_t, std::span<P::real>, \
+        std::span<P::real>, std::span<P::real>, const SitePermutation*); \
+    template void heun_predictor<P>(const MatParams[2], const double[2][2], \
+        const FccNeighbors&, std::span<const uint8_t>, int, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, std::span<const P::real>, \
+        double, double, double, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, double, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>); \
+    template void heun_corrector<P>(const MatParams[2], const double[2][2], \
+        const FccNeighbors&, std::span<const uint8_t>, int, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, double, double, double, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, std::span<const P::real>, double, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>);
+
+    INSTANTIATE_ENSEMBLE(PrecDouble)
+    INSTANTIATE_ENSEMBLE(PrecMixed)
+    INSTANTIATE_ENSEMBLE(PrecFloat)
+
+    template void gather<double>(std::span<const double>, int, int,
+        std::span<double>);
+    template void gather<float>(std::span<const float>, int, int,
+        std::span<float>);
+    template void gather<uint8_t>(std::span<const uint8_t>, int, int,
+        std::span<uint8_t>);
+}
@@ -0,0 +1,114 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+#include <cstdint>
+#include <fstream>
+#include <span>
+#include <string>
+#include <vector>
+#include "lattice.h"
+#include "params.h"
+#include "precision.h"
+#include "rng.h"
+
+/// R replicas of one lattice in one process (input column replicas = R):
+/// they share the neighbor table (or stencil), the temperature series and
+/// the parameters. The per-site arrays hold the R values of a site next to
+/// each other (replica-innermost: replica r of site i at i*R + r), so the
+/// exchange sum runs over R contiguous values per neighbor and vectorizes
+/// across the replicas, and the neighbor list of a site is read once for
+/// all of them. Replica r draws its thermal noise from Philox stream r
+/// (replica 0 is the single run with rng=philox, bit for bit). Species are
+/// per replica and site (species[i*R + r]) so that replicas may have their
+/// own disorder. The kernels follow heun_predictor_fused and
+/// heun_corrector_fused site by site (same bits per replica).
+namespace ensemble {
+    template <typename P>
+    void ther_field(const MatParams mat[2], std::span<const uint8_t> species,
+        int R, double T_kelvin, double dt_sec, uint32_t seed, uint64_t step,
+        std::span<typename P::real> Hx_ther_tesla,
+        std::span<typename P::real> Hy_ther_tesla,
+        std::span<typename P::real> Hz_ther_tesla,
+        const SitePermutation* perm = nullptr);
+
+    /// Heun stage 1 of all replicas: dm/dt_st1 and m_pred from m, m_mid.
+    template <typename P>
+    void heun_predictor(const MatParams mat[2],
+        const double J_joule_per_link[2][2], const FccNeighbors& neighbors,
+        std::span<const uint8_t> species, int R,
+        std::span<const typename P::real> mx,
+        std::span<const typename P::real> my,
+        std::span<const typename P::real> mz,
+        std::span<const typename P::real> mx_mid,
+        std::span<const typename P::real> my_mid,
+        std::span<const typename P::real> mz_mid,
+        double Hx_appl_tesla, double Hy_appl_tesla, double Hz_appl_tesla,
+        std::span<const typename P::real> Hx_ther_tesla,
+        std::span<const typename P::real> Hy_ther_tesla,
+        std::span<const typename P::real> Hz_ther_tesla,
+        double h_sec,
+        std::span<typename P::real> dmx_dt_st1,
+        std::span<typename P::real> dmy_dt_st1,
+        std::span<typename P::real> dmz_dt_st1,
+        std::span<typename P::real> mx_pred,
+        std::span<typename P::real> my_pred,
+        std::span<typename P::real> mz_pred);
+
+    /// Heun stage 2 of all replicas: advances m and refreshes m_mid.
+    template <typename P>
+    void heun_corrector(const MatParams mat[2],
+        const double J_joule_per_link[2][2], const FccNeighbors& neighbors,
+        std::span<const uint8_t> species, int R,
+        std::span<const typename P::real> mx_pred,
+        std::span<const typename P::real> my_pred,
+        std::span<const typename P::real> mz_pred,
+        double Hx_appl_tesla, double Hy_appl_tesla, double Hz_appl_tesla,
+        std::span<const typename P::real> Hx_ther_tesla,
+        std::span<const typename P::real> Hy_ther_tesla,
+        std::span<const typename P::real> Hz_ther_tesla,
+        std::span<const typename P::real> dmx_dt_st1,
+        std::span<const typename P::real> dmy_dt_st1,
+        std::span<const typename P::real> dmz_dt_st1,
+        double h_sec,
+        std::span<typename P::real> mx,
+        std::span<typename P::real> my,
+        std::span<typename P::real> mz,
+        std::span<typename P::real> mx_mid,
+        std::span<typename P::real> my_mid,
+        std::span<typename P::real> mz_mid);
+
+    /// Values of replica r (out[i] = a[i*R + r]), for the per-replica
+    /// reductions; instantiated for double, float and uint8_t.
+    template <typename T>
+    void gather(std::span<const T> a, int R, int r, std::span<T> out);
+
+    /// Mean and sample variance over the replicas of the 9 bulk
+    /// magnetizations of one saved step (Welford, one replica at a time).
+    class Moments {
+    public:
+        void add(const BulkValues& b);
+        int count() const { return n_; }
+        double mean(int c) const { return mean_[c]; }
+        double variance(int c) const {
+            return n_ > 1 ? m2_[c] / (n_ - 1) : 0.0;
+        }
+
+    private:
+        int n_{0};
+        double mean_[9]{};
+        double m2_[9]{};
+    };
+
+    /// ensemble_mean.csv: time_step, T_kelvin, then <column>_mean and
+    /// <column>_var of mx_Fe .. mz_bulk. Rows are appended as the run goes.
+    /// Throws std::runtime_error("ensemble:MomentsWriter: ...").
+    class MomentsWriter {
+    public:
+        explicit MomentsWriter(const std::string& path);
+        void append(int time_step, double T_kelvin, const Moments& m);
+
+    private:
+        std::ofstream ofs_;
+    };
+}
+
+#endif //ENSEMBLE_H
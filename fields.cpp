@@ -1,81 +1,84 @@
 #include "fields.h"
+#include "kernels_avx2.h"
 #include <array>
 #include <cmath>
 #include <iostream>
 #include <vector>
 
+template <typename P>
 void compute_exch_field(
     const MatParams mat[2],
     const double J_joule_per_link[2][2],
     const std::vector<std::array<int, constants::FCC_NN_COUNT>>&
     nearest_neighbors,
     const std::vector<uint8_t>& species,
-    const std::vector<double>& mx,
-    const std::vector<double>& my,
-    const std::vector<double>& mz,
-    std::vector<double>& Hx_exch_tesla,
-    std::vector<double>& Hy_exch_tesla,
-    std::vector<double>& Hz_exch_tesla)
+    std::span<const typename P::real> mx,
+    std::span<const typename P::real> my,
+    std::span<const typename P::real> mz,
+    std::span<typename P::real> Hx_exch_tesla,
+    std::span<typename P::real> Hy_exch_tesla,
+    std::span<typename P::real> Hz_exch_tesla)
 {
-    const int N = static_cast<int>(species.size());
-    for (int i=0; i < N; ++i) {
-        const int si = species[i];
-        const double inv_mu_per_ampere_m2 = 1.0 / mat[si].mu_ampere_m2;
-        double Hx_exch_joule = 0.0, Hy_exch_joule = 0.0, Hz_exch_joule = 0.0;
-
-        for (const int j : nearest_neighbors[i]) {
-            const int sj = species[j];
-            // TODO: Discuss again whether should use factor of 2.
-            const double J_ij_joule_per_link =
-                J_joule_per_link[si][sj] * constants::EXCH_FACTOR;
-            Hx_exch_joule += J_ij_joule_per_link * mx[j];
-            Hy_exch_joule += J_ij_joule_per_link * my[j];
-            Hz_exch_joule += J_ij_joule_per_link * mz[j];
-        }
-        Hx_exch_tesla[i] = Hx_exch_joule * inv_mu_per_ampere_m2;
-        Hy_exch_tesla[i] = Hy_exch_joule * inv_mu_per_ampere_m2;
-        Hz_exch_tesla[i] = Hz_exch_joule * inv_mu_per_ampere_m2;
+    using Acc = typename P::acc;
+    const SiteIndex N = static_cast<SiteIndex>(species.size());
+    SiteIndex i0 = 0;
+    if constexpr (P::is_double) {
+        i0 = simd::exch_field(N, mat, J_joule_per_link,
+            nearest_neighbors.data(), species.data(), mx.data(), my.data(),
+            mz.data(), Hx_exch_tesla.data(), Hy_exch_tesla.data(),
+            Hz_exch_tesla.data());
+    }
+    #pragma omp parallel for schedule(static)
+    for (SiteIndex i=i0; i < N; ++i) {
+        Acc Hx, Hy, Hz;
+        exch_field_at(i, nearest_neighbors[i], mat, J_joule_per_link, species,
+            mx, my, mz, Hx, Hy, Hz);
+        Hx_exch_tesla[i] = Hx;
+        Hy_exch_tesla[i] = Hy;
+        Hz_exch_tesla[i] = Hz;
     }
 }
 
+template <typename P>
 void compute_uniaxial_anis_field(
     const MatParams mat[2],
     const std::vector<uint8_t>& species,
-    const std::vector<double>& mx_arr,
-    const std::vector<double>& my_arr,
-    const std::vector<double>& mz_arr,
-    std::vector<double>& Hx_anis_tesla,
-    std::vector<double>& Hy_anis_tesla,
-    std::vector<double>& Hz_anis_tesla)
+    std::span<const typename P::real> mx_arr,
+    std::span<const typename P::real> my_arr,
+    std::span<const typename P::real> mz_arr,
+    std::span<typename P::real> Hx_anis_tesla,
+    std::span<typename P::real> Hy_anis_tesla,
+    std::span<typename P::real> Hz_anis_tesla)
 {
-    const int N = static_cast<int>(species.size());
-    for (int i=0; i < N; ++i) {
-        const int s = species[i];
-        const double mu_ampere_m2      = mat[s].mu_ampere_m2;
-        const double ku_joule_per_atom = mat[s].ku_joule_per_atom;
-        const Vec3   easy_axis         = mat[s].easy_axis;
-        const double mx = mx_arr[i];
-        const double my = my_arr[i];
-        const double mz = mz_arr[i];
-
-        const double dot =
-            mx*easy_axis.x + my*easy_axis.y + mz*easy_axis.z;
-        Hx_anis_tesla[i] = 2.*ku_joule_per_atom*dot*easy_axis.x / mu_ampere_m2;
-        Hy_anis_tesla[i] = 2.*ku_joule_per_atom*dot*easy_axis.y / mu_ampere_m2;
-        Hz_anis_tesla[i] = 2.*ku_joule_per_atom*dot*easy_axis.z / mu_ampere_m2;
+    using Acc = typename P::acc;
+    const SiteIndex N = static_cast<SiteIndex>(species.size());
+    #pragma omp parallel for schedule(static)
+    for (SiteIndex i=0; i < N; ++i) {
+        Acc Hx, Hy, Hz;
+        anis_field_at<Acc>(mat[species[i]], mx_arr[i], my_arr[i], mz_arr[i],
+            Hx, Hy, Hz);
+        Hx_anis_tesla[i] = Hx;
+        Hy_anis_tesla[i] = Hy;
+        Hz_anis_tesla[i] = Hz;
     }
 }
 
 // TODO: May use one normal_distribution instead of building three in each step.
+template <typename P>
 void compute_ther_field_once(const MatParams mat[2],
     const std::vector<uint8_t>& species,
     double T_kelvin, double dt_sec, RNG& rng,
-    std::vector<double>& Hx_ther_tesla,
-    std::vector<double>& Hy_ther_tesla,
-    std::vector<double>& Hz_ther_tesla)
+    std::span<typename P::real> Hx_ther_tesla,
+    std::span<typename P::real> Hy_ther_tesla,
+    std::span<typename P::real> Hz_ther_tesla,
+    const SitePermutation* perm)
 {
-    const int N = static_cast<int>(species.size());
-    for (int i=0; i < N; ++i) {
+    // Serial on purpose: the draws come from one sequential generator, so the
+    // noise sequence must not depend on the thread schedule.
+    const SiteIndex N = static_cast<SiteIndex>(species.size());
+    for (SiteIndex p=0; p < N; ++p) {
+        const SiteIndex i = (perm && !perm->is_identity()) ?
+            perm->to_site[p] : p;
         const int s = species[i];
         const double alpha = mat[s].alpha;
         const double gamma_rad_per_tesla_sec =
@@ -85,48 +88,128 @@ void compute_ther_field_once(const MatParams mat[2],
         const double sigma_tesla =
             std::sqrt(2. * alpha * constants::KB_JOULE_PER_KELVIN * T_kelvin
                 / (gamma_rad_per_tesla_sec * mu_ampere_m2 * dt_sec));
-        Hx_ther_tesla[i] = sigma_tesla * rng.normal(0.0, 1.0);
-        Hy_ther_tesla[i] = sigma_tesla * rng.normal(0.0, 1.0);
-        Hz_ther_tesla[i] = sigma_tesla * rng.normal(0.0, 1.0);
+        Hx_ther_tesla[i] = static_cast<typename P::real>(
+            sigma_tesla * rng.normal(0.0, 1.0));
+        Hy_ther_tesla[i] = static_cast<typename P::real>(
+            sigma_tesla * rng.normal(0.0, 1.0));
+        Hz_ther_tesla[i] = static_cast<typename P::real>(
+            sigma_tesla * rng.normal(0.0, 1.0));
     }
 }
 
+template <typename P>
+void compute_ther_field_counter(const MatParams mat[2],
+    const std::vector<uint8_t>& species,
+    const double T_kelvin, const double dt_sec, const CounterRNG& rng,
+    const uint64_t step,
+    std::span<typename P::real> Hx_ther_tesla,
+    std::span<typename P::real> Hy_ther_tesla,
+    std::span<typename P::real> Hz_ther_tesla,
+    const SitePermutation* perm)
+{
+    double sigma_tesla[2];
+    for (int s=0; s < 2; ++s) {
+        sigma_tesla[s] =
+            std::sqrt(2. * mat[s].alpha * constants::KB_JOULE_PER_KELVIN
+                * T_kelvin / (mat[s].gamma_rad_per_tesla_sec
+                * mat[s].mu_ampere_m2 * dt_sec));
+    }
+
+    const SiteIndex N = static_cast<SiteIndex>(species.size());
+    const int* to_lattice = (perm && !perm->is_identity()) ?
+        perm->to_lattice.data() : nullptr;
+    #pragma omp parallel for schedule(static)
+    for (SiteIndex i=0; i < N; ++i) {
+        const double sigma = sigma_tesla[species[i]];
+        const SiteIndex p = to_lattice ? to_lattice[i] : i;
+        double zx, zy, zz;
+        rng.normal3(step, static_cast<uint64_t>(p), zx, zy, zz);
+        Hx_ther_tesla[i] = static_cast<typename P::real>(sigma * zx);
+        Hy_ther_tesla[i] = static_cast<typename P::real>(sigma * zy);
+        Hz_ther_tesla[i] = static_cast<typename P::real>(sigma * zz);
+    }
+}
+
+template <typename P>
 void compute_total_field(
     const MatParams mat[2],
     const double J_joule_per_link[2][2],
     const std::vector<std::array<int, constants::FCC_NN_COUNT>>&
     nearest_neighbors,
     const std::vector<uint8_t>& species,
-    const std::vector<double>& mx,
-    const std::vector<double>& my,
-    const std::vector<double>& mz,
+    std::span<const typename P::real> mx,
+    std::span<const typename P::real> my,
+    std::span<const typename P::real> mz,
     double Hx_appl_tesla, double Hy_appl_tesla, double Hz_appl_tesla,
-    std::vector<double>& Hx_exch_tesla,
-    std::vector<double>& Hy_exch_tesla,
-    std::vector<double>& Hz_exch_tesla,
-    std::vector<double>& Hx_anis_tesla,
-    std::vector<double>& Hy_anis_tesla,
-    std::vector<double>& Hz_anis_tesla,
-    const std::vector<double>& Hx_ther_tesla,
-    const std::vector<double>& Hy_ther_tesla,
-    const std::vector<double>& Hz_ther_tesla,
-    std::vector<double>& Hx_total_tesla,
-    std::vector<double>& Hy_total_tesla,
-    std::vector<double>& Hz_total_tesla)
+    std::span<typename P::real> Hx_exch_tesla,
+    std::span<typename P::real> Hy_exch_tesla,
+    std::span<typename P::real> Hz_exch_tesla,
+    std::span<typename P::real> Hx_anis_tesla,
+    std::span<typename P::real> Hy_anis_tesla,
+    std::span<typename P::real> Hz_anis_tesla,
+    std::span<const typename P::real> Hx_ther_tesla,
+    std::span<const typename P::real> Hy_ther_tesla,
+    std::span<const typename P::real> Hz_ther_tesla,
+    std::span<typename P::real> Hx_total_tesla,
+    std::span<typename P::real> Hy_total_tesla,
+    std::span<typename P::real> Hz_total_tesla)
 {
-    compute_exch_field(mat, J_joule_per_link, nearest_neighbors, species,
+    compute_exch_field<P>(mat, J_joule_per_link, nearest_neighbors, species,
         mx, my, mz,
         Hx_exch_tesla, Hy_exch_tesla, Hz_exch_tesla);
-    compute_uniaxial_anis_field(mat, species,
+    compute_uniaxial_anis_field<P>(mat, species,
         mx, my, mz,
         Hx_anis_tesla, Hy_anis_tesla, Hz_anis_tesla);
 
-    for (int i=0; i < Hx_total_tesla.size(); ++i) {
-        Hx_total_tesla[i] = Hx_appl_tesla +
-            Hx_exch_tesla[i] + Hx_anis_tesla[i] + Hx_ther_tesla[i];
-        Hy_total_tesla[i] = Hy_appl_tesla +
-            Hy_exch_tesla[i] + Hy_anis_tesla[i] + Hy_ther_tesla[i];
-        Hz_total_tesla[i] = Hz_appl_tesla +
-            Hz_exch_tesla[i] + Hz_anis_tesla[i] + Hz_ther_tesla[i];
+    using Acc = typename P::acc;
+    const Acc Hx_appl = static_cast<Acc>(Hx_appl_tesla);
+    const Acc Hy_appl = static_cast<Acc>(Hy_appl_tesla);
+    const Acc Hz_appl = static_cast<Acc>(Hz_appl_tesla);
+    const SiteIndex N = static_cast<SiteIndex>(Hx_total_tesla.size());
+    #pragma omp parallel for schedule(static)
+    for (SiteIndex i=0; i < N; ++i) {
+        Hx_total_tesla[i] = static_cast<typename P::real>(Hx_appl +
+            Acc(Hx_exch_tesla[i]) + Acc(Hx_anis_tesla[i]) + Acc(Hx_ther_tesla[i]));
+        Hy_total_tesla[i] = static_cast<typename P::real>(Hy_appl +
+            Acc(Hy_exch_tesla[i]) + Acc(Hy_anis_tesla[i]) + Acc(Hy_ther_tesla[i]));
+        Hz_total_tesla[i] = static_cast<typename P::real>(Hz_appl +
+            Acc(Hz_exch_tesla[i]) + Acc(Hz_anis_tesla[i]) + Acc(Hz_ther_tesla[i]));
     }
-}
\ No newline at end of file
+}
+#define INSTANTIATE_FIELDS(P) \
+    template void compute_exch_field<P>(const MatParams[2], \
+        const double[2][2], \
+        const std::vector<std::array<int, constants::FCC_NN_COUNT>>&, \
+        const std::vector<uint8_t>&, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>); \
+    template void compute_uniaxial_anis_field<P>(const MatParams[2], \
+        const std::vector<uint8_t>&, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>); \
+    template void compute_ther_field_once<P>(const MatParams[2], \
+        const std::vector<uint8_t>&, double, double, RNG&, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>, \
+        const SitePermutation*); \
+    template void compute_ther_field_counter<P>(const MatParams[2], \
+        const std::vector<uint8_t>&, double, double, const CounterRNG&, \
+        uint64_t, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>, \
+        const SitePermutation*); \
+    template void compute_total_field<P>(const MatParams[2], \
+        const double[2][2], \
+        const std::vector<std::array<int, constants::FCC_NN_COUNT>>&, \
+        const std::vector<uint8_t>&, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, double, double, double, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>);
+
+INSTANTIATE_FIELDS(PrecDouble)
+INSTANTIATE_FIELDS(PrecMixed)
+INSTANTIATE_FIELDS(PrecFloat)
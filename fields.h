@@ -1,62 +1,171 @@
 #ifndef FIELDS_H
 #define FIELDS_H
 #include <cstdint>
+#include <span>
 #include <vector>
+#include "lattice.h"
 #include "params.h"
+#include "precision.h"
 #include "rng.h"
 
+/// Exchange field at site i (tesla), computed in Acc from Real moments.
+/// Shared by compute_exch_field and the fused Heun kernels so both produce
+/// identical bits. Index is int for table entries, SiteIndex for the
+/// stencil (FccNeighbors::List / WideList).
+template <typename Acc, typename Real, typename Index>
+inline void exch_field_at(const SiteIndex i,
+    const std::array<Index, constants::FCC_NN_COUNT>& neighbors_of_i,
+    const MatParams mat[2],
+    const double J_joule_per_link[2][2],
+    const std::vector<uint8_t>& species,
+    std::span<const Real> mx,
+    std::span<const Real> my,
+    std::span<const Real> mz,
+    Acc& Hx_exch_tesla, Acc& Hy_exch_tesla, Acc& Hz_exch_tesla)
+{
+    const int si = species[i];
+    const Acc inv_mu_per_ampere_m2 = static_cast<Acc>(1.0 / mat[si].mu_ampere_m2);
+    Acc Hx_exch_joule = 0.0, Hy_exch_joule = 0.0, Hz_exch_joule = 0.0;
+
+    for (const Index j : neighbors_of_i) {
+        const int sj = species[j];
+        // TODO: Discuss again whether should use factor of 2.
+        const Acc J_ij_joule_per_link = static_cast<Acc>(
+            J_joule_per_link[si][sj] * constants::EXCH_FACTOR);
+        Hx_exch_joule += J_ij_joule_per_link * static_cast<Acc>(mx[j]);
+        Hy_exch_joule += J_ij_joule_per_link * static_cast<Acc>(my[j]);
+        Hz_exch_joule += J_ij_joule_per_link * static_cast<Acc>(mz[j]);
+    }
+    Hx_exch_tesla = Hx_exch_joule * inv_mu_per_ampere_m2;
+    Hy_exch_tesla = Hy_exch_joule * inv_mu_per_ampere_m2;
+    Hz_exch_tesla = Hz_exch_joule * inv_mu_per_ampere_m2;
+}
+
+/// exch_field_at for the species-partitioned order (FccNeighbors::
+/// species_split): the neighbor species is j >= species_split, so no species
+/// array is read, and J_row = J[s_i], inv_mu = 1/mu[s_i] are hoisted by the
+/// caller. Same bits as exch_field_at.
+template <typename Acc, typename Real>
+inline void exch_field_split_at(
+    const std::array<int, constants::FCC_NN_COUNT>& neighbors_of_i,
+    const double J_row_joule_per_link[2], const Acc inv_mu_per_ampere_m2,
+    const int species_split,
+    std::span<const Real> mx,
+    std::span<const Real> my,
+    std::span<const Real> mz,
+    Acc& Hx_exch_tesla, Acc& Hy_exch_tesla, Acc& Hz_exch_tesla)
+{
+    Acc Hx_exch_joule = 0.0, Hy_exch_joule = 0.0, Hz_exch_joule = 0.0;
+    for (const int j : neighbors_of_i) {
+        const Acc J_ij_joule_per_link = static_cast<Acc>(
+            J_row_joule_per_link[j >= species_split] * constants::EXCH_FACTOR);
+        Hx_exch_joule += J_ij_joule_per_link * static_cast<Acc>(mx[j]);
+        Hy_exch_joule += J_ij_joule_per_link * static_cast<Acc>(my[j]);
+        Hz_exch_joule += J_ij_joule_per_link * static_cast<Acc>(mz[j]);
+    }
+    Hx_exch_tesla = Hx_exch_joule * inv_mu_per_ampere_m2;
+    Hy_exch_tesla = Hy_exch_joule * inv_mu_per_ampere_m2;
+    Hz_exch_tesla = Hz_exch_joule * inv_mu_per_ampere_m2;
+}
+
+/// Uniaxial anisotropy field (tesla) of a moment m on species mat.
+template <typename Acc>
+inline void anis_field_at(const MatParams& mat,
+    const Acc mx, const Acc my, const Acc mz,
+    Acc& Hx_anis_tesla, Acc& Hy_anis_tesla, Acc& Hz_anis_tesla)
+{
+    const Acc mu_ampere_m2      = static_cast<Acc>(mat.mu_ampere_m2);
+    const Acc ku_joule_per_atom = static_cast<Acc>(mat.ku_joule_per_atom);
+    const Acc ex = static_cast<Acc>(mat.easy_axis.x);
+    const Acc ey = static_cast<Acc>(mat.easy_axis.y);
+    const Acc ez = static_cast<Acc>(mat.easy_axis.z);
+
+    const Acc dot = mx*ex + my*ey + mz*ez;
+    Hx_anis_tesla = Acc(2.)*ku_joule_per_atom*dot*ex / mu_ampere_m2;
+    Hy_anis_tesla = Acc(2.)*ku_joule_per_atom*dot*ey / mu_ampere_m2;
+    Hz_anis_tesla = Acc(2.)*ku_joule_per_atom*dot*ez / mu_ampere_m2;
+}
+
+// The per-site array kernels are templates on the precision policy P
+// (precision.h); per-site arrays are spans of P::real (std::vector converts
+// implicitly, and so do the views of a HeunWorkspace). They are
+// instantiated for PrecDouble, PrecMixed and PrecFloat in fields.cpp.
+
+template <typename P>
 void compute_exch_field(
     const MatParams mat[2],
     const double J_joule_per_link[2][2],
     const std::vector<std::array<int, constants::FCC_NN_COUNT>>&
     nearest_neighbors,
     const std::vector<uint8_t>& species,
-    const std::vector<double>& mx,
-    const std::vector<double>& my,
-    const std::vector<double>& mz,
-    std::vector<double>& Hx_exch_tesla,
-    std::vector<double>& Hy_exch_tesla,
-    std::vector<double>& Hz_exch_tesla);
+    std::span<const typename P::real> mx,
+    std::span<const typename P::real> my,
+    std::span<const typename P::real> mz,
+    std::span<typename P::real> Hx_exch_tesla,
+    std::span<typename P::real> Hy_exch_tesla,
+    std::span<typename P::real> Hz_exch_tesla);
 
+template <typename P>
 void compute_uniaxial_anis_field(
     const MatParams mat[2],
     const std::vector<uint8_t>& species,
-    const std::vector<double>& mx_arr,
-    const std::vector<double>& my_arr,
-    const std::vector<double>& mz_arr,
-    std::vector<double>& Hx_anis_tesla,
-    std::vector<double>& Hy_anis_tesla,
-    std::vector<double>& Hz_anis_tesla);
+    std::span<const typename P::real> mx_arr,
+    std::span<const typename P::real> my_arr,
+    std::span<const typename P::real> mz_arr,
+    std::span<typename P::real> Hx_anis_tesla,
+    std::span<typename P::real> Hy_anis_tesla,
+    std::span<typename P::real> Hz_anis_tesla);
 
+/// With a site permutation, the draws are made in lattice order, so every
+/// lattice site gets the same noise as in the row-major run. The noise is
+/// drawn in double and rounded to P::real, so all precisions see the same
+/// sequence.
+template <typename P>
 void compute_ther_field_once(
     const MatParams mat[2],
     const std::vector<uint8_t>& species,
     double T_kelvin, double dt_sec, RNG& rng,
-    std::vector<double>& Hx_ther_tesla,
-    std::vector<double>& Hy_ther_tesla,
-    std::vector<double>& Hz_ther_tesla);
+    std::span<typename P::real> Hx_ther_tesla,
+    std::span<typename P::real> Hy_ther_tesla,
+    std::span<typename P::real> Hz_ther_tesla,
+    const SitePermutation* perm = nullptr);
+
+/// Counter-based variant: noise at (step, site) comes from Philox keyed by
+/// (seed, stream, step, site), so the sites fill in parallel and the result
+/// does not depend on the thread count. The key is the row-major lattice
+/// index, so the noise does not depend on the site order either.
+template <typename P>
+void compute_ther_field_counter(
+    const MatParams mat[2],
+    const std::vector<uint8_t>& species,
+    double T_kelvin, double dt_sec, const CounterRNG& rng, uint64_t step,
+    std::span<typename P::real> Hx_ther_tesla,
+    std::span<typename P::real> Hy_ther_tesla,
+    std::span<typename P::real> Hz_ther_tesla,
+    const SitePermutation* perm = nullptr);
 
+template <typename P>
 void compute_total_field(
     const MatParams mat[2],
     const double J_joule_per_link[2][2],
     const std::vector<std::array<int, constants::FCC_NN_COUNT>>&
     nearest_neighbors,
     const std::vector<uint8_t>& species,
-    const std::vector<double>& mx,
-    const std::vector<double>& my,
-    const std::vector<double>& mz,
+    std::span<const typename P::real> mx,
+    std::span<const typename P::real> my,
+    std::span<const typename P::real> mz,
     double Hx_appl_tesla, double Hy_appl_tesla, double Hz_appl_tesla,
-    std::vector<double>& Hx_exch_tesla,
-    std::vector<double>& Hy_exch_tesla,
-    std::vector<double>& Hz_exch_tesla,
-    std::vector<double>& Hx_anis_tesla,
-    std::vector<double>& Hy_anis_tesla,
-    std::vector<double>& Hz_anis_tesla,
-    const std::vector<double>& Hx_ther_tesla,
-    const std::vector<double>& Hy_ther_tesla,
-    const std::vector<double>& Hz_ther_tesla,
-    std::vector<double>& Hx_total_tesla,
-    std::vector<double>& Hy_total_tesla,
-    std::vector<double>& Hz_total_tesla);
+    std::span<typename P::real> Hx_exch_tesla,
+    std::span<typename P::real> Hy_exch_tesla,
+    std::span<typename P::real> Hz_exch_tesla,
+    std::span<typename P::real> Hx_anis_tesla,
+    std::span<typename P::real> Hy_anis_tesla,
+    std::span<typename P::real> Hz_anis_tesla,
+    std::span<const typename P::real> Hx_ther_tesla,
+    std::span<const typename P::real> Hy_ther_tesla,
+    std::span<const typename P::real> Hz_ther_tesla,
+    std::span<typename P::real> Hx_total_tesla,
+    std::span<typename P::real> Hy_total_tesla,
+    std::span<typename P::real> Hz_total_tesla);
 
 #endif //FIELDS_H
@@ -3,32 +3,36 @@
 #include <cassert>
 #include <cstdint>
 #include <vector>
+#include "params.h"
 
-/// Initialize per-site magnetization:
-inline void initialize_m(const uint8_t* species, int N,
-    double* mx, double* my, double* mz,
+/// Initialize per-site magnetization (Real = double or float storage):
+template <typename Real>
+inline void initialize_m(const uint8_t* species, const SiteIndex N,
+    Real* mx, Real* my, Real* mz,
     const double mx_Fe, const double my_Fe, const double mz_Fe,
     const double mx_Gd, const double my_Gd, const double mz_Gd)
 {
     assert(species && mx && my && mz);
-    for (int i = 0; i < N; ++i) {
+    #pragma omp parallel for schedule(static)
+    for (SiteIndex i = 0; i < N; ++i) {
         const bool isFe = (species[i] == 0);
-        mx[i] = isFe ? mx_Fe : mx_Gd;
-        my[i] = isFe ? my_Fe : my_Gd;
-        mz[i] = isFe ? mz_Fe : mz_Gd;
+        mx[i] = static_cast<Real>(isFe ? mx_Fe : mx_Gd);
+        my[i] = static_cast<Real>(isFe ? my_Fe : my_Gd);
+        mz[i] = static_cast<Real>(isFe ? mz_Fe : mz_Gd);
     }
 }
 
 /// Convenience wrapper for std::vector storage.
 /// Resizes mx/my/mz to match species.size() if needed.
+template <typename Real>
 inline void initialize_m(const std::vector<uint8_t>& species,
-    std::vector<double>& mx,
-    std::vector<double>& my,
-    std::vector<double>& mz,
+    std::vector<Real>& mx,
+    std::vector<Real>& my,
+    std::vector<Real>& mz,
     double mx_Fe, double my_Fe, double mz_Fe,
     double mx_Gd, double my_Gd, double mz_Gd)
 {
-    const int N = static_cast<int>(species.size());
+    const SiteIndex N = static_cast<SiteIndex>(species.size());
     mx.resize(N); my.resize(N); mz.resize(N);
     initialize_m(species.data(), N,
         mx.data(), my.data(), mz.data(),
@@ -1,99 +1,527 @@
 #include "integrator.h"
+#include "fields.h"
+#include "kernels_avx2.h"
 #include "math_utils.h"
 #include <vector>
 
+namespace {
+    /// finish_site(i, s, Hx_exch, Hy_exch, Hz_exch) for every site i (of
+    /// species s), with the exchange field of (mx, my, mz): one branch-free
+    /// loop per species on a partitioned table, else cell by cell so the
+    /// stencil resolves each cell's neighbors once.
+    template <typename Acc, typename Real, typename F>
+    void sweep_exchange(const MatParams mat[2],
+        const double J_joule_per_link[2][2], const FccNeighbors& neighbors,
+        const std::vector<uint8_t>& species, std::span<const Real> mx,
+        std::span<const Real> my, std::span<const Real> mz,
+        const F& finish_site)
+    {
+        const SiteIndex N = static_cast<SiteIndex>(species.size());
+        if (neighbors.is_partitioned()) {
+            // Constants of the species hoisted out of its loop.
+            const SiteIndex begin[3] = {0, neighbors.species_split, N};
+            for (int s=0; s < 2; ++s) {
+                const double* J_row = J_joule_per_link[s];
+                const Acc inv_mu = static_cast<Acc>(1.0 / mat[s].mu_ampere_m2);
+                #pragma omp parallel for schedule(static)
+                for (SiteIndex i=begin[s]; i < begin[s+1]; ++i) {
+                    Acc Hx_exch, Hy_exch, Hz_exch;
+                    exch_field_split_at(neighbors.table[i], J_row, inv_mu,
+                        neighbors.species_split, mx, my, mz,
+                        Hx_exch, Hy_exch, Hz_exch);
+                    finish_site(i, s, Hx_exch, Hy_exch, Hz_exch);
+                }
+            }
+            return;
+        }
+        #pragma omp parallel for schedule(static)
+        for (int row=0; row < neighbors.n_rows(); ++row) {
+            const int ci = row / neighbors.ny, cj = row % neighbors.ny;
+            FccNeighbors::WideList scratch[constants::FCC_BASIS_COUNT];
+            for (int ck=0; ck < neighbors.nz; ++ck) {
+                const SiteIndex p = neighbors.first_site(row, ck);
+                neighbors.visit_cell(p, ci, cj, ck, scratch,
+                    [&](const auto* nb4) {
+                    for (int b=0; b < constants::FCC_BASIS_COUNT; ++b) {
+                        const SiteIndex i = p + b;
+                        Acc Hx_exch, Hy_exch, Hz_exch;
+                        exch_field_at(i, nb4[b], mat, J_joule_per_link,
+                            species, mx, my, mz, Hx_exch, Hy_exch, Hz_exch);
+                        finish_site(i, species[i], Hx_exch, Hy_exch, Hz_exch);
+                    }
+                });
+            }
+        }
+    }
+}
+
+template <typename P>
 void advance_and_normalize_m(
-    const std::vector<double>& mx_in,
-    const std::vector<double>& my_in,
-    const std::vector<double>& mz_in,
-    std::vector<double>& mx_out,
-    std::vector<double>& my_out,
-    std::vector<double>& mz_out,
-    const std::vector<double>& dmx_dt,
-    const std::vector<double>& dmy_dt,
-    const std::vector<double>& dmz_dt,
+    std::span<const typename P::real> mx_in,
+    std::span<const typename P::real> my_in,
+    std::span<const typename P::real> mz_in,
+    std::span<typename P::real> mx_out,
+    std::span<typename P::real> my_out,
+    std::span<typename P::real> mz_out,
+    std::span<const typename P::real> dmx_dt,
+    std::span<const typename P::real> dmy_dt,
+    std::span<const typename P::real> dmz_dt,
     const double h_sec)
 {
-    const int N = static_cast<int>(mx_in.size());
+    using Acc = typename P::acc;
+    const SiteIndex N = static_cast<SiteIndex>(mx_in.size());
+    SiteIndex i0 = 0;
+    if constexpr (P::is_double) {
+        i0 = simd::advance_and_normalize(N,
+            mx_in.data(), my_in.data(), mz_in.data(),
+            mx_out.data(), my_out.data(), mz_out.data(),
+            dmx_dt.data(), dmy_dt.data(), dmz_dt.data(), h_sec);
+    }
     if (h_sec == 0.0) {
-        for (int i = 0; i < N; ++i) {
-            mx_out[i] = mx_in[i];
-            my_out[i] = my_in[i];
-            mz_out[i] = mz_in[i];
-            normalize3(mx_out[i], my_out[i], mz_out[i]);
+        #pragma omp parallel for schedule(static)
+        for (SiteIndex i = i0; i < N; ++i) {
+            Acc x = mx_in[i], y = my_in[i], z = mz_in[i];
+            normalize3(x, y, z);
+            mx_out[i] = x;
+            my_out[i] = y;
+            mz_out[i] = z;
         }
         return;
     }
-    for (int i=0; i < N; ++i) {
-        mx_out[i] = mx_in[i] + h_sec * dmx_dt[i];
-        my_out[i] = my_in[i] + h_sec * dmy_dt[i];
-        mz_out[i] = mz_in[i] + h_sec * dmz_dt[i];
-        normalize3(mx_out[i], my_out[i], mz_out[i]);
+    const Acc h = static_cast<Acc>(h_sec);
+    #pragma omp parallel for schedule(static)
+    for (SiteIndex i=i0; i < N; ++i) {
+        Acc x = Acc(mx_in[i]) + h * Acc(dmx_dt[i]);
+        Acc y = Acc(my_in[i]) + h * Acc(dmy_dt[i]);
+        Acc z = Acc(mz_in[i]) + h * Acc(dmz_dt[i]);
+        normalize3(x, y, z);
+        mx_out[i] = x;
+        my_out[i] = y;
+        mz_out[i] = z;
     }
 }
 
+template <typename P>
 void advance_and_normalize_m_Heun(
-    std::vector<double>& mx,
-    std::vector<double>& my,
-    std::vector<double>& mz,
-    const std::vector<double>& dmx_dt_st1,
-    const std::vector<double>& dmy_dt_st1,
-    const std::vector<double>& dmz_dt_st1,
-    const std::vector<double>& dmx_dt_st2,
-    const std::vector<double>& dmy_dt_st2,
-    const std::vector<double>& dmz_dt_st2,
+    std::span<typename P::real> mx,
+    std::span<typename P::real> my,
+    std::span<typename P::real> mz,
+    std::span<const typename P::real> dmx_dt_st1,
+    std::span<const typename P::real> dmy_dt_st1,
+    std::span<const typename P::real> dmz_dt_st1,
+    std::span<const typename P::real> dmx_dt_st2,
+    std::span<const typename P::real> dmy_dt_st2,
+    std::span<const typename P::real> dmz_dt_st2,
     const double h_sec)
 {
-    const int N = static_cast<int>(mx.size());
-    for (int i=0; i < N; ++i) {
-        mx[i] += h_sec * 0.5 * (dmx_dt_st1[i] + dmx_dt_st2[i]);
-        my[i] += h_sec * 0.5 * (dmy_dt_st1[i] + dmy_dt_st2[i]);
-        mz[i] += h_sec * 0.5 * (dmz_dt_st1[i] + dmz_dt_st2[i]);
-        normalize3(mx[i], my[i], mz[i]);
+    using Acc = typename P::acc;
+    const SiteIndex N = static_cast<SiteIndex>(mx.size());
+    SiteIndex i0 = 0;
+    if constexpr (P::is_double) {
+        i0 = simd::advance_and_normalize_Heun(N,
+            mx.data(), my.data(), mz.data(),
+            dmx_dt_st1.data(), dmy_dt_st1.data(), dmz_dt_st1.data(),
+            dmx_dt_st2.data(), dmy_dt_st2.data(), dmz_dt_st2.data(), h_sec);
+    }
+    const Acc h = static_cast<Acc>(h_sec);
+    #pragma omp parallel for schedule(static)
+    for (SiteIndex i=i0; i < N; ++i) {
+        Acc x = Acc(mx[i]) + h * Acc(0.5) * (Acc(dmx_dt_st1[i]) + Acc(dmx_dt_st2[i]));
+        Acc y = Acc(my[i]) + h * Acc(0.5) * (Acc(dmy_dt_st1[i]) + Acc(dmy_dt_st2[i]));
+        Acc z = Acc(mz[i]) + h * Acc(0.5) * (Acc(dmz_dt_st1[i]) + Acc(dmz_dt_st2[i]));
+        normalize3(x, y, z);
+        mx[i] = x;
+        my[i] = y;
+        mz[i] = z;
     }
 }
 
+template <typename P>
 void compute_dm_dt_kernel(
     const MatParams phys_params[2],
     const std::vector<uint8_t>& species,
-    const std::vector<double>& mx_arr,
-    const std::vector<double>& my_arr,
-    const std::vector<double>& mz_arr,
-    const std::vector<double>& Hx_total_tesla_arr,
-    const std::vector<double>& Hy_total_tesla_arr,
-    const std::vector<double>& Hz_total_tesla_arr,
-    std::vector<double>& dmx_dt,
-    std::vector<double>& dmy_dt,
-    std::vector<double>& dmz_dt)
+    std::span<const typename P::real> mx_arr,
+    std::span<const typename P::real> my_arr,
+    std::span<const typename P::real> mz_arr,
+    std::span<const typename P::real> Hx_total_tesla_arr,
+    std::span<const typename P::real> Hy_total_tesla_arr,
+    std::span<const typename P::real> Hz_total_tesla_arr,
+    std::span<typename P::real> dmx_dt,
+    std::span<typename P::real> dmy_dt,
+    std::span<typename P::real> dmz_dt)
 {
-    const int N = static_cast<int>(species.size());
-    for (int i=0; i < N; ++i) {
+    using Acc = typename P::acc;
+    const SiteIndex N = static_cast<SiteIndex>(species.size());
+    SiteIndex i0 = 0;
+    if constexpr (P::is_double) {
+        i0 = simd::dm_dt(N, phys_params, species.data(),
+            mx_arr.data(), my_arr.data(), mz_arr.data(),
+            Hx_total_tesla_arr.data(), Hy_total_tesla_arr.data(),
+            Hz_total_tesla_arr.data(),
+            dmx_dt.data(), dmy_dt.data(), dmz_dt.data());
+    }
+    const LlgConst<Acc> llg(phys_params);
+    #pragma omp parallel for schedule(static)
+    for (SiteIndex i=i0; i < N; ++i) {
         const int s = species[i];
-        const double gamma_rad_per_tesla_sec =
-            phys_params[s].gamma_rad_per_tesla_sec;
-        const double alpha                   = phys_params[s].alpha;
-        const double mx = mx_arr[i];
-        const double my = my_arr[i];
-        const double mz = mz_arr[i];
-        const double Hx_total_tesla = Hx_total_tesla_arr[i];
-        const double Hy_total_tesla = Hy_total_tesla_arr[i];
-        const double Hz_total_tesla = Hz_total_tesla_arr[i];
-
-        const double gamma_prime_rad_per_tesla_sec =
-            -gamma_rad_per_tesla_sec / (1. + alpha*alpha);
-
-        // c1 = m x H
-        const double c1x = my*Hz_total_tesla - mz*Hy_total_tesla;
-        const double c1y = mz*Hx_total_tesla - mx*Hz_total_tesla;
-        const double c1z = mx*Hy_total_tesla - my*Hx_total_tesla;
-
-        // c2 = m x (m x H)
-        const double c2x = my*c1z - mz*c1y;
-        const double c2y = mz*c1x - mx*c1z;
-        const double c2z = mx*c1y - my*c1x;
-
-        dmx_dt[i] = gamma_prime_rad_per_tesla_sec * ( c1x + alpha * c2x );
-        dmy_dt[i] = gamma_prime_rad_per_tesla_sec * ( c1y + alpha * c2y );
-        dmz_dt[i] = gamma_prime_rad_per_tesla_sec * ( c1z + alpha * c2z );
+        Acc dmx, dmy, dmz;
+        llg_rhs_at<Acc>(llg.gamma_prime[s], llg.alpha[s],
+            mx_arr[i], my_arr[i], mz_arr[i],
+            Hx_total_tesla_arr[i], Hy_total_tesla_arr[i], Hz_total_tesla_arr[i],
+            dmx, dmy, dmz);
+        dmx_dt[i] = dmx;
+        dmy_dt[i] = dmy;
+        dmz_dt[i] = dmz;
+    }
+}
+
+template <typename P>
+void heun_predictor_fused(
+    const MatParams mat[2],
+    const double J_joule_per_link[2][2],
+    const FccNeighbors& neighbors,
+    const std::vector<uint8_t>& species,
+    std::span<const typename P::real> mx,
+    std::span<const typename P::real> my,
+    std::span<const typename P::real> mz,
+    std::span<const typename P::real> mx_mid,
+    std::span<const typename P::real> my_mid,
+    std::span<const typename P::real> mz_mid,
+    const double Hx_appl_tesla, const double Hy_appl_tesla,
+    const double Hz_appl_tesla,
+    std::span<const typename P::real> Hx_ther_tesla,
+    std::span<const typename P::real> Hy_ther_tesla,
+    std::span<const typename P::real> Hz_ther_tesla,
+    const double h_sec,
+    std::span<typename P::real> dmx_dt_st1,
+    std::span<typename P::real> dmy_dt_st1,
+    std::span<typename P::real> dmz_dt_st1,
+    std::span<typename P::real> mx_pred,
+    std::span<typename P::real> my_pred,
+    std::span<typename P::real> mz_pred)
+{
+    using Acc = typename P::acc;
+    if constexpr (P::is_double) {
+        const double H_appl_tesla[3] = {Hx_appl_tesla, Hy_appl_tesla,
+            Hz_appl_tesla};
+        if (simd::heun_predictor(mat, J_joule_per_link,
+            neighbors, species.data(),
+            mx.data(), my.data(), mz.data(),
+            mx_mid.data(), my_mid.data(), mz_mid.data(),
+            H_appl_tesla,
+            Hx_ther_tesla.data(), Hy_ther_tesla.data(), Hz_ther_tesla.data(),
+            h_sec,
+            dmx_dt_st1.data(), dmy_dt_st1.data(), dmz_dt_st1.data(),
+            mx_pred.data(), my_pred.data(), mz_pred.data())) {
+            return;
+        }
+    }
+    const LlgConst<Acc> llg(mat);
+    const Acc Hx_appl = static_cast<Acc>(Hx_appl_tesla);
+    const Acc Hy_appl = static_cast<Acc>(Hy_appl_tesla);
+    const Acc Hz_appl = static_cast<Acc>(Hz_appl_tesla);
+    const Acc h = static_cast<Acc>(h_sec);
+
+    // Everything after the exchange field; s is the species of site i.
+    const auto finish_site = [&](const SiteIndex i, const int s,
+        const Acc Hx_exch, const Acc Hy_exch, const Acc Hz_exch)
+    {
+        const Acc mx_i = mx_mid[i], my_i = my_mid[i], mz_i = mz_mid[i];
+        Acc Hx_anis, Hy_anis, Hz_anis;
+        anis_field_at<Acc>(mat[s], mx_i, my_i, mz_i,
+            Hx_anis, Hy_anis, Hz_anis);
+        const Acc Hx_total = Hx_appl + Hx_exch + Hx_anis + Acc(Hx_ther_tesla[i]);
+        const Acc Hy_total = Hy_appl + Hy_exch + Hy_anis + Acc(Hy_ther_tesla[i]);
+        const Acc Hz_total = Hz_appl + Hz_exch + Hz_anis + Acc(Hz_ther_tesla[i]);
+
+        Acc dmx_dt, dmy_dt, dmz_dt;
+        llg_rhs_at<Acc>(llg.gamma_prime[s], llg.alpha[s],
+            mx_i, my_i, mz_i,
+            Hx_total, Hy_total, Hz_total,
+            dmx_dt, dmy_dt, dmz_dt);
+        dmx_dt_st1[i] = dmx_dt;
+        dmy_dt_st1[i] = dmy_dt;
+        dmz_dt_st1[i] = dmz_dt;
+
+        Acc mx_p = Acc(mx[i]) + h * dmx_dt;
+        Acc my_p = Acc(my[i]) + h * dmy_dt;
+        Acc mz_p = Acc(mz[i]) + h * dmz_dt;
+        normalize3(mx_p, my_p, mz_p);
+        mx_pred[i] = mx_p;
+        my_pred[i] = my_p;
+        mz_pred[i] = mz_p;
+    };
+    sweep_exchange<Acc>(mat, J_joule_per_link, neighbors, species,
+        mx_mid, my_mid, mz_mid, finish_site);
+}
+
+template <typename P>
+void heun_corrector_fused(
+    const MatParams mat[2],
+    const double J_joule_per_link[2][2],
+    const FccNeighbors& neighbors,
+    const std::vector<uint8_t>& species,
+    std::span<const typename P::real> mx_pred,
+    std::span<const typename P::real> my_pred,
+    std::span<const typename P::real> mz_pred,
+    const double Hx_appl_tesla, const double Hy_appl_tesla,
+    const double Hz_appl_tesla,
+    std::span<const typename P::real> Hx_ther_tesla,
+    std::span<const typename P::real> Hy_ther_tesla,
+    std::span<const typename P::real> Hz_ther_tesla,
+    std::span<const typename P::real> dmx_dt_st1,
+    std::span<const typename P::real> dmy_dt_st1,
+    std::span<const typename P::real> dmz_dt_st1,
+    const double h_sec,
+    std::span<typename P::real> mx,
+    std::span<typename P::real> my,
+    std::span<typename P::real> mz,
+    std::span<typename P::real> mx_mid,
+    std::span<typename P::real> my_mid,
+    std::span<typename P::real> mz_mid)
+{
+    using Acc = typename P::acc;
+    // m, m_mid are only touched at site i; neighbors are read from m_pred.
+    if constexpr (P::is_double) {
+        const double H_appl_tesla[3] = {Hx_appl_tesla, Hy_appl_tesla,
+            Hz_appl_tesla};
+        if (simd::heun_corrector(mat, J_joule_per_link,
+            neighbors, species.data(),
+            mx_pred.data(), my_pred.data(), mz_pred.data(),
+            H_appl_tesla,
+            Hx_ther_tesla.data(), Hy_ther_tesla.data(), Hz_ther_tesla.data(),
+            dmx_dt_st1.data(), dmy_dt_st1.data(), dmz_dt_st1.data(),
+            h_sec,
+            mx.data(), my.data(), mz.data(),
+            mx_mid.data(), my_mid.data(), mz_mid.data())) {
+            return;
+        }
     }
-}
\ No newline at end of file
+    const LlgConst<Acc> llg(mat);
+    const Acc Hx_appl = static_cast<Acc>(Hx_appl_tesla);
+    const Acc Hy_appl = static_cast<Acc>(Hy_appl_tesla);
+    const Acc Hz_appl = static_cast<Acc>(Hz_appl_tesla);
+    const Acc h = static_cast<Acc>(h_sec);
+
+    const auto finish_site = [&](const SiteIndex i, const int s,
+        const Acc Hx_exch, const Acc Hy_exch, const Acc Hz_exch)
+    {
+        const Acc mx_i = mx_pred[i], my_i = my_pred[i], mz_i = mz_pred[i];
+        Acc Hx_anis, Hy_anis, Hz_anis;
+        anis_field_at<Acc>(mat[s], mx_i, my_i, mz_i,
+            Hx_anis, Hy_anis, Hz_anis);
+        const Acc Hx_total = Hx_appl + Hx_exch + Hx_anis + Acc(Hx_ther_tesla[i]);
+        const Acc Hy_total = Hy_appl + Hy_exch + Hy_anis + Acc(Hy_ther_tesla[i]);
+        const Acc Hz_total = Hz_appl + Hz_exch + Hz_anis + Acc(Hz_ther_tesla[i]);
+
+        Acc dmx_dt_st2, dmy_dt_st2, dmz_dt_st2;
+        llg_rhs_at<Acc>(llg.gamma_prime[s], llg.alpha[s],
+            mx_i, my_i, mz_i,
+            Hx_total, Hy_total, Hz_total,
+            dmx_dt_st2, dmy_dt_st2, dmz_dt_st2);
+
+        Acc mx_n = Acc(mx[i]) + h * Acc(0.5) * (Acc(dmx_dt_st1[i]) + dmx_dt_st2);
+        Acc my_n = Acc(my[i]) + h * Acc(0.5) * (Acc(dmy_dt_st1[i]) + dmy_dt_st2);
+        Acc mz_n = Acc(mz[i]) + h * Acc(0.5) * (Acc(dmz_dt_st1[i]) + dmz_dt_st2);
+        normalize3(mx_n, my_n, mz_n);
+        mx[i] = mx_n;
+        my[i] = my_n;
+        mz[i] = mz_n;
+
+        normalize3(mx_n, my_n, mz_n);
+        mx_mid[i] = mx_n;
+        my_mid[i] = my_n;
+        mz_mid[i] = mz_n;
+    };
+    sweep_exchange<Acc>(mat, J_joule_per_link, neighbors, species,
+        mx_pred, my_pred, mz_pred, finish_site);
+}
+
+template <typename P>
+void depondt_predictor_fused(
+    const MatParams mat[2],
+    const double J_joule_per_link[2][2],
+    const FccNeighbors& neighbors,
+    const std::vector<uint8_t>& species,
+    std::span<const typename P::real> mx,
+    std::span<const typename P::real> my,
+    std::span<const typename P::real> mz,
+    std::span<const typename P::real> mx_mid,
+    std::span<const typename P::real> my_mid,
+    std::span<const typename P::real> mz_mid,
+    const double Hx_appl_tesla, const double Hy_appl_tesla,
+    const double Hz_appl_tesla,
+    std::span<const typename P::real> Hx_ther_tesla,
+    std::span<const typename P::real> Hy_ther_tesla,
+    std::span<const typename P::real> Hz_ther_tesla,
+    const double h_sec,
+    std::span<typename P::real> wx_st1,
+    std::span<typename P::real> wy_st1,
+    std::span<typename P::real> wz_st1,
+    std::span<typename P::real> mx_pred,
+    std::span<typename P::real> my_pred,
+    std::span<typename P::real> mz_pred)
+{
+    using Acc = typename P::acc;
+    const LlgConst<Acc> llg(mat);
+    const Acc Hx_appl = static_cast<Acc>(Hx_appl_tesla);
+    const Acc Hy_appl = static_cast<Acc>(Hy_appl_tesla);
+    const Acc Hz_appl = static_cast<Acc>(Hz_appl_tesla);
+    const Acc h = static_cast<Acc>(h_sec);
+
+    const auto finish_site = [&](const SiteIndex i, const int s,
+        const Acc Hx_exch, const Acc Hy_exch, const Acc Hz_exch)
+    {
+        const Acc mx_i = mx_mid[i], my_i = my_mid[i], mz_i = mz_mid[i];
+        Acc Hx_anis, Hy_anis, Hz_anis;
+        anis_field_at<Acc>(mat[s], mx_i, my_i, mz_i,
+            Hx_anis, Hy_anis, Hz_anis);
+        const Acc Hx_total = Hx_appl + Hx_exch + Hx_anis + Acc(Hx_ther_tesla[i]);
+        const Acc Hy_total = Hy_appl + Hy_exch + Hy_anis + Acc(Hy_ther_tesla[i]);
+        const Acc Hz_total = Hz_appl + Hz_exch + Hz_anis + Acc(Hz_ther_tesla[i]);
+
+        Acc wx, wy, wz;
+        llg_rotation_at<Acc>(llg.gamma_prime[s], llg.alpha[s],
+            mx_i, my_i, mz_i, Hx_total, Hy_total, Hz_total, wx, wy, wz);
+        wx_st1[i] = wx;
+        wy_st1[i] = wy;
+        wz_st1[i] = wz;
+
+        Acc mx_p = mx[i], my_p = my[i], mz_p = mz[i];
+        rotate_at<Acc>(wx, wy, wz, h, mx_p, my_p, mz_p);
+        mx_pred[i] = mx_p;
+        my_pred[i] = my_p;
+        mz_pred[i] = mz_p;
+    };
+    sweep_exchange<Acc>(mat, J_joule_per_link, neighbors, species,
+        mx_mid, my_mid, mz_mid, finish_site);
+}
+
+template <typename P>
+void depondt_corrector_fused(
+    const MatParams mat[2],
+    const double J_joule_per_link[2][2],
+    const FccNeighbors& neighbors,
+    const std::vector<uint8_t>& species,
+    std::span<const typename P::real> mx_pred,
+    std::span<const typename P::real> my_pred,
+    std::span<const typename P::real> mz_pred,
+    const double Hx_appl_tesla, const double Hy_appl_tesla,
+    const double Hz_appl_tesla,
+    std::span<const typename P::real> Hx_ther_tesla,
+    std::span<const typename P::real> Hy_ther_tesla,
+    std::span<const typename P::real> Hz_ther_tesla,
+    std::span<const typename P::real> wx_st1,
+    std::span<const typename P::real> wy_st1,
+    std::span<const typename P::real> wz_st1,
+    const double h_sec,
+    std::span<typename P::real> mx,
+    std::span<typename P::real> my,
+    std::span<typename P::real> mz,
+    std::span<typename P::real> mx_mid,
+    std::span<typename P::real> my_mid,
+    std::span<typename P::real> mz_mid)
+{
+    using Acc = typename P::acc;
+    const LlgConst<Acc> llg(mat);
+    const Acc Hx_appl = static_cast<Acc>(Hx_appl_tesla);
+    const Acc Hy_appl = static_cast<Acc>(Hy_appl_tesla);
+    const Acc Hz_appl = static_cast<Acc>(Hz_appl_tesla);
+    const Acc h = static_cast<Acc>(h_sec);
+
+    const auto finish_site = [&](const SiteIndex i, const int s,
+        const Acc Hx_exch, const Acc Hy_exch, const Acc Hz_exch)
+    {
+        const Acc mx_i = mx_pred[i], my_i = my_pred[i], mz_i = mz_pred[i];
+        Acc Hx_anis, Hy_anis, Hz_anis;
+        anis_field_at<Acc>(mat[s], mx_i, my_i, mz_i,
+            Hx_anis, Hy_anis, Hz_anis);
+        const Acc Hx_total = Hx_appl + Hx_exch + Hx_anis + Acc(Hx_ther_tesla[i]);
+        const Acc Hy_total = Hy_appl + Hy_exch + Hy_anis + Acc(Hy_ther_tesla[i]);
+        const Acc Hz_total = Hz_appl + Hz_exch + Hz_anis + Acc(Hz_ther_tesla[i]);
+
+        Acc wx, wy, wz;
+        llg_rotation_at<Acc>(llg.gamma_prime[s], llg.alpha[s],
+            mx_i, my_i, mz_i, Hx_total, Hy_total, Hz_total, wx, wy, wz);
+
+        Acc mx_n = mx[i], my_n = my[i], mz_n = mz[i];
+        rotate_at<Acc>(Acc(0.5) * (Acc(wx_st1[i]) + wx),
+            Acc(0.5) * (Acc(wy_st1[i]) + wy),
+            Acc(0.5) * (Acc(wz_st1[i]) + wz), h, mx_n, my_n, mz_n);
+        mx[i] = mx_n;
+        my[i] = my_n;
+        mz[i] = mz_n;
+
+        normalize3(mx_n, my_n, mz_n);
+        mx_mid[i] = mx_n;
+        my_mid[i] = my_n;
+        mz_mid[i] = mz_n;
+    };
+    sweep_exchange<Acc>(mat, J_joule_per_link, neighbors, species,
+        mx_pred, my_pred, mz_pred, finish_site);
+}
+
+#define INSTANTIATE_INTEGRATOR(P) \
+    template void advance_and_normalize_m<P>( \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, double); \
+    template void advance_and_normalize_m_Heun<P>( \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, double); \
+    template void compute_dm_dt_kernel<P>(const MatParams[2], \
+        const std::vector<uint8_t>&, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>); \
+    template void heun_predictor_fused<P>(const MatParams[2], \
+        const double[2][2], const FccNeighbors&, const std::vector<uint8_t>&, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, double, double, double, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, double, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>); \
+    template void heun_corrector_fused<P>(const MatParams[2], \
+        const double[2][2], const FccNeighbors&, const std::vector<uint8_t>&, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, double, double, double, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, double, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>); \
+    template void depondt_predictor_fused<P>(const MatParams[2], \
+        const double[2][2], const FccNeighbors&, const std::vector<uint8_t>&, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, double, double, double, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, double, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>); \
+    template void depondt_corrector_fused<P>(const MatParams[2], \
+        const double[2][2], const FccNeighbors&, const std::vector<uint8_t>&, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, double, double, double, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, double, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>, \
+        std::span<P::real>, std::span<P::real>, std::span<P::real>);
+
+INSTANTIATE_INTEGRATOR(PrecDouble)
+INSTANTIATE_INTEGRATOR(PrecMixed)
+INSTANTIATE_INTEGRATOR(PrecFloat)
@@ -1,44 +1,246 @@
 #ifndef INTEGRATOR_H
 #define INTEGRATOR_H
+#include <cmath>
 #include <cstdint>
+#include <span>
 #include <vector>
+#include "lattice.h"
 #include "params.h"
+#include "precision.h"
 
+/// gamma' = -gamma / (1 + alpha^2) per species, and alpha, in Acc.
+template <typename Acc>
+struct LlgConst {
+    Acc gamma_prime[2];
+    Acc alpha[2];
+
+    explicit LlgConst(const MatParams mat[2]) {
+        for (int s = 0; s < 2; ++s) {
+            gamma_prime[s] = static_cast<Acc>(-mat[s].gamma_rad_per_tesla_sec
+                / (1. + mat[s].alpha*mat[s].alpha));
+            alpha[s] = static_cast<Acc>(mat[s].alpha);
+        }
+    }
+};
+
+/// LLG right-hand side for one site:
+/// dm/dt = gamma' * (m x H + alpha * m x (m x H)),
+/// gamma' = -gamma / (1 + alpha^2).
+template <typename Acc>
+inline void llg_rhs_at(const Acc gamma_prime_rad_per_tesla_sec,
+    const Acc alpha,
+    const Acc mx, const Acc my, const Acc mz,
+    const Acc Hx_total_tesla, const Acc Hy_total_tesla,
+    const Acc Hz_total_tesla,
+    Acc& dmx_dt, Acc& dmy_dt, Acc& dmz_dt)
+{
+    // c1 = m x H
+    const Acc c1x = my*Hz_total_tesla - mz*Hy_total_tesla;
+    const Acc c1y = mz*Hx_total_tesla - mx*Hz_total_tesla;
+    const Acc c1z = mx*Hy_total_tesla - my*Hx_total_tesla;
+
+    // c2 = m x (m x H)
+    const Acc c2x = my*c1z - mz*c1y;
+    const Acc c2y = mz*c1x - mx*c1z;
+    const Acc c2z = mx*c1y - my*c1x;
+
+    dmx_dt = gamma_prime_rad_per_tesla_sec * ( c1x + alpha * c2x );
+    dmy_dt = gamma_prime_rad_per_tesla_sec * ( c1y + alpha * c2y );
+    dmz_dt = gamma_prime_rad_per_tesla_sec * ( c1z + alpha * c2z );
+}
+
+/// The LLG right-hand side as a rotation, dm/dt = Omega x m with
+/// Omega = -gamma' * (H + alpha * m x H) (same gamma' as llg_rhs_at).
+template <typename Acc>
+inline void llg_rotation_at(const Acc gamma_prime_rad_per_tesla_sec,
+    const Acc alpha,
+    const Acc mx, const Acc my, const Acc mz,
+    const Acc Hx_total_tesla, const Acc Hy_total_tesla,
+    const Acc Hz_total_tesla,
+    Acc& wx_rad_per_sec, Acc& wy_rad_per_sec, Acc& wz_rad_per_sec)
+{
+    const Acc c1x = my*Hz_total_tesla - mz*Hy_total_tesla;
+    const Acc c1y = mz*Hx_total_tesla - mx*Hz_total_tesla;
+    const Acc c1z = mx*Hy_total_tesla - my*Hx_total_tesla;
+    wx_rad_per_sec = -gamma_prime_rad_per_tesla_sec * (Hx_total_tesla + alpha*c1x);
+    wy_rad_per_sec = -gamma_prime_rad_per_tesla_sec * (Hy_total_tesla + alpha*c1y);
+    wz_rad_per_sec = -gamma_prime_rad_per_tesla_sec * (Hz_total_tesla + alpha*c1z);
+}
+
+/// m rotated by the angle |w|*h about w (Rodrigues), in place. Keeps |m|
+/// whatever h, unlike an Euler step followed by normalize3.
+template <typename Acc>
+inline void rotate_at(const Acc wx, const Acc wy, const Acc wz, const Acc h,
+    Acc& mx, Acc& my, Acc& mz)
+{
+    const Acc w = std::sqrt(wx*wx + wy*wy + wz*wz);
+    const Acc theta = w * h;
+    if (!(theta > Acc(0))) return;
+    const Acc kx = wx / w, ky = wy / w, kz = wz / w;
+    const Acc c = std::cos(theta), s = std::sin(theta);
+    const Acc k_dot_m = kx*mx + ky*my + kz*mz;
+    const Acc x = mx*c + (ky*mz - kz*my)*s + kx*k_dot_m*(Acc(1) - c);
+    const Acc y = my*c + (kz*mx - kx*mz)*s + ky*k_dot_m*(Acc(1) - c);
+    const Acc z = mz*c + (kx*my - ky*mx)*s + kz*k_dot_m*(Acc(1) - c);
+    mx = x; my = y; mz = z;
+}
+
+// The per-site array kernels are templates on the precision policy P
+// (precision.h), instantiated for PrecDouble, PrecMixed and PrecFloat in
+// integrator.cpp. Site updates are computed in P::acc.
+
+template <typename P>
 void advance_and_normalize_m(
-    const std::vector<double>& mx_in,
-    const std::vector<double>& my_in,
-    const std::vector<double>& mz_in,
-    std::vector<double>& mx_out,
-    std::vector<double>& my_out,
-    std::vector<double>& mz_out,
-    const std::vector<double>& dmx_dt,
-    const std::vector<double>& dmy_dt,
-    const std::vector<double>& dmz_dt,
+    std::span<const typename P::real> mx_in,
+    std::span<const typename P::real> my_in,
+    std::span<const typename P::real> mz_in,
+    std::span<typename P::real> mx_out,
+    std::span<typename P::real> my_out,
+    std::span<typename P::real> mz_out,
+    std::span<const typename P::real> dmx_dt,
+    std::span<const typename P::real> dmy_dt,
+    std::span<const typename P::real> dmz_dt,
     double h_sec);
 
+template <typename P>
 void advance_and_normalize_m_Heun(
-    std::vector<double>& mx,
-    std::vector<double>& my,
-    std::vector<double>& mz,
-    const std::vector<double>& dmx_dt_st1,
-    const std::vector<double>& dmy_dt_st1,
-    const std::vector<double>& dmz_dt_st1,
-    const std::vector<double>& dmx_dt_st2,
-    const std::vector<double>& dmy_dt_st2,
-    const std::vector<double>& dmz_dt_st2,
+    std::span<typename P::real> mx,
+    std::span<typename P::real> my,
+    std::span<typename P::real> mz,
+    std::span<const typename P::real> dmx_dt_st1,
+    std::span<const typename P::real> dmy_dt_st1,
+    std::span<const typename P::real> dmz_dt_st1,
+    std::span<const typename P::real> dmx_dt_st2,
+    std::span<const typename P::real> dmy_dt_st2,
+    std::span<const typename P::real> dmz_dt_st2,
     const double h_sec);
 
+template <typename P>
 void compute_dm_dt_kernel(
     const MatParams phys_params[2],
     const std::vector<uint8_t>& species,
-    const std::vector<double>& mx_arr,
-    const std::vector<double>& my_arr,
-    const std::vector<double>& mz_arr,
-    const std::vector<double>& Hx_total_tesla_arr,
-    const std::vector<double>& Hy_total_tesla_arr,
-    const std::vector<double>& Hz_total_tesla_arr,
-    std::vector<double>& dmx_dt,
-    std::vector<double>& dmy_dt,
-    std::vector<double>& dmz_dt);
+    std::span<const typename P::real> mx_arr,
+    std::span<const typename P::real> my_arr,
+    std::span<const typename P::real> mz_arr,
+    std::span<const typename P::real> Hx_total_tesla_arr,
+    std::span<const typename P::real> Hy_total_tesla_arr,
+    std::span<const typename P::real> Hz_total_tesla_arr,
+    std::span<typename P::real> dmx_dt,
+    std::span<typename P::real> dmy_dt,
+    std::span<typename P::real> dmz_dt);
+
+/** Fused Heun predictor (stage 1), one sweep over the sites.
+ *  Per site: exchange + anisotropy + thermal + applied field of m_mid, the
+ *  LLG right-hand side dm/dt_st1 (stored, needed by the corrector) and the
+ *  predictor m_pred = normalize(m + h*dm/dt_st1). The fields stay in
+ *  registers (compute_bulk_fields_from_m recomputes them on save steps).
+ *  Bit-identical to the unfused kernels, and for the
+ *  table and stencil forms of neighbors. */
+template <typename P>
+void heun_predictor_fused(
+    const MatParams mat[2],
+    const double J_joule_per_link[2][2],
+    const FccNeighbors& neighbors,
+    const std::vector<uint8_t>& species,
+    std::span<const typename P::real> mx,
+    std::span<const typename P::real> my,
+    std::span<const typename P::real> mz,
+    std::span<const typename P::real> mx_mid,
+    std::span<const typename P::real> my_mid,
+    std::span<const typename P::real> mz_mid,
+    double Hx_appl_tesla, double Hy_appl_tesla, double Hz_appl_tesla,
+    std::span<const typename P::real> Hx_ther_tesla,
+    std::span<const typename P::real> Hy_ther_tesla,
+    std::span<const typename P::real> Hz_ther_tesla,
+    double h_sec,
+    std::span<typename P::real> dmx_dt_st1,
+    std::span<typename P::real> dmy_dt_st1,
+    std::span<typename P::real> dmz_dt_st1,
+    std::span<typename P::real> mx_pred,
+    std::span<typename P::real> my_pred,
+    std::span<typename P::real> mz_pred);
+
+/** Fused Heun corrector (stage 2), one sweep over the sites.
+ *  Per site: total field of m_pred, dm/dt_st2 (kept in registers), the Heun
+ *  update m += h/2*(dm/dt_st1 + dm/dt_st2) with normalization, and m_mid =
+ *  normalize(m) for the next predictor. */
+template <typename P>
+void heun_corrector_fused(
+    const MatParams mat[2],
+    const double J_joule_per_link[2][2],
+    const FccNeighbors& neighbors,
+    const std::vector<uint8_t>& species,
+    std::span<const typename P::real> mx_pred,
+    std::span<const typename P::real> my_pred,
+    std::span<const typename P::real> mz_pred,
+    double Hx_appl_tesla, double Hy_appl_tesla, double Hz_appl_tesla,
+    std::span<const typename P::real> Hx_ther_tesla,
+    std::span<const typename P::real> Hy_ther_tesla,
+    std::span<const typename P::real> Hz_ther_tesla,
+    std::span<const typename P::real> dmx_dt_st1,
+    std::span<const typename P::real> dmy_dt_st1,
+    std::span<const typename P::real> dmz_dt_st1,
+    double h_sec,
+    std::span<typename P::real> mx,
+    std::span<typename P::real> my,
+    std::span<typename P::real> mz,
+    std::span<typename P::real> mx_mid,
+    std::span<typename P::real> my_mid,
+    std::span<typename P::real> mz_mid);
+
+/** Depondt-Mertens predictor (stage 1): same sweep as heun_predictor_fused,
+ *  but stores the rotation vector Omega_1 of m_mid (llg_rotation_at) in
+ *  w*_st1 and predicts m_pred = m rotated by h*Omega_1. Scalar kernels
+ *  (no AVX2 variant); stable and norm-preserving at larger h than Heun. */
+template <typename P>
+void depondt_predictor_fused(
+    const MatParams mat[2],
+    const double J_joule_per_link[2][2],
+    const FccNeighbors& neighbors,
+    const std::vector<uint8_t>& species,
+    std::span<const typename P::real> mx,
+    std::span<const typename P::real> my,
+    std::span<const typename P::real> mz,
+    std::span<const typename P::real> mx_mid,
+    std::span<const typename P::real> my_mid,
+    std::span<const typename P::real> mz_mid,
+    double Hx_appl_tesla, double Hy_appl_tesla, double Hz_appl_tesla,
+    std::span<const typename P::real> Hx_ther_tesla,
+    std::span<const typename P::real> Hy_ther_tesla,
+    std::span<const typename P::real> Hz_ther_tesla,
+    double h_sec,
+    std::span<typename P::real> wx_st1,
+    std::span<typename P::real> wy_st1,
+    std::span<typename P::real> wz_st1,
+    std::span<typename P::real> mx_pred,
+    std::span<typename P::real> my_pred,
+    std::span<typename P::real> mz_pred);
+
+/** Depondt-Mertens corrector (stage 2): Omega_2 of m_pred, then m rotated
+ *  by h*(Omega_1 + Omega_2)/2, and m_mid = normalize(m) as in
+ *  heun_corrector_fused (the normalization only removes rounding). */
+template <typename P>
+void depondt_corrector_fused(
+    const MatParams mat[2],
+    const double J_joule_per_link[2][2],
+    const FccNeighbors& neighbors,
+    const std::vector<uint8_t>& species,
+    std::span<const typename P::real> mx_pred,
+    std::span<const typename P::real> my_pred,
+    std::span<const typename P::real> mz_pred,
+    double Hx_appl_tesla, double Hy_appl_tesla, double Hz_appl_tesla,
+    std::span<const typename P::real> Hx_ther_tesla,
+    std::span<const typename P::real> Hy_ther_tesla,
+    std::span<const typename P::real> Hz_ther_tesla,
+    std::span<const typename P::real> wx_st1,
+    std::span<const typename P::real> wy_st1,
+    std::span<const typename P::real> wz_st1,
+    double h_sec,
+    std::span<typename P::real> mx,
+    std::span<typename P::real> my,
+    std::span<typename P::real> mz,
+    std::span<typename P::real> mx_mid,
+    std::span<typename P::real> my_mid,
+    std::span<typename P::real> mz_mid);
 
 #endif //INTEGRATOR_H
@@ -2,11 +2,13 @@
 #include "io_csv_utils.h"
 #include "lattice.h"
 #include "math_utils.h"
+#include <charconv>
 #include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <locale>
+#include <sstream>
 #include <stdexcept>
 #include <unordered_map>
 #include <vector>
@@ -24,8 +26,73 @@ using namespace io::csv;
 // easy_axis_x_Fe, easy_axis_y_Fe, easy_axis_z_Fe
 // mu_ampere_m2_Gd, alpha_Gd, gamma_rad_per_tesla_sec_Gd, ku_joule_per_atom_Gd,
 // easy_axis_x_Gd, easy_axis_y_Gd, easy_axis_z_Gd
+/// Optional columns (default in brackets):
+// num_threads [0 = OpenMP default]
+// rng [mt19937] : mt19937 | philox
+// simd [auto] : auto | scalar | avx2
+// integrator [heun] : heun | depondt (Depondt-Mertens rotations, scalar
+//                     kernels; see dt_convergence for the usable dt_sec)
+// exchange [table] : table | stencil
+// site_order [lattice] : lattice | species (species needs exchange=table)
+// cell_order [row] : row | morton | hilbert (curves need exchange=table)
+// validate_precision [0] : 1 = also run in double, mixed and float and write
+//                          precision_validation.csv
+// numa [first_touch] : first_touch | interleave | bind
+// numa_node [0] : node of numa=bind
+// lattice_cache [empty = off] : directory of lattice cache files (needs
+//                               exchange=table, see lattice_cache.h)
+// checkpoint_steps [0 = off] : write a checkpoint every this many steps
+// checkpoint_path [<run dir>/checkpoint.bin] : checkpoint file (see
+//                                              checkpoint.h, --restart)
+// fork_Te_files [empty = off] : Te files separated by ';'. The pre-steps run
+//                               once, then one run phase per file starts from
+//                               the equilibrated state, see README
+// fork_jobs [0 = min(files, threads)] : run phases running at once
+// equilibrated_path [<run dir>/equilibrated.bin] : equilibrated state
+// bulk_format [csv] : csv (bulk_values_vs_time.csv) | binary
+//                    (bulk_values_vs_time.bin, see bulk_series.h)
+// snapshot_steps [0 = off] : write m of all sites to m_snapshots.bin every
+//                            this many steps (see snapshot.h)
+// snapshot_keyframe [16] : every n-th snapshot is a keyframe, the others are
+//                          deltas to the previous one (1 = keyframes only)
+// topology [1] : 1 = write topology.bin (neighbor table and species, see
+//                topology.h; topology_to_text makes the text files)
+// save_steps_fast [0 = off] : adaptive cadence, save every this many steps
+//                             while m or T change fast, else every
+//                             save_steps (must divide it, see save_cadence.h)
+// save_dm_dt_per_ps [0.05] : |dm_Fe| or |dm_Gd| per ps that counts as fast
+// save_dT_dt_kelvin_per_ps [100] : |dT/dt| that counts as fast
+// dt_tol [0 = off] : adaptive step, largest |m_corrector - m_predictor| per
+//                    step (see step_control.h); steps are in units of dt_sec
+// dt_min_sec [dt_sec / 4], dt_max_sec [32 dt_sec] : adaptive step bounds
+// dt_max_dT_kelvin [10] : largest temperature change in one adaptive step
+// pre_mc_sweeps [0 = off] : equilibrate with this many Metropolis sweeps at
+//                           pre_Te_kelvin instead of the LLG pre-steps (see
+//                           monte_carlo.h); LLG starts at step pre_steps
+// replicas [1] : > 1 = run this many replicas in one process, replica r on
+//                Philox stream r (needs rng=philox; see ensemble.h, README)
+// replica_species [shared] : shared | independent (replica r places its Gd
+//                            with seed + r)
+// sweep_jobs [0 = min(jobs, threads)] : jobs of a sweep running at once
+/// Sweeps: every value row is a job, and a cell [v1;v2;...] (list) or
+/// [from:to:n] (n evenly spaced values) expands its row into one job per
+/// value, the Cartesian product over such cells (read_input_jobs, see
+/// sweep.h). read_input_csv reads the first value row as it is. Integer
+/// columns take whole numbers only, so a range must land on them.
 
 namespace {
+    /// Whole-number cell: the entire text must parse (no "4.5" -> 4).
+    template <typename T>
+    T parse_whole(const std::string& text, const std::string& key) {
+        T v{};
+        const char* end = text.data() + text.size();
+        const auto [p, ec] = std::from_chars(text.data(), end, v);
+        if (ec != std::errc() || p != end) {
+            throw std::runtime_error("Expected a whole number for " + key +
+                ": " + text);
+        }
+        return v;
+    }
     double get_dou(const std::unordered_map<std::string, int>& idx,
         const std::vector<std::string>& vals, const std::string& key)
     {
@@ -34,13 +101,29 @@ namespace {
             throw std::runtime_error(std::string("Missing key: ") + key);
         return std::stod(vals[it->second]);
     }
+    double get_dou_or(const std::unordered_map<std::string, int>& idx,
+        const std::vector<std::string>& vals, const std::string& key,
+        const double fallback)
+    {
+        auto it = idx.find(key);
+        if (it == idx.end()) return fallback;
+        return std::stod(vals[it->second]);
+    }
     int get_int(const std::unordered_map<std::string,int>& idx,
         const std::vector<std::string>& vals, const std::string& key)
     {
         auto it = idx.find(key);
         if (it == idx.end())
             throw std::runtime_error(std::string("Missing key: ") + key);
-        return std::stoi(vals[it->second]);
+        return parse_whole<int>(vals[it->second], key);
+    }
+    int get_int_or(const std::unordered_map<std::string,int>& idx,
+        const std::vector<std::string>& vals, const std::string& key,
+        const int fallback)
+    {
+        auto it = idx.find(key);
+        if (it == idx.end()) return fallback;
+        return parse_whole<int>(vals[it->second], key);
     }
     uint32_t get_u32(const std::unordered_map<std::string,int>& idx,
         const std::vector<std::string>& vals, const std::string& key)
@@ -48,7 +131,15 @@ namespace {
         auto it = idx.find(key);
         if (it == idx.end())
             throw std::runtime_error(std::string("Missing key: ") + key);
-        return static_cast<uint32_t>(std::stoul(vals[it->second]));
+        return parse_whole<uint32_t>(vals[it->second], key);
+    }
+    std::string get_str_or(const std::unordered_map<std::string,int>& idx,
+        const std::vector<std::string>& vals, const std::string& key,
+        const std::string& fallback)
+    {
+        auto it = idx.find(key);
+        if (it == idx.end()) return fallback;
+        return vals[it->second];
     }
     std::string get_str(const std::unordered_map<std::string,int>& idx,
         const std::vector<std::string>& vals, const std::string& key)
@@ -58,38 +149,41 @@ namespace {
             throw std::runtime_error(std::string("Missing key: ") + key);
         return vals[it->second];
     }
-}
-
-bool read_input_csv(const std::string& csv_path, ControlParams& control,
-    LatParams& lat, MatParams mat[2])
-{
-    std::ifstream fin(csv_path);
-    if (!fin) {
-        std::cerr << "io:read_input_csv: Failed to open file: " << csv_path
-                  << "\n";
-        return false;
-    }
-
-    std::string header, values;
-    if (!std::getline(fin, header) || !std::getline(fin, values)) {
-        std::cerr << "io:read_input_csv: Expected 2 lines (header + values).\n";
-        return false;
-    }
-
-    auto keys = split_line_csv(header);
-    auto vals_str = split_line_csv(values);
-    if (vals_str.size() != keys.size()) {
-        std::cerr << "io:read_input_csv: Expected " << keys.size() << " entries for values.\n";
-        return false;
-    }
 
-    std::unordered_map<std::string,int> key_idx_map;
-    for (int i=0; i < static_cast<int>(keys.size()); ++i) {
-        if (const std::string& k = keys[i]; !k.empty())
-            key_idx_map[k] = i;
+    /// Values of one input cell: a sweep list [v1;v2;...] or a sweep range
+    /// [from:to:n] (n evenly spaced values, both ends included); any other
+    /// cell is its own single value.
+    std::vector<std::string> expand_cell(const std::string& cell) {
+        if (cell.size() < 2 || cell.front() != '[' || cell.back() != ']')
+            return {cell};
+        const std::string inner = cell.substr(1, cell.size() - 2);
+        std::vector<std::string> out;
+        if (const auto range = split(inner, ':'); range.size() == 3) {
+            const double from = std::stod(range[0]);
+            const double to = std::stod(range[1]);
+            const int n = parse_whole<int>(range[2], "sweep range count");
+            if (n < 1) throw std::runtime_error("Sweep range needs n >= 1: " + cell);
+            for (int k = 0; k < n; ++k) {
+                std::ostringstream os;
+                os.imbue(std::locale::classic());
+                os << std::setprecision(15)
+                   << (n == 1 ? from : from + (to - from) * k / (n - 1));
+                out.push_back(os.str());
+            }
+        }
+        else {
+            out = split(inner, ';');
+        }
+        if (out.empty()) throw std::runtime_error("Empty sweep list: " + cell);
+        return out;
     }
 
-    try {
+    /// Parameters of one value row (cells by column as in key_idx_map).
+    /// Throws std::runtime_error on a missing key or an invalid value.
+    void parse_input_row(const std::unordered_map<std::string,int>& key_idx_map,
+        const std::vector<std::string>& vals_str, ControlParams& control,
+        LatParams& lat, MatParams mat[2])
+    {
         // Sim params
         control.seed            = get_u32(key_idx_map, vals_str, "seed");
         control.pre_steps       = get_int(key_idx_map, vals_str, "pre_steps");
@@ -101,6 +195,160 @@ bool read_input_csv(const std::string& csv_path, ControlParams& control,
         control.run_parent_dir = get_str(key_idx_map, vals_str, "run_parent_dir");
         control.run_base_folder = get_str(key_idx_map, vals_str, "run_base_folder");
         control.Te_filepath   = get_str(key_idx_map, vals_str, "Te_filepath");
+        control.num_threads = get_int_or(key_idx_map, vals_str, "num_threads", 0);
+        {
+            const std::string rng = get_str_or(key_idx_map, vals_str, "rng",
+                "mt19937");
+            if (rng == "mt19937")     control.rng_kind = RngKind::MT19937;
+            else if (rng == "philox") control.rng_kind = RngKind::PHILOX;
+            else throw std::runtime_error("Unknown rng: " + rng);
+        }
+        {
+            const std::string simd = get_str_or(key_idx_map, vals_str, "simd",
+                "auto");
+            if (simd == "auto")        control.simd_mode = SimdMode::AUTO;
+            else if (simd == "scalar") control.simd_mode = SimdMode::SCALAR;
+            else if (simd == "avx2")   control.simd_mode = SimdMode::AVX2;
+            else throw std::runtime_error("Unknown simd: " + simd);
+        }
+        {
+            const std::string scheme = get_str_or(key_idx_map, vals_str,
+                "integrator", "heun");
+            if (scheme == "heun")         control.integrator = Integrator::HEUN;
+            else if (scheme == "depondt") control.integrator = Integrator::DEPONDT;
+            else throw std::runtime_error("Unknown integrator: " + scheme);
+        }
+        {
+            const std::string exch = get_str_or(key_idx_map, vals_str,
+                "exchange", "table");
+            if (exch == "table")        control.exchange_mode = ExchangeMode::TABLE;
+            else if (exch == "stencil") control.exchange_mode = ExchangeMode::STENCIL;
+            else throw std::runtime_error("Unknown exchange: " + exch);
+        }
+        {
+            const std::string order = get_str_or(key_idx_map, vals_str,
+                "site_order", "lattice");
+            if (order == "lattice")      control.site_order = SiteOrder::LATTICE;
+            else if (order == "species") control.site_order = SiteOrder::SPECIES;
+            else throw std::runtime_error("Unknown site_order: " + order);
+            if (control.site_order == SiteOrder::SPECIES &&
+                control.exchange_mode == ExchangeMode::STENCIL) {
+                throw std::runtime_error(
+                    "site_order=species requires exchange=table");
+            }
+        }
+        {
+            const std::string order = get_str_or(key_idx_map, vals_str,
+                "cell_order", "row");
+            if (order == "row")          control.cell_order = CellOrder::ROW_MAJOR;
+            else if (order == "morton")  control.cell_order = CellOrder::MORTON;
+            else if (order == "hilbert") control.cell_order = CellOrder::HILBERT;
+            else throw std::runtime_error("Unknown cell_order: " + order);
+            if (control.cell_order != CellOrder::ROW_MAJOR &&
+                control.exchange_mode == ExchangeMode::STENCIL) {
+                throw std::runtime_error(
+                    "cell_order=" + order + " requires exchange=table");
+            }
+        }
+        control.validate_precision =
+            get_int_or(key_idx_map, vals_str, "validate_precision", 0) != 0;
+        {
+            const std::string numa = get_str_or(key_idx_map, vals_str, "numa",
+                "first_touch");
+            if (numa == "first_touch")     control.numa_policy = NumaPolicy::FIRST_TOUCH;
+            else if (numa == "interleave") control.numa_policy = NumaPolicy::INTERLEAVE;
+            else if (numa == "bind")       control.numa_policy = NumaPolicy::BIND;
+            else throw std::runtime_error("Unknown numa: " + numa);
+            control.numa_node = get_int_or(key_idx_map, vals_str, "numa_node", 0);
+        }
+        control.lattice_cache_dir = get_str_or(key_idx_map, vals_str,
+            "lattice_cache", "");
+        if (!control.lattice_cache_dir.empty() &&
+            control.exchange_mode == ExchangeMode::STENCIL) {
+            throw std::runtime_error("lattice_cache requires exchange=table");
+        }
+        control.checkpoint_steps = get_int_or(key_idx_map, vals_str,
+            "checkpoint_steps", 0);
+        control.checkpoint_path = get_str_or(key_idx_map, vals_str,
+            "checkpoint_path", "");
+        for (const std::string& f : split(get_str_or(key_idx_map, vals_str,
+            "fork_Te_files", ""), ';')) {
+            if (!f.empty()) control.fork_Te_filepaths.push_back(f);
+        }
+        control.fork_jobs = get_int_or(key_idx_map, vals_str, "fork_jobs", 0);
+        control.equilibrated_path = get_str_or(key_idx_map, vals_str,
+            "equilibrated_path", "");
+        {
+            const std::string fmt = get_str_or(key_idx_map, vals_str,
+                "bulk_format", "csv");
+            if (fmt == "csv")         control.bulk_format = BulkFormat::CSV;
+            else if (fmt == "binary") control.bulk_format = BulkFormat::BINARY;
+            else throw std::runtime_error("Unknown bulk_format: " + fmt);
+        }
+        control.snapshot_steps = get_int_or(key_idx_map, vals_str,
+            "snapshot_steps", 0);
+        control.snapshot_keyframe = get_int_or(key_idx_map, vals_str,
+            "snapshot_keyframe", 16);
+        if (control.snapshot_keyframe < 1) {
+            throw std::runtime_error("snapshot_keyframe must be >= 1");
+        }
+        control.write_topology =
+            get_int_or(key_idx_map, vals_str, "topology", 1) != 0;
+        control.save_steps_fast = get_int_or(key_idx_map, vals_str,
+            "save_steps_fast", 0);
+        if (control.save_steps_fast > 0 &&
+            control.save_steps % control.save_steps_fast != 0) {
+            throw std::runtime_error("save_steps_fast must divide save_steps");
+        }
+        control.save_dm_dt_per_ps = get_dou_or(key_idx_map, vals_str,
+            "save_dm_dt_per_ps", 0.05);
+        control.save_dT_dt_kelvin_per_ps = get_dou_or(key_idx_map, vals_str,
+            "save_dT_dt_kelvin_per_ps", 100.0);
+        control.dt_tol = get_dou_or(key_idx_map, vals_str, "dt_tol", 0.0);
+        control.dt_min_sec = get_dou_or(key_idx_map, vals_str, "dt_min_sec",
+            control.dt_sec / 4);
+        control.dt_max_sec = get_dou_or(key_idx_map, vals_str, "dt_max_sec",
+            32 * control.dt_sec);
+        control.dt_max_dT_kelvin = get_dou_or(key_idx_map, vals_str,
+            "dt_max_dT_kelvin", 10.0);
+        control.pre_mc_sweeps = get_int_or(key_idx_map, vals_str,
+            "pre_mc_sweeps", 0);
+        control.replicas = get_int_or(key_idx_map, vals_str, "replicas", 1);
+        {
+            const std::string rs = get_str_or(key_idx_map, vals_str,
+                "replica_species", "shared");
+            if (rs == "shared")
+                control.replica_species = ReplicaSpecies::SHARED;
+            else if (rs == "independent")
+                control.replica_species = ReplicaSpecies::INDEPENDENT;
+            else throw std::runtime_error("Unknown replica_species: " + rs);
+        }
+        if (control.replicas < 1) {
+            throw std::runtime_error("replicas must be >= 1");
+        }
+        if (control.replicas > 1 && (control.rng_kind != RngKind::PHILOX ||
+            control.integrator != Integrator::HEUN ||
+            control.validate_precision || control.checkpoint_steps > 0 ||
+            !control.fork_Te_filepaths.empty() || control.snapshot_steps > 0 ||
+            control.save_steps_fast > 0 || control.dt_tol > 0.0 ||
+            control.pre_mc_sweeps > 0)) {
+            throw std::runtime_error("replicas > 1 requires rng=philox and "
+                "integrator=heun, and does not support validate_precision, "
+                "checkpoints, forks, snapshots, save_steps_fast, dt_tol or "
+                "pre_mc_sweeps");
+        }
+        if (control.replica_species == ReplicaSpecies::INDEPENDENT &&
+            control.site_order == SiteOrder::SPECIES) {
+            throw std::runtime_error("replica_species=independent requires "
+                "site_order=lattice");
+        }
+        control.sweep_jobs = get_int_or(key_idx_map, vals_str, "sweep_jobs", 0);
+        if (control.dt_tol > 0.0 && !(control.dt_min_sec > 0.0 &&
+            control.dt_min_sec <= control.dt_max_sec &&
+            control.dt_max_dT_kelvin > 0.0)) {
+            throw std::runtime_error("dt_tol needs 0 < dt_min_sec <= "
+                "dt_max_sec and dt_max_dT_kelvin > 0");
+        }
 
         // FCC params
         lat.nx      = get_int(key_idx_map, vals_str, "nx");
@@ -153,6 +401,40 @@ bool read_input_csv(const std::string& csv_path, ControlParams& control,
         fill_phys(0, "Fe");
         fill_phys(1, "Gd");
     }
+}
+
+bool read_input_csv(const std::string& csv_path, ControlParams& control,
+    LatParams& lat, MatParams mat[2])
+{
+    std::ifstream fin(csv_path);
+    if (!fin) {
+        std::cerr << "io:read_input_csv: Failed to open file: " << csv_path
+                  << "\n";
+        return false;
+    }
+
+    std::string header, values;
+    if (!std::getline(fin, header) || !std::getline(fin, values)) {
+        std::cerr << "io:read_input_csv: Expected 2 lines (header + values).\n";
+        return false;
+    }
+
+    auto keys = split_line_csv(header);
+    auto vals_str = split_line_csv(values);
+    if (vals_str.size() != keys.size()) {
+        std::cerr << "io:read_input_csv: Expected " << keys.size() << " entries for values.\n";
+        return false;
+    }
+
+    std::unordered_map<std::string,int> key_idx_map;
+    for (int i=0; i < static_cast<int>(keys.size()); ++i) {
+        if (const std::string& k = keys[i]; !k.empty())
+            key_idx_map[k] = i;
+    }
+
+    try {
+        parse_input_row(key_idx_map, vals_str, control, lat, mat);
+    }
     catch (const std::exception& e) {
         std::cerr << "io:read_input_csv: " << e.what() << "\n";
         return false;
@@ -160,6 +442,76 @@ bool read_input_csv(const std::string& csv_path, ControlParams& control,
     return true;
 }
 
+InputSweep read_input_jobs(const std::string& csv_path) {
+    std::ifstream fin(csv_path);
+    if (!fin) {
+        throw std::runtime_error("io:read_input_jobs: Failed to open file: " +
+            csv_path);
+    }
+    InputSweep sweep;
+    std::string line;
+    if (!std::getline(fin, line)) {
+        throw std::runtime_error("io:read_input_jobs: No header in " +
+            csv_path);
+    }
+    sweep.columns = split_line_csv(line);
+    const std::size_t n_cols = sweep.columns.size();
+    std::unordered_map<std::string,int> key_idx_map;
+    for (int i=0; i < static_cast<int>(n_cols); ++i) {
+        if (const std::string& k = sweep.columns[i]; !k.empty())
+            key_idx_map[k] = i;
+    }
+
+    for (int row = 1; std::getline(fin, line); ) {
+        if (trim(line).empty()) continue;
+        try {
+            const auto cells = split_line_csv(line);
+            if (cells.size() != n_cols) {
+                throw std::runtime_error("Expected " + std::to_string(n_cols) +
+                    " entries");
+            }
+            std::vector<std::vector<std::string>> choices;
+            for (const std::string& c : cells) choices.push_back(expand_cell(c));
+            // Cartesian product of the sweep lists, last column fastest.
+            std::vector<std::size_t> pick(n_cols, 0);
+            for (int c = 0; c >= 0; ) {
+                InputSweep::Job job;
+                job.row = row;
+                for (std::size_t k = 0; k < n_cols; ++k)
+                    job.values.push_back(choices[k][pick[k]]);
+                parse_input_row(key_idx_map, job.values, job.control, job.lat,
+                    job.mat);
+                sweep.jobs.push_back(std::move(job));
+                for (c = static_cast<int>(n_cols) - 1;
+                    c >= 0 && ++pick[c] == choices[c].size(); --c) {
+                    pick[c] = 0;
+                }
+            }
+        }
+        catch (const std::exception& e) {
+            throw std::runtime_error("io:read_input_jobs: row " +
+                std::to_string(row) + ": " + e.what());
+        }
+        ++row;
+    }
+    if (sweep.jobs.empty()) {
+        throw std::runtime_error("io:read_input_jobs: No value rows in " +
+            csv_path);
+    }
+    for (const std::string& key : PROCESS_WIDE_COLUMNS) {
+        const auto it = key_idx_map.find(key);
+        if (it == key_idx_map.end()) continue;
+        for (const InputSweep::Job& job : sweep.jobs) {
+            if (job.values[it->second] != sweep.jobs.front().values[it->second]) {
+                throw std::runtime_error("io:read_input_jobs: " + key +
+                    " applies to the whole process and must be the same "
+                    "for all jobs");
+            }
+        }
+    }
+    return sweep;
+}
+
 void process_input(LatParams& lat, MatParams mat[2]) {
     lat.N = count_fcc_sites(lat.nx, lat.ny, lat.nz);
     normalize3(lat.mx_init_Fe, lat.my_init_Fe, lat.mz_init_Fe);
@@ -170,6 +522,24 @@ void process_input(LatParams& lat, MatParams mat[2]) {
     }
 }
 
+void truncate_bulk_values(const std::string& csv_path, const int from_step) {
+    std::ifstream ifs(csv_path);
+    if (!ifs) return;
+    std::string kept, line;
+    if (std::getline(ifs, line)) kept = line + '\n'; // header
+    while (std::getline(ifs, line)) {
+        if (line.empty()) continue;
+        if (std::stoi(line.substr(0, line.find(','))) >= from_step) break;
+        kept += line + '\n';
+    }
+    ifs.close();
+    std::ofstream ofs(csv_path, std::ios::out | std::ios::trunc);
+    if (!ofs || !(ofs << kept) || !ofs.flush()) {
+        throw std::runtime_error(
+            "io:truncate_bulk_values: Failed to write file: " + csv_path);
+    }
+}
+
 void write_bulk_values(const std::string& csv_path, const int time_step,
     const double T_kelvin, const BulkValues& bulk)
 {
@@ -286,12 +656,45 @@ void write_bulk_values(const std::string& csv_path, const int time_step,
         << '\n';
 }
 
+void write_precision_validation(const std::string& csv_path,
+    const std::vector<int>& time_steps,
+    const std::vector<double>& T_kelvin,
+    const std::vector<std::array<double, 6>>& divergence)
+{
+    try {
+        if (const std::filesystem::path p(csv_path); !p.parent_path().empty()) {
+            std::filesystem::create_directories(p.parent_path());
+        }
+    } catch (const std::exception& e) {
+        throw std::runtime_error(std::string(
+            "io:write_precision_validation: Failed to create directories: ")
+            + e.what());
+    }
+
+    std::ofstream ofs(csv_path, std::ios::out | std::ios::trunc);
+    if (!ofs) {
+        throw std::runtime_error(
+            "io:write_precision_validation: Failed to open file: " + csv_path);
+    }
+
+    ofs.imbue(std::locale::classic());
+    ofs << std::defaultfloat << std::setprecision(6);
+    ofs << "time_step,T_kelvin,"
+           "dm_bulk_mixed,dm_Fe_mixed,dm_Gd_mixed,"
+           "dm_bulk_float,dm_Fe_float,dm_Gd_float\n";
+    for (size_t r = 0; r < divergence.size(); ++r) {
+        ofs << time_steps[r] << ',' << T_kelvin[r];
+        for (const double d : divergence[r]) ofs << ',' << d;
+        ofs << '\n';
+    }
+}
+
 /// Write one line per site:
 /// Atom_index:i,j,k,b, nn_index:i,j,k,b, ..., nn_index:i,j,k,b
 void write_nearest_neighbors(const std::string& filepath,
     const int nx, const int ny, const int nz, const int n_basis,
-    const std::vector<std::array<int, constants::FCC_NN_COUNT>>&
-    nearest_neighbors)
+    std::span<const std::array<int, constants::FCC_NN_COUNT>>
+    nearest_neighbors, const SitePermutation* perm)
 {
     try {
         if (const std::filesystem::path p(filepath); !p.parent_path().empty()) {
@@ -310,16 +713,19 @@ void write_nearest_neighbors(const std::string& filepath,
             "io:write_nearest_neighbors: Failed to open file: " + filepath);
     }
 
+    const bool permuted = perm && !perm->is_identity();
     const int N = static_cast<int>(nearest_neighbors.size());
     ofs << "# Atom_index:i,j,k,b, nn_index:i,j,k,b, ..., nn_index:i,j,k,b\n";
     for (int p = 0; p < N; ++p) {
+        const int s = permuted ? perm->to_site[p] : p;
         int ni, nj, nk, nb;
         invert_linear_index(
             p, nx, ny, nz, n_basis, ni, nj, nk, nb);
         ofs << "Atom_" << p << ":"
             << ni << ',' << nj << ',' << nk << ',' << nb;
         for (int q = 0; q < constants::FCC_NN_COUNT; ++q) {
-            const int nei = nearest_neighbors[p][q];
+            const int nei = permuted ? perm->to_lattice[nearest_neighbors[s][q]]
+                : nearest_neighbors[p][q];
             invert_linear_index(nei, nx, ny, nz, n_basis,
                 ni, nj, nk, nb);
             ofs << ", nn_" << nei << ":"
@@ -333,7 +739,7 @@ void write_nearest_neighbors(const std::string& filepath,
 /// Gd_<index>:i,j,k,b
 void write_site_species(const std::string& filepath,
     const int nx, const int ny, const int nz, const int n_basis,
-    const std::vector<uint8_t>& species)
+    const std::vector<uint8_t>& species, const SitePermutation* perm)
 {
     try {
         if (const std::filesystem::path p(filepath); !p.parent_path().empty()) {
@@ -351,10 +757,12 @@ void write_site_species(const std::string& filepath,
             "io:write_site_species: Failed to open file: " + filepath);
     }
 
-    const int N = static_cast<int>(species.size());
+    const bool permuted = perm && !perm->is_identity();
+    const SiteIndex N = static_cast<SiteIndex>(species.size());
     ofs << "# Gd_<index>:i,j,k,b\n";
-    for (int p = 0; p < N; ++p) {
-        if (species[p] == 1) { // 0=Fe, 1=Gd
+    for (SiteIndex p = 0; p < N; ++p) {
+        const SiteIndex s = permuted ? perm->to_site[p] : p;
+        if (species[s] == 1) { // 0=Fe, 1=Gd
             int i, j, k, b;
             invert_linear_index(p, nx, ny, nz, n_basis, i, j, k, b);
             ofs << "Gd_" << p << ':'
@@ -1,12 +1,38 @@
 #ifndef IO_H
 #define IO_H
+#include <span>
 #include <string>
 #include <vector>
+#include "lattice.h"
 #include "params.h"
 
 bool read_input_csv(const std::string& csv_path, ControlParams& control,
     LatParams& lat, MatParams mat[2]);
 
+/// Jobs of a parameter sweep: the value rows of input.csv, each expanded
+/// over its sweep cells ([v1;v2;...] or [from:to:n]), in row order with the
+/// last sweep column varying fastest. Throws std::runtime_error(
+/// "io:read_input_jobs: row <r>: ...") on the first invalid job.
+struct InputSweep {
+    struct Job {
+        ControlParams control{};
+        LatParams lat{};
+        MatParams mat[2]{};
+        int row{0};                       // value row of input.csv, 1 = first
+        std::vector<std::string> values;  // cells of the job, by column
+    };
+    std::vector<std::string> columns;     // header of input.csv
+    std::vector<Job> jobs;
+};
+
+InputSweep read_input_jobs(const std::string& csv_path);
+
+/// Columns that configure the whole process (threads, kernels, memory
+/// placement, sweep workers): read_input_jobs throws unless every job of a
+/// sweep has the same value.
+inline const std::vector<std::string> PROCESS_WIDE_COLUMNS = {
+    "num_threads", "simd", "numa", "numa_node", "sweep_jobs"};
+
 void process_input(LatParams& lat, MatParams mat[2]);
 
 void write_bulk_values(const std::string& csv_path, int time_step,
@@ -17,13 +43,28 @@ void write_bulk_values(const std::string& csv_path, int time_step,
     const BulkValues& bulk_vals,
     const BulkFields& bulk_fields);
 
+/// Drop the rows of time_step >= from_step (a restart writes them again);
+/// the header and the earlier rows stay. No-op if the file does not exist.
+void truncate_bulk_values(const std::string& csv_path, int from_step);
+
+/// One row per saved step: |m_P - m_double| of the bulk, Fe and Gd
+/// magnetization for P = mixed, then P = float.
+void write_precision_validation(const std::string& csv_path,
+    const std::vector<int>& time_steps,
+    const std::vector<double>& T_kelvin,
+    const std::vector<std::array<double, 6>>& divergence);
+
+/// With a site permutation (cell curve or species order), the rows and the
+/// indices are written in row-major lattice order, so the files do not
+/// depend on the storage order.
 void write_nearest_neighbors(const std::string& filepath,
     int nx, int ny, int nz, int n_basis,
-    const std::vector<std::array<int, constants::FCC_NN_COUNT>>&
-    nearest_neighbors);
+    std::span<const std::array<int, constants::FCC_NN_COUNT>>
+    nearest_neighbors, const SitePermutation* perm = nullptr);
 
 void write_site_species(const std::string& filepath,
     int nx, int ny, int nz, int n_basis,
-    const std::vector<uint8_t>& species);
+    const std::vector<uint8_t>& species,
+    const SitePermutation* perm = nullptr);
 
 #endif //IO_H
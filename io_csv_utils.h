@@ -14,15 +14,21 @@ namespace io::csv {
         return s.substr(a, b-a);
     }
 
-    inline std::vector<std::string> split_line_csv(const std::string& line) {
+    inline std::vector<std::string> split(const std::string& line,
+        const char sep)
+    {
         std::vector<std::string> out;
         std::istringstream ss(line);
         std::string item;
-        while (std::getline(ss, item, ','))
+        while (std::getline(ss, item, sep))
             out.push_back(trim(item));
         return out;
     }
 
+    inline std::vector<std::string> split_line_csv(const std::string& line) {
+        return split(line, ',');
+    }
+
 } // namespace io::csv
 
 #endif //IO_CSV_UTILS_H
@@ -0,0 +1,696 @@
+#include "kernels_avx2.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define KERNELS_AVX2_ENABLED 1
+#include <immintrin.h>
+#include <cstring>
+#endif
+
+namespace {
+    bool g_use_avx2 = false;
+}
+
+#ifdef KERNELS_AVX2_ENABLED
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+namespace {
+    // Four sites i..i+3 per register; lanes with species == 1 (Gd) all-ones.
+    AVX2_TARGET inline __m256d gd_mask(const uint8_t* species, const SiteIndex i) {
+        return _mm256_castsi256_pd(_mm256_set_epi64x(
+            -static_cast<int64_t>(species[i+3] == 1),
+            -static_cast<int64_t>(species[i+2] == 1),
+            -static_cast<int64_t>(species[i+1] == 1),
+            -static_cast<int64_t>(species[i]   == 1)));
+    }
+
+    AVX2_TARGET inline __m256d pick(const __m256d mask_gd,
+        const double v_Fe, const double v_Gd)
+    {
+        return _mm256_blendv_pd(_mm256_set1_pd(v_Fe), _mm256_set1_pd(v_Gd),
+            mask_gd);
+    }
+
+    /// Per-species constants, hoisted once per kernel call.
+    struct SpeciesConst {
+        double inv_mu[2];
+        double mu[2];
+        double two_ku[2];
+        double ex[2], ey[2], ez[2];
+        double alpha[2];
+        double gamma_prime[2];
+
+        explicit SpeciesConst(const MatParams mat[2]) {
+            for (int s = 0; s < 2; ++s) {
+                inv_mu[s] = 1.0 / mat[s].mu_ampere_m2;
+                mu[s]     = mat[s].mu_ampere_m2;
+                two_ku[s] = 2.*mat[s].ku_joule_per_atom;
+                ex[s] = mat[s].easy_axis.x;
+                ey[s] = mat[s].easy_axis.y;
+                ez[s] = mat[s].easy_axis.z;
+                alpha[s] = mat[s].alpha;
+                gamma_prime[s] = -mat[s].gamma_rad_per_tesla_sec /
+                    (1. + mat[s].alpha*mat[s].alpha);
+            }
+        }
+    };
+
+    // Same accumulation order as exch_field_at (fields.h). Index as there:
+    // int for table entries, SiteIndex for stencil lists.
+    template <typename Index>
+    AVX2_TARGET inline void exch4(const SiteIndex i,
+        const __m256d mask_i,
+        const SpeciesConst& sc,
+        const double J_joule_per_link[2][2],
+        const std::array<Index, constants::FCC_NN_COUNT>* neighbors_of_4,
+        const uint8_t* species,
+        const double* mx, const double* my, const double* mz,
+        __m256d& Hx, __m256d& Hy, __m256d& Hz)
+    {
+        // The neighbor sums use per-lane scalar loads: AVX2 hardware gathers
+        // (and lane inserts) measured slower than this for 12 random reads.
+        double ax[4], ay[4], az[4];
+        for (int l = 0; l < 4; ++l) {
+            const double* J_row = J_joule_per_link[species[i+l]];
+            double sx = 0.0, sy = 0.0, sz = 0.0;
+            for (const Index j : neighbors_of_4[l]) {
+                const double J_ij = J_row[species[j]] * constants::EXCH_FACTOR;
+                sx += J_ij * mx[j];
+                sy += J_ij * my[j];
+                sz += J_ij * mz[j];
+            }
+            ax[l] = sx; ay[l] = sy; az[l] = sz;
+        }
+        const __m256d hx = _mm256_loadu_pd(ax);
+        const __m256d hy = _mm256_loadu_pd(ay);
+        const __m256d hz = _mm256_loadu_pd(az);
+        const __m256d inv_mu = pick(mask_i, sc.inv_mu[0], sc.inv_mu[1]);
+        Hx = _mm256_mul_pd(hx, inv_mu);
+        Hy = _mm256_mul_pd(hy, inv_mu);
+        Hz = _mm256_mul_pd(hz, inv_mu);
+    }
+
+    // Same operation order as anis_field_at (fields.h).
+    AVX2_TARGET inline void anis4(const __m256d mask_i,
+        const SpeciesConst& sc,
+        const __m256d mx, const __m256d my, const __m256d mz,
+        __m256d& Hx, __m256d& Hy, __m256d& Hz)
+    {
+        const __m256d ex = pick(mask_i, sc.ex[0], sc.ex[1]);
+        const __m256d ey = pick(mask_i, sc.ey[0], sc.ey[1]);
+        const __m256d ez = pick(mask_i, sc.ez[0], sc.ez[1]);
+        const __m256d mu = pick(mask_i, sc.mu[0], sc.mu[1]);
+        const __m256d two_ku = pick(mask_i, sc.two_ku[0], sc.two_ku[1]);
+
+        const __m256d dot = _mm256_add_pd(_mm256_add_pd(
+            _mm256_mul_pd(mx, ex), _mm256_mul_pd(my, ey)),
+            _mm256_mul_pd(mz, ez));
+        const __m256d c = _mm256_mul_pd(two_ku, dot);
+        Hx = _mm256_div_pd(_mm256_mul_pd(c, ex), mu);
+        Hy = _mm256_div_pd(_mm256_mul_pd(c, ey), mu);
+        Hz = _mm256_div_pd(_mm256_mul_pd(c, ez), mu);
+    }
+
+    // Same operation order as llg_rhs_at (integrator.h).
+    AVX2_TARGET inline void llg4(const __m256d mask_i,
+        const SpeciesConst& sc,
+        const __m256d mx, const __m256d my, const __m256d mz,
+        const __m256d Hx, const __m256d Hy, const __m256d Hz,
+        __m256d& dmx, __m256d& dmy, __m256d& dmz)
+    {
+        const __m256d gp = pick(mask_i, sc.gamma_prime[0], sc.gamma_prime[1]);
+        const __m256d alpha = pick(mask_i, sc.alpha[0], sc.alpha[1]);
+
+        // c1 = m x H
+        const __m256d c1x = _mm256_sub_pd(_mm256_mul_pd(my, Hz), _mm256_mul_pd(mz, Hy));
+        const __m256d c1y = _mm256_sub_pd(_mm256_mul_pd(mz, Hx), _mm256_mul_pd(mx, Hz));
+        const __m256d c1z = _mm256_sub_pd(_mm256_mul_pd(mx, Hy), _mm256_mul_pd(my, Hx));
+
+        // c2 = m x (m x H)
+        const __m256d c2x = _mm256_sub_pd(_mm256_mul_pd(my, c1z), _mm256_mul_pd(mz, c1y));
+        const __m256d c2y = _mm256_sub_pd(_mm256_mul_pd(mz, c1x), _mm256_mul_pd(mx, c1z));
+        const __m256d c2z = _mm256_sub_pd(_mm256_mul_pd(mx, c1y), _mm256_mul_pd(my, c1x));
+
+        dmx = _mm256_mul_pd(gp, _mm256_add_pd(c1x, _mm256_mul_pd(alpha, c2x)));
+        dmy = _mm256_mul_pd(gp, _mm256_add_pd(c1y, _mm256_mul_pd(alpha, c2y)));
+        dmz = _mm256_mul_pd(gp, _mm256_add_pd(c1z, _mm256_mul_pd(alpha, c2z)));
+    }
+
+    // Same as normalize3 (math_utils.h): zero vectors are left untouched.
+    AVX2_TARGET inline void normalize4(__m256d& x, __m256d& y, __m256d& z) {
+        const __m256d n = _mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(
+            _mm256_mul_pd(x, x), _mm256_mul_pd(y, y)), _mm256_mul_pd(z, z)));
+        const __m256d nonzero = _mm256_cmp_pd(n, _mm256_setzero_pd(), _CMP_GT_OQ);
+        const __m256d inv = _mm256_div_pd(_mm256_set1_pd(1.0), n);
+        x = _mm256_blendv_pd(x, _mm256_mul_pd(x, inv), nonzero);
+        y = _mm256_blendv_pd(y, _mm256_mul_pd(y, inv), nonzero);
+        z = _mm256_blendv_pd(z, _mm256_mul_pd(z, inv), nonzero);
+    }
+
+    AVX2_TARGET inline __m256d total4(const double H_appl, const __m256d H_exch,
+        const __m256d H_anis, const double* H_ther, const SiteIndex i)
+    {
+        return _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(
+            _mm256_set1_pd(H_appl), H_exch), H_anis), _mm256_loadu_pd(H_ther + i));
+    }
+
+    AVX2_TARGET SiteIndex exch_field_impl(const SiteIndex N,
+        const MatParams mat[2], const double J_joule_per_link[2][2],
+        const std::array<int, constants::FCC_NN_COUNT>* nearest_neighbors,
+        const uint8_t* species,
+        const double* mx, const double* my, const double* mz,
+        double* Hx_exch_tesla, double* Hy_exch_tesla, double* Hz_exch_tesla)
+    {
+        const SpeciesConst sc(mat);
+        const SiteIndex N4 = N & ~SiteIndex(3);
+        #pragma omp parallel for schedule(static)
+        for (SiteIndex i = 0; i < N4; i += 4) {
+            const __m256d mask_i = gd_mask(species, i);
+            __m256d Hx, Hy, Hz;
+            exch4(i, mask_i, sc, J_joule_per_link, nearest_neighbors + i,
+                species, mx, my, mz, Hx, Hy, Hz);
+            _mm256_storeu_pd(Hx_exch_tesla + i, Hx);
+            _mm256_storeu_pd(Hy_exch_tesla + i, Hy);
+            _mm256_storeu_pd(Hz_exch_tesla + i, Hz);
+        }
+        return N4;
+    }
+
+    AVX2_TARGET SiteIndex dm_dt_impl(const SiteIndex N,
+        const MatParams mat[2], const uint8_t* species,
+        const double* mx, const double* my, const double* mz,
+        const double* Hx_total_tesla, const double* Hy_total_tesla,
+        const double* Hz_total_tesla,
+        double* dmx_dt, double* dmy_dt, double* dmz_dt)
+    {
+        const SpeciesConst sc(mat);
+        const SiteIndex N4 = N & ~SiteIndex(3);
+        #pragma omp parallel for schedule(static)
+        for (SiteIndex i = 0; i < N4; i += 4) {
+            const __m256d mask_i = gd_mask(species, i);
+            __m256d dmx, dmy, dmz;
+            llg4(mask_i, sc,
+                _mm256_loadu_pd(mx + i), _mm256_loadu_pd(my + i),
+                _mm256_loadu_pd(mz + i),
+                _mm256_loadu_pd(Hx_total_tesla + i),
+                _mm256_loadu_pd(Hy_total_tesla + i),
+                _mm256_loadu_pd(Hz_total_tesla + i),
+                dmx, dmy, dmz);
+            _mm256_storeu_pd(dmx_dt + i, dmx);
+            _mm256_storeu_pd(dmy_dt + i, dmy);
+            _mm256_storeu_pd(dmz_dt + i, dmz);
+        }
+        return N4;
+    }
+
+    AVX2_TARGET SiteIndex advance_and_normalize_impl(const SiteIndex N,
+        const double* mx_in, const double* my_in, const double* mz_in,
+        double* mx_out, double* my_out, double* mz_out,
+        const double* dmx_dt, const double* dmy_dt, const double* dmz_dt,
+        const double h_sec)
+    {
+        const __m256d h = _mm256_set1_pd(h_sec);
+        const SiteIndex N4 = N & ~SiteIndex(3);
+        #pragma omp parallel for schedule(static)
+        for (SiteIndex i = 0; i < N4; i += 4) {
+            __m256d x = _mm256_loadu_pd(mx_in + i);
+            __m256d y = _mm256_loadu_pd(my_in + i);
+            __m256d z = _mm256_loadu_pd(mz_in + i);
+            if (h_sec != 0.0) {
+                x = _mm256_add_pd(x, _mm256_mul_pd(h, _mm256_loadu_pd(dmx_dt + i)));
+                y = _mm256_add_pd(y, _mm256_mul_pd(h, _mm256_loadu_pd(dmy_dt + i)));
+                z = _mm256_add_pd(z, _mm256_mul_pd(h, _mm256_loadu_pd(dmz_dt + i)));
+            }
+            normalize4(x, y, z);
+            _mm256_storeu_pd(mx_out + i, x);
+            _mm256_storeu_pd(my_out + i, y);
+            _mm256_storeu_pd(mz_out + i, z);
+        }
+        return N4;
+    }
+
+    AVX2_TARGET SiteIndex advance_and_normalize_Heun_impl(const SiteIndex N,
+        double* mx, double* my, double* mz,
+        const double* dmx_dt_st1, const double* dmy_dt_st1,
+        const double* dmz_dt_st1,
+        const double* dmx_dt_st2, const double* dmy_dt_st2,
+        const double* dmz_dt_st2,
+        const double h_sec)
+    {
+        const __m256d half_h = _mm256_set1_pd(h_sec * 0.5);
+        const SiteIndex N4 = N & ~SiteIndex(3);
+        #pragma omp parallel for schedule(static)
+        for (SiteIndex i = 0; i < N4; i += 4) {
+            __m256d x = _mm256_add_pd(_mm256_loadu_pd(mx + i), _mm256_mul_pd(half_h,
+                _mm256_add_pd(_mm256_loadu_pd(dmx_dt_st1 + i), _mm256_loadu_pd(dmx_dt_st2 + i))));
+            __m256d y = _mm256_add_pd(_mm256_loadu_pd(my + i), _mm256_mul_pd(half_h,
+                _mm256_add_pd(_mm256_loadu_pd(dmy_dt_st1 + i), _mm256_loadu_pd(dmy_dt_st2 + i))));
+            __m256d z = _mm256_add_pd(_mm256_loadu_pd(mz + i), _mm256_mul_pd(half_h,
+                _mm256_add_pd(_mm256_loadu_pd(dmz_dt_st1 + i), _mm256_loadu_pd(dmz_dt_st2 + i))));
+            normalize4(x, y, z);
+            _mm256_storeu_pd(mx + i, x);
+            _mm256_storeu_pd(my + i, y);
+            _mm256_storeu_pd(mz + i, z);
+        }
+        return N4;
+    }
+
+    AVX2_TARGET void heun_predictor_impl(const MatParams mat[2],
+        const double J_joule_per_link[2][2],
+        const FccNeighbors& neighbors,
+        const uint8_t* species,
+        const double* mx, const double* my, const double* mz,
+        const double* mx_mid, const double* my_mid, const double* mz_mid,
+        const double H_appl_tesla[3],
+        const double* Hx_ther_tesla, const double* Hy_ther_tesla,
+        const double* Hz_ther_tesla,
+        const double h_sec,
+        double* dmx_dt_st1, double* dmy_dt_st1, double* dmz_dt_st1,
+        double* mx_pred, double* my_pred, double* mz_pred)
+    {
+        const SpeciesConst sc(mat);
+        const __m256d h = _mm256_set1_pd(h_sec);
+        #pragma omp parallel for schedule(static)
+        for (int row = 0; row < neighbors.n_rows(); ++row) {
+            const int ci = row / neighbors.ny, cj = row % neighbors.ny;
+            FccNeighbors::WideList scratch[constants::FCC_BASIS_COUNT];
+            for (int ck = 0; ck < neighbors.nz; ++ck) {
+                const SiteIndex i = neighbors.first_site(row, ck);
+                const __m256d mask_i = gd_mask(species, i);
+                const __m256d mx_i = _mm256_loadu_pd(mx_mid + i);
+                const __m256d my_i = _mm256_loadu_pd(my_mid + i);
+                const __m256d mz_i = _mm256_loadu_pd(mz_mid + i);
+
+                __m256d Hx_exch, Hy_exch, Hz_exch;
+                if (neighbors.table) {
+                    exch4(i, mask_i, sc, J_joule_per_link, neighbors.table + i,
+                        species, mx_mid, my_mid, mz_mid, Hx_exch, Hy_exch, Hz_exch);
+                }
+                else {
+                    exch4(i, mask_i, sc, J_joule_per_link,
+                        neighbors.stencil_cell(i, ci, cj, ck, scratch),
+                        species, mx_mid, my_mid, mz_mid, Hx_exch, Hy_exch, Hz_exch);
+                }
+                __m256d Hx_anis, Hy_anis, Hz_anis;
+                anis4(mask_i, sc, mx_i, my_i, mz_i, Hx_anis, Hy_anis, Hz_anis);
+                const __m256d Hx = total4(H_appl_tesla[0], Hx_exch, Hx_anis, Hx_ther_tesla, i);
+                const __m256d Hy = total4(H_appl_tesla[1], Hy_exch, Hy_anis, Hy_ther_tesla, i);
+                const __m256d Hz = total4(H_appl_tesla[2], Hz_exch, Hz_anis, Hz_ther_tesla, i);
+
+                __m256d dmx, dmy, dmz;
+                llg4(mask_i, sc, mx_i, my_i, mz_i, Hx, Hy, Hz, dmx, dmy, dmz);
+                _mm256_storeu_pd(dmx_dt_st1 + i, dmx);
+                _mm256_storeu_pd(dmy_dt_st1 + i, dmy);
+                _mm256_storeu_pd(dmz_dt_st1 + i, dmz);
+
+                __m256d x = _mm256_add_pd(_mm256_loadu_pd(mx + i), _mm256_mul_pd(h, dmx));
+                __m256d y = _mm256_add_pd(_mm256_loadu_pd(my + i), _mm256_mul_pd(h, dmy));
+                __m256d z = _mm256_add_pd(_mm256_loadu_pd(mz + i), _mm256_mul_pd(h, dmz));
+                normalize4(x, y, z);
+                _mm256_storeu_pd(mx_pred + i, x);
+                _mm256_storeu_pd(my_pred + i, y);
+                _mm256_storeu_pd(mz_pred + i, z);
+            }
+        }
+    }
+
+    AVX2_TARGET void heun_corrector_impl(const MatParams mat[2],
+        const double J_joule_per_link[2][2],
+        const FccNeighbors& neighbors,
+        const uint8_t* species,
+        const double* mx_pred, const double* my_pred, const double* mz_pred,
+        const double H_appl_tesla[3],
+        const double* Hx_ther_tesla, const double* Hy_ther_tesla,
+        const double* Hz_ther_tesla,
+        const double* dmx_dt_st1, const double* dmy_dt_st1,
+        const double* dmz_dt_st1,
+        const double h_sec,
+        double* mx, double* my, double* mz,
+        double* mx_mid, double* my_mid, double* mz_mid)
+    {
+        const SpeciesConst sc(mat);
+        const __m256d half_h = _mm256_set1_pd(h_sec * 0.5);
+        #pragma omp parallel for schedule(static)
+        for (int row = 0; row < neighbors.n_rows(); ++row) {
+            const int ci = row / neighbors.ny, cj = row % neighbors.ny;
+            FccNeighbors::WideList scratch[constants::FCC_BASIS_COUNT];
+            for (int ck = 0; ck < neighbors.nz; ++ck) {
+                const SiteIndex i = neighbors.first_site(row, ck);
+                const __m256d mask_i = gd_mask(species, i);
+                const __m256d mx_i = _mm256_loadu_pd(mx_pred + i);
+                const __m256d my_i = _mm256_loadu_pd(my_pred + i);
+                const __m256d mz_i = _mm256_loadu_pd(mz_pred + i);
+
+                __m256d Hx_exch, Hy_exch, Hz_exch;
+                if (neighbors.table) {
+                    exch4(i, mask_i, sc, J_joule_per_link, neighbors.table + i,
+                        species, mx_pred, my_pred, mz_pred, Hx_exch, Hy_exch, Hz_exch);
+                }
+                else {
+                    exch4(i, mask_i, sc, J_joule_per_link,
+                        neighbors.stencil_cell(i, ci, cj, ck, scratch),
+                        species, mx_pred, my_pred, mz_pred, Hx_exch, Hy_exch, Hz_exch);
+                }
+                __m256d Hx_anis, Hy_anis, Hz_anis;
+                anis4(mask_i, sc, mx_i, my_i, mz_i, Hx_anis, Hy_anis, Hz_anis);
+                const __m256d Hx = total4(H_appl_tesla[0], Hx_exch, Hx_anis, Hx_ther_tesla, i);
+                const __m256d Hy = total4(H_appl_tesla[1], Hy_exch, Hy_anis, Hy_ther_tesla, i);
+                const __m256d Hz = total4(H_appl_tesla[2], Hz_exch, Hz_anis, Hz_ther_tesla, i);
+
+                __m256d dmx2, dmy2, dmz2;
+                llg4(mask_i, sc, mx_i, my_i, mz_i, Hx, Hy, Hz, dmx2, dmy2, dmz2);
+
+                __m256d x = _mm256_add_pd(_mm256_loadu_pd(mx + i), _mm256_mul_pd(half_h,
+                    _mm256_add_pd(_mm256_loadu_pd(dmx_dt_st1 + i), dmx2)));
+                __m256d y = _mm256_add_pd(_mm256_loadu_pd(my + i), _mm256_mul_pd(half_h,
+                    _mm256_add_pd(_mm256_loadu_pd(dmy_dt_st1 + i), dmy2)));
+                __m256d z = _mm256_add_pd(_mm256_loadu_pd(mz + i), _mm256_mul_pd(half_h,
+                    _mm256_add_pd(_mm256_loadu_pd(dmz_dt_st1 + i), dmz2)));
+                normalize4(x, y, z);
+                _mm256_storeu_pd(mx + i, x);
+                _mm256_storeu_pd(my + i, y);
+                _mm256_storeu_pd(mz + i, z);
+
+                normalize4(x, y, z);
+                _mm256_storeu_pd(mx_mid + i, x);
+                _mm256_storeu_pd(my_mid + i, y);
+                _mm256_storeu_pd(mz_mid + i, z);
+            }
+        }
+    }
+
+    // Four replicas k..k+3 of one site (contiguous species bytes); lanes
+    // with species == 1 (Gd) all-ones.
+    AVX2_TARGET inline __m256d gd_mask_replicas(const uint8_t* species,
+        const SiteIndex k)
+    {
+        int32_t s4;
+        std::memcpy(&s4, species + k, sizeof(s4));
+        const __m256i s = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(s4));
+        return _mm256_castsi256_pd(_mm256_cmpeq_epi64(s,
+            _mm256_set1_epi64x(1)));
+    }
+
+    /// Arrays of an ensemble Heun stage. Predictor: fields at m_mid (f*),
+    /// writes dm/dt_st1 and m_pred (out*). Corrector: fields at m_pred (f*),
+    /// advances m, writes m_mid (out*).
+    struct EnsembleArrays {
+        const double *fx, *fy, *fz;
+        const double *Hx_ther, *Hy_ther, *Hz_ther;
+        double *mx, *my, *mz;
+        double *dmx_st1, *dmy_st1, *dmz_st1;
+        double *outx, *outy, *outz;
+    };
+
+    // Replicas r0..r0+3 of site i (k = i*R + r0) with neighbor list nb:
+    // per replica the operations of exch4 / anis4 / llg4 / normalize4.
+    template <bool CORRECTOR, typename Index>
+    AVX2_TARGET inline void ensemble_stage4(const SiteIndex k, const int R,
+        const int r0, const SpeciesConst& sc, const double J_link[2][2],
+        const std::array<Index, constants::FCC_NN_COUNT>& nb,
+        const uint8_t* species, const double H_appl_tesla[3],
+        const __m256d h, const EnsembleArrays& a)
+    {
+        const __m256d mask_i = gd_mask_replicas(species, k);
+        // J_ij of a Fe and of a Gd neighbor, per lane species of i.
+        const __m256d J_Fe = pick(mask_i, J_link[0][0], J_link[1][0]);
+        const __m256d J_Gd = pick(mask_i, J_link[0][1], J_link[1][1]);
+        __m256d hx = _mm256_setzero_pd();
+        __m256d hy = _mm256_setzero_pd();
+        __m256d hz = _mm256_setzero_pd();
+        for (const Index j : nb) {
+            const SiteIndex o = static_cast<SiteIndex>(j)*R + r0;
+            const __m256d J_ij = _mm256_blendv_pd(J_Fe, J_Gd,
+                gd_mask_replicas(species, o));
+            hx = _mm256_add_pd(hx, _mm256_mul_pd(J_ij, _mm256_loadu_pd(a.fx + o)));
+            hy = _mm256_add_pd(hy, _mm256_mul_pd(J_ij, _mm256_loadu_pd(a.fy + o)));
+            hz = _mm256_add_pd(hz, _mm256_mul_pd(J_ij, _mm256_loadu_pd(a.fz + o)));
+        }
+        const __m256d inv_mu = pick(mask_i, sc.inv_mu[0], sc.inv_mu[1]);
+        const __m256d Hx_exch = _mm256_mul_pd(hx, inv_mu);
+        const __m256d Hy_exch = _mm256_mul_pd(hy, inv_mu);
+        const __m256d Hz_exch = _mm256_mul_pd(hz, inv_mu);
+
+        const __m256d mx_i = _mm256_loadu_pd(a.fx + k);
+        const __m256d my_i = _mm256_loadu_pd(a.fy + k);
+        const __m256d mz_i = _mm256_loadu_pd(a.fz + k);
+        __m256d Hx_anis, Hy_anis, Hz_anis;
+        anis4(mask_i, sc, mx_i, my_i, mz_i, Hx_anis, Hy_anis, Hz_anis);
+        const __m256d Hx = total4(H_appl_tesla[0], Hx_exch, Hx_anis, a.Hx_ther, k);
+        const __m256d Hy = total4(H_appl_tesla[1], Hy_exch, Hy_anis, a.Hy_ther, k);
+        const __m256d Hz = total4(H_appl_tesla[2], Hz_exch, Hz_anis, a.Hz_ther, k);
+
+        __m256d dmx, dmy, dmz;
+        llg4(mask_i, sc, mx_i, my_i, mz_i, Hx, Hy, Hz, dmx, dmy, dmz);
+        if constexpr (!CORRECTOR) {
+            _mm256_storeu_pd(a.dmx_st1 + k, dmx);
+            _mm256_storeu_pd(a.dmy_st1 + k, dmy);
+            _mm256_storeu_pd(a.dmz_st1 + k, dmz);
+            __m256d x = _mm256_add_pd(_mm256_loadu_pd(a.mx + k), _mm256_mul_pd(h, dmx));
+            __m256d y = _mm256_add_pd(_mm256_loadu_pd(a.my + k), _mm256_mul_pd(h, dmy));
+            __m256d z = _mm256_add_pd(_mm256_loadu_pd(a.mz + k), _mm256_mul_pd(h, dmz));
+            normalize4(x, y, z);
+            _mm256_storeu_pd(a.outx + k, x);
+            _mm256_storeu_pd(a.outy + k, y);
+            _mm256_storeu_pd(a.outz + k, z);
+        }
+        else {
+            // h is h/2 here.
+            __m256d x = _mm256_add_pd(_mm256_loadu_pd(a.mx + k), _mm256_mul_pd(h,
+                _mm256_add_pd(_mm256_loadu_pd(a.dmx_st1 + k), dmx)));
+            __m256d y = _mm256_add_pd(_mm256_loadu_pd(a.my + k), _mm256_mul_pd(h,
+                _mm256_add_pd(_mm256_loadu_pd(a.dmy_st1 + k), dmy)));
+            __m256d z = _mm256_add_pd(_mm256_loadu_pd(a.mz + k), _mm256_mul_pd(h,
+                _mm256_add_pd(_mm256_loadu_pd(a.dmz_st1 + k), dmz)));
+            normalize4(x, y, z);
+            _mm256_storeu_pd(a.mx + k, x);
+            _mm256_storeu_pd(a.my + k, y);
+            _mm256_storeu_pd(a.mz + k, z);
+
+            normalize4(x, y, z);
+            _mm256_storeu_pd(a.outx + k, x);
+            _mm256_storeu_pd(a.outy + k, y);
+            _mm256_storeu_pd(a.outz + k, z);
+        }
+    }
+
+    template <bool CORRECTOR>
+    AVX2_TARGET int ensemble_stage_impl(const int R, const MatParams mat[2],
+        const double J_joule_per_link[2][2], const FccNeighbors& neighbors,
+        const uint8_t* species, const double H_appl_tesla[3],
+        const double h_sec, const EnsembleArrays& a)
+    {
+        const SpeciesConst sc(mat);
+        double J_link[2][2];
+        for (int s = 0; s < 2; ++s) {
+            for (int t = 0; t < 2; ++t) {
+                J_link[s][t] = J_joule_per_link[s][t] * constants::EXCH_FACTOR;
+            }
+        }
+        const __m256d h = _mm256_set1_pd(CORRECTOR ? h_sec * 0.5 : h_sec);
+        const int R4 = R & ~3;
+        #pragma omp parallel for schedule(static)
+        for (int row = 0; row < neighbors.n_rows(); ++row) {
+            const int ci = row / neighbors.ny, cj = row % neighbors.ny;
+            FccNeighbors::WideList scratch[constants::FCC_BASIS_COUNT];
+            for (int ck = 0; ck < neighbors.nz; ++ck) {
+                const SiteIndex p = neighbors.first_site(row, ck);
+                const FccNeighbors::WideList* wide = neighbors.table ? nullptr :
+                    neighbors.stencil_cell(p, ci, cj, ck, scratch);
+                for (int b = 0; b < constants::FCC_BASIS_COUNT; ++b) {
+                    const SiteIndex i = p + b;
+                    for (int r0 = 0; r0 < R4; r0 += 4) {
+                        if (wide) {
+                            ensemble_stage4<CORRECTOR>(i*R + r0, R, r0, sc,
+                                J_link, wide[b], species, H_appl_tesla, h, a);
+                        }
+                        else {
+                            ensemble_stage4<CORRECTOR>(i*R + r0, R, r0, sc,
+                                J_link, neighbors.table[i], species,
+                                H_appl_tesla, h, a);
+                        }
+                    }
+                }
+            }
+        }
+        return R4;
+    }
+}
+#endif // KERNELS_AVX2_ENABLED
+
+namespace simd {
+    bool avx2_supported() {
+#ifdef KERNELS_AVX2_ENABLED
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+#else
+        return false;
+#endif
+    }
+
+    SimdMode configure(const SimdMode mode) {
+        g_use_avx2 = (mode != SimdMode::SCALAR) && avx2_supported();
+        return g_use_avx2 ? SimdMode::AVX2 : SimdMode::SCALAR;
+    }
+
+    bool avx2_active() { return g_use_avx2; }
+
+    const char* active_name() { return g_use_avx2 ? "avx2" : "scalar"; }
+
+#ifdef KERNELS_AVX2_ENABLED
+#define DISPATCH_AVX2(impl, ...) \
+    return g_use_avx2 ? impl(__VA_ARGS__) : 0
+#define DISPATCH_AVX2_ALL(impl, ...) \
+    if (!g_use_avx2) return false; \
+    impl(__VA_ARGS__); \
+    return true
+#else
+#define DISPATCH_AVX2(impl, ...) \
+    return 0
+#define DISPATCH_AVX2_ALL(impl, ...) \
+    return false
+#endif
+
+    SiteIndex exch_field(const SiteIndex N,
+        const MatParams mat[2], const double J_joule_per_link[2][2],
+        const std::array<int, constants::FCC_NN_COUNT>* nearest_neighbors,
+        const uint8_t* species,
+        const double* mx, const double* my, const double* mz,
+        double* Hx_exch_tesla, double* Hy_exch_tesla, double* Hz_exch_tesla)
+    {
+        DISPATCH_AVX2(exch_field_impl, N, mat, J_joule_per_link,
+            nearest_neighbors, species, mx, my, mz,
+            Hx_exch_tesla, Hy_exch_tesla, Hz_exch_tesla);
+    }
+
+    SiteIndex dm_dt(const SiteIndex N,
+        const MatParams mat[2], const uint8_t* species,
+        const double* mx, const double* my, const double* mz,
+        const double* Hx_total_tesla, const double* Hy_total_tesla,
+        const double* Hz_total_tesla,
+        double* dmx_dt, double* dmy_dt, double* dmz_dt)
+    {
+        DISPATCH_AVX2(dm_dt_impl, N, mat, species, mx, my, mz,
+            Hx_total_tesla, Hy_total_tesla, Hz_total_tesla,
+            dmx_dt, dmy_dt, dmz_dt);
+    }
+
+    SiteIndex advance_and_normalize(const SiteIndex N,
+        const double* mx_in, const double* my_in, const double* mz_in,
+        double* mx_out, double* my_out, double* mz_out,
+        const double* dmx_dt, const double* dmy_dt, const double* dmz_dt,
+        const double h_sec)
+    {
+        DISPATCH_AVX2(advance_and_normalize_impl, N, mx_in, my_in, mz_in,
+            mx_out, my_out, mz_out, dmx_dt, dmy_dt, dmz_dt, h_sec);
+    }
+
+    SiteIndex advance_and_normalize_Heun(const SiteIndex N,
+        double* mx, double* my, double* mz,
+        const double* dmx_dt_st1, const double* dmy_dt_st1,
+        const double* dmz_dt_st1,
+        const double* dmx_dt_st2, const double* dmy_dt_st2,
+        const double* dmz_dt_st2,
+        const double h_sec)
+    {
+        DISPATCH_AVX2(advance_and_normalize_Heun_impl, N, mx, my, mz,
+            dmx_dt_st1, dmy_dt_st1, dmz_dt_st1,
+            dmx_dt_st2, dmy_dt_st2, dmz_dt_st2, h_sec);
+    }
+
+    bool heun_predictor(const MatParams mat[2],
+        const double J_joule_per_link[2][2],
+        const FccNeighbors& neighbors,
+        const uint8_t* species,
+        const double* mx, const double* my, const double* mz,
+        const double* mx_mid, const double* my_mid, const double* mz_mid,
+        const double H_appl_tesla[3],
+        const double* Hx_ther_tesla, const double* Hy_ther_tesla,
+        const double* Hz_ther_tesla,
+        const double h_sec,
+        double* dmx_dt_st1, double* dmy_dt_st1, double* dmz_dt_st1,
+        double* mx_pred, double* my_pred, double* mz_pred)
+    {
+        DISPATCH_AVX2_ALL(heun_predictor_impl, mat, J_joule_per_link,
+            neighbors, species, mx, my, mz, mx_mid, my_mid, mz_mid,
+            H_appl_tesla, Hx_ther_tesla, Hy_ther_tesla, Hz_ther_tesla, h_sec,
+            dmx_dt_st1, dmy_dt_st1, dmz_dt_st1, mx_pred, my_pred, mz_pred);
+    }
+
+    bool heun_corrector(const MatParams mat[2],
+        const double J_joule_per_link[2][2],
+        const FccNeighbors& neighbors,
+        const uint8_t* species,
+        const double* mx_pred, const double* my_pred, const double* mz_pred,
+        const double H_appl_tesla[3],
+        const double* Hx_ther_tesla, const double* Hy_ther_tesla,
+        const double* Hz_ther_tesla,
+        const double* dmx_dt_st1, const double* dmy_dt_st1,
+        const double* dmz_dt_st1,
+        const double h_sec,
+        double* mx, double* my, double* mz,
+        double* mx_mid, double* my_mid, double* mz_mid)
+    {
+        DISPATCH_AVX2_ALL(heun_corrector_impl, mat, J_joule_per_link,
+            neighbors, species, mx_pred, my_pred, mz_pred,
+            H_appl_tesla, Hx_ther_tesla, Hy_ther_tesla, Hz_ther_tesla,
+            dmx_dt_st1, dmy_dt_st1, dmz_dt_st1, h_sec,
+            mx, my, mz, mx_mid, my_mid, mz_mid);
+    }
+
+    int ensemble_heun_predictor(const int R,
+        const MatParams mat[2], const double J_joule_per_link[2][2],
+        const FccNeighbors& neighbors,
+        const uint8_t* species,
+        const double* mx, const double* my, const double* mz,
+        const double* mx_mid, const double* my_mid, const double* mz_mid,
+        const double H_appl_tesla[3],
+        const double* Hx_ther_tesla, const double* Hy_ther_tesla,
+        const double* Hz_ther_tesla,
+        const double h_sec,
+        double* dmx_dt_st1, double* dmy_dt_st1, double* dmz_dt_st1,
+        double* mx_pred, double* my_pred, double* mz_pred)
+    {
+#ifdef KERNELS_AVX2_ENABLED
+        if (!g_use_avx2) return 0;
+        // m is only read by the predictor.
+        const EnsembleArrays a{mx_mid, my_mid, mz_mid,
+            Hx_ther_tesla, Hy_ther_tesla, Hz_ther_tesla,
+            const_cast<double*>(mx), const_cast<double*>(my),
+            const_cast<double*>(mz),
+            dmx_dt_st1, dmy_dt_st1, dmz_dt_st1, mx_pred, my_pred, mz_pred};
+        return ensemble_stage_impl<false>(R, mat, J_joule_per_link,
+            neighbors, species, H_appl_tesla, h_sec, a);
+#else
+        return 0;
+#endif
+    }
+
+    int ensemble_heun_corrector(const int R,
+        const MatParams mat[2], const double J_joule_per_link[2][2],
+        const FccNeighbors& neighbors,
+        const uint8_t* species,
+        const double* mx_pred, const double* my_pred, const double* mz_pred,
+        const double H_appl_tesla[3],
+        const double* Hx_ther_tesla, const double* Hy_ther_tesla,
+        const double* Hz_ther_tesla,
+        const double* dmx_dt_st1, const double* dmy_dt_st1,
+        const double* dmz_dt_st1,
+        const double h_sec,
+        double* mx, double* my, double* mz,
+        double* mx_mid, double* my_mid, double* mz_mid)
+    {
+#ifdef KERNELS_AVX2_ENABLED
+        if (!g_use_avx2) return 0;
+        // dm/dt_st1 is only read by the corrector.
+        const EnsembleArrays a{mx_pred, my_pred, mz_pred,
+            Hx_ther_tesla, Hy_ther_tesla, Hz_ther_tesla, mx, my, mz,
+            const_cast<double*>(dmx_dt_st1), const_cast<double*>(dmy_dt_st1),
+            const_cast<double*>(dmz_dt_st1), mx_mid, my_mid, mz_mid};
+        return ensemble_stage_impl<true>(R, mat, J_joule_per_link,
+            neighbors, species, H_appl_tesla, h_sec, a);
+#else
+        return 0;
+#endif
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef KERNELS_AVX2_H
+#define KERNELS_AVX2_H
+#include <array>
+#include <cstdint>
+#include "lattice.h"
+#include "params.h"
+
+/// Explicit AVX2 variants of the hot per-site kernels, selected at runtime.
+/// Each kernel handles sites [0, N4) with N4 = N rounded down to a multiple
+/// of 4 (in parallel) and returns N4; the caller finishes the tail with its
+/// scalar loop. Kernels return 0 when AVX2 is not active, so callers need no
+/// separate branch. Only separate mul/add/div/sqrt are used (no FMA), in the
+/// same order as the scalar code, so results are bit-identical to it.
+namespace simd {
+    /// CPU supports AVX2 (and the build targets x86-64 with GCC/Clang).
+    bool avx2_supported();
+
+    /// Select the kernel set: AUTO picks AVX2 when supported. Requesting AVX2
+    /// on a CPU without it falls back to scalar. Returns the active mode.
+    SimdMode configure(SimdMode mode);
+    bool avx2_active();
+    const char* active_name();
+
+    SiteIndex exch_field(SiteIndex N,
+        const MatParams mat[2],
+        const double J_joule_per_link[2][2],
+        const std::array<int, constants::FCC_NN_COUNT>* nearest_neighbors,
+        const uint8_t* species,
+        const double* mx, const double* my, const double* mz,
+        double* Hx_exch_tesla, double* Hy_exch_tesla, double* Hz_exch_tesla);
+
+    SiteIndex dm_dt(SiteIndex N,
+        const MatParams mat[2],
+        const uint8_t* species,
+        const double* mx, const double* my, const double* mz,
+        const double* Hx_total_tesla, const double* Hy_total_tesla,
+        const double* Hz_total_tesla,
+        double* dmx_dt, double* dmy_dt, double* dmz_dt);
+
+    /// m_out = normalize(m_in + h*dm/dt); dm/dt is ignored if h == 0.
+    SiteIndex advance_and_normalize(SiteIndex N,
+        const double* mx_in, const double* my_in, const double* mz_in,
+        double* mx_out, double* my_out, double* mz_out,
+        const double* dmx_dt, const double* dmy_dt, const double* dmz_dt,
+        double h_sec);
+
+    /// m = normalize(m + h/2*(dm/dt_st1 + dm/dt_st2)).
+    SiteIndex advance_and_normalize_Heun(SiteIndex N,
+        double* mx, double* my, double* mz,
+        const double* dmx_dt_st1, const double* dmy_dt_st1,
+        const double* dmz_dt_st1,
+        const double* dmx_dt_st2, const double* dmy_dt_st2,
+        const double* dmz_dt_st2,
+        double h_sec);
+
+    /// See heun_predictor_fused (integrator.h). The fused kernels walk all
+    /// 4 * cells sites of `neighbors` and return false when AVX2 is off.
+    bool heun_predictor(const MatParams mat[2],
+        const double J_joule_per_link[2][2],
+        const FccNeighbors& neighbors,
+        const uint8_t* species,
+        const double* mx, const double* my, const double* mz,
+        const double* mx_mid, const double* my_mid, const double* mz_mid,
+        const double H_appl_tesla[3],
+        const double* Hx_ther_tesla, const double* Hy_ther_tesla,
+        const double* Hz_ther_tesla,
+        double h_sec,
+        double* dmx_dt_st1, double* dmy_dt_st1, double* dmz_dt_st1,
+        double* mx_pred, double* my_pred, double* mz_pred);
+
+    /// See heun_corrector_fused (integrator.h).
+    bool heun_corrector(const MatParams mat[2],
+        const double J_joule_per_link[2][2],
+        const FccNeighbors& neighbors,
+        const uint8_t* species,
+        const double* mx_pred, const double* my_pred, const double* mz_pred,
+        const double H_appl_tesla[3],
+        const double* Hx_ther_tesla, const double* Hy_ther_tesla,
+        const double* Hz_ther_tesla,
+        const double* dmx_dt_st1, const double* dmy_dt_st1,
+        const double* dmz_dt_st1,
+        double h_sec,
+        double* mx, double* my, double* mz,
+        double* mx_mid, double* my_mid, double* mz_mid);
+
+    /// Heun stages of an ensemble (ensemble.h) on its replica-innermost
+    /// arrays (replica r of site i at i*R + r): one register holds replicas
+    /// r0..r0+3 of a site, so every neighbor read is one contiguous load.
+    /// Each replica gets the bits of heun_predictor / heun_corrector above.
+    /// Covers replicas [0, R4) with R4 = R rounded down to a multiple of 4
+    /// and returns R4 (0 when AVX2 is off); the caller does the rest.
+    int ensemble_heun_predictor(int R,
+        const MatParams mat[2],
+        const double J_joule_per_link[2][2],
+        const FccNeighbors& neighbors,
+        const uint8_t* species,
+        const double* mx, const double* my, const double* mz,
+        const double* mx_mid, const double* my_mid, const double* mz_mid,
+        const double H_appl_tesla[3],
+        const double* Hx_ther_tesla, const double* Hy_ther_tesla,
+        const double* Hz_ther_tesla,
+        double h_sec,
+        double* dmx_dt_st1, double* dmy_dt_st1, double* dmz_dt_st1,
+        double* mx_pred, double* my_pred, double* mz_pred);
+
+    int ensemble_heun_corrector(int R,
+        const MatParams mat[2],
+        const double J_joule_per_link[2][2],
+        const FccNeighbors& neighbors,
+        const uint8_t* species,
+        const double* mx_pred, const double* my_pred, const double* mz_pred,
+        const double H_appl_tesla[3],
+        const double* Hx_ther_tesla, const double* Hy_ther_tesla,
+        const double* Hz_ther_tesla,
+        const double* dmx_dt_st1, const double* dmy_dt_st1,
+        const double* dmz_dt_st1,
+        double h_sec,
+        double* mx, double* my, double* mz,
+        double* mx_mid, double* my_mid, double* mz_mid);
+}
+
+#endif //KERNELS_AVX2_H
@@ -2,8 +2,11 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <limits>
 #include <numeric>
 #include <random>
+#include <stdexcept>
+#include <string>
 
 namespace {
     // Basis offsets in half-steps
@@ -31,86 +34,192 @@ namespace {
         return -1;
     }
 
-    // Linear index from (cell i,j,k) and basis b
-    int lin_from_cell_and_basis(
-        const int i, const int j, const int k, const int b,
-        const int nx, const int ny, const int nz, const int n_basis)
+    // Interleave the low `bits` bits of x, y, z (x most significant).
+    uint64_t morton_key(const uint32_t x, const uint32_t y, const uint32_t z,
+        const int bits)
     {
-        return (((i*ny + j)*nz + k)*n_basis + b);
+        uint64_t key = 0;
+        for (int b=bits-1; b >= 0; --b) {
+            key = (key << 3) | (((x >> b) & 1u) << 2) | (((y >> b) & 1u) << 1)
+                | ((z >> b) & 1u);
+        }
+        return key;
+    }
+
+    // Hilbert index of (x, y, z) on a 2^bits cube: Skilling's axes-to-
+    // transpose (AIP Conf. Proc. 707, 381 (2004)), then bit interleaving.
+    uint64_t hilbert_key(const uint32_t x, const uint32_t y, const uint32_t z,
+        const int bits)
+    {
+        uint32_t X[3] = {x, y, z};
+        const uint32_t M = 1u << (bits - 1);
+        for (uint32_t Q = M; Q > 1; Q >>= 1) { // inverse undo excess work
+            const uint32_t P = Q - 1;
+            for (int a=0; a < 3; ++a) {
+                if (X[a] & Q) {
+                    X[0] ^= P;
+                }
+                else {
+                    const uint32_t t = (X[0] ^ X[a]) & P;
+                    X[0] ^= t;
+                    X[a] ^= t;
+                }
+            }
+        }
+        for (int a=1; a < 3; ++a) X[a] ^= X[a-1]; // Gray encode
+        uint32_t t = 0;
+        for (uint32_t Q = M; Q > 1; Q >>= 1) {
+            if (X[2] & Q) t ^= Q - 1;
+        }
+        for (uint32_t& v : X) v ^= t;
+        return morton_key(X[0], X[1], X[2], bits);
     }
 
-    //  10 %  3 =  1
-    //  10 % -3 =  1
-    // -10 %  3 = -1
-    // -10 % -3 = -1
-    int wrap_modulo(const int v, const int m) {
-        assert(m > 0 && "wrap_modulo: modulus m must be > 0");
-        int r = v % m;
-        return (r < 0) ? (r + m) : r; // Returns in [0, m-1]
+    // rank[c] = position of row-major cell c = (i*ny + j)*nz + k along the
+    // curve. Extents need not be powers of two: the lattice is embedded in
+    // the enclosing 2^bits cube and the cells are sorted by their key.
+    std::vector<int> cell_ranks(const int nx, const int ny, const int nz,
+        const CellOrder order)
+    {
+        int bits = 1;
+        while ((1 << bits) < std::max({nx, ny, nz})) ++bits;
+
+        const int n_cells = nx*ny*nz;
+        std::vector<uint64_t> keys(n_cells);
+        #pragma omp parallel for schedule(static)
+        for (int i=0; i < nx; ++i) {
+            for (int j=0; j < ny; ++j) {
+                for (int k=0; k < nz; ++k) {
+                    const int c = (i*ny + j)*nz + k;
+                    keys[c] = (order == CellOrder::HILBERT) ?
+                        hilbert_key(i, j, k, bits) : morton_key(i, j, k, bits);
+                }
+            }
+        }
+        std::vector<int> by_key(n_cells);
+        std::iota(by_key.begin(), by_key.end(), 0);
+        std::sort(by_key.begin(), by_key.end(),
+            [&keys](const int a, const int b){ return keys[a] < keys[b]; });
+
+        std::vector<int> rank(n_cells);
+        #pragma omp parallel for schedule(static)
+        for (int r=0; r < n_cells; ++r) rank[by_key[r]] = r;
+        return rank;
     }
 }
 
 void build_fcc_nn(const int nx, const int ny, const int nz,
-    std::vector<std::array<int,constants::FCC_NN_COUNT>>& nearest_neighbors)
+    std::vector<std::array<int,constants::FCC_NN_COUNT>>& nearest_neighbors,
+    const CellOrder order, SitePermutation* perm)
 {
-    const int N  = count_fcc_sites(nx, ny, nz);
-    const int GX = 2*nx, GY = 2*ny, GZ = 2*nz; // doubled-grid extents
+    const SiteIndex N_sites = count_fcc_sites(nx, ny, nz);
+    if (N_sites > std::numeric_limits<int>::max()) {
+        throw std::length_error("lattice:build_fcc_nn: " +
+            std::to_string(N_sites) + " sites exceed the 32-bit table; "
+            "use exchange=stencil");
+    }
+    const int N  = static_cast<int>(N_sites);
 
     nearest_neighbors.resize(N);
 
-    // For each site (i,j,k,b) with grid coords (gx,gy,gz) =
-    // (2i+bx, 2j+by, 2k+bz), add the 12 NN integer offsets, wrap with PBC, map
-    // back to (cell, basis).
-    int p = 0;
-    for (int i=0; i<nx; ++i) {
-        for (int j=0; j<ny; ++j) {
-            for (int k=0; k<nz; ++k) {
-                for (int b=0; b < constants::FCC_BASIS_COUNT; ++b, ++p) {
-                    const int gx = 2*i + BASIS_OFF[b][0];
-                    const int gy = 2*j + BASIS_OFF[b][1];
-                    const int gz = 2*k + BASIS_OFF[b][2];
-
-                    std::array<int,constants::FCC_NN_COUNT> neis;
-                    for (int q=0; q < constants::FCC_NN_COUNT; ++q) {
-                        const int nei_gx = wrap_modulo(gx + NN12_OFF[q][0], GX);
-                        const int nei_gy = wrap_modulo(gy + NN12_OFF[q][1], GY);
-                        const int nei_gz = wrap_modulo(gz + NN12_OFF[q][2], GZ);
-
-                        // grid coords back to cell + basis:
-                        const int nei_i = nei_gx >> 1;  // divide by 2
-                        const int nei_j = nei_gy >> 1;
-                        const int nei_k = nei_gz >> 1;
-                        const int rx = nei_gx & 1;      // remainder (0 or 1)
-                        const int ry = nei_gy & 1;
-                        const int rz = nei_gz & 1;
-                        const int nei_b = fcc_basis_from_remainders(rx, ry, rz);
-
-                        neis[q] = lin_from_cell_and_basis(nei_i, nei_j, nei_k,
-                            nei_b, nx, ny, nz, constants::FCC_BASIS_COUNT);
-                    }
-                    nearest_neighbors[p] = neis;
+    // Site index of (cell, basis): row-major, or 4*rank(cell) + b on a curve.
+    std::vector<int> rank;
+    if (order != CellOrder::ROW_MAJOR) {
+        if (!perm) {
+            throw std::invalid_argument(
+                "lattice:build_fcc_nn: a cell curve order needs perm");
+        }
+        rank = cell_ranks(nx, ny, nz, order);
+        perm->to_lattice.resize(N);
+        perm->to_site.resize(N);
+        perm->n_Fe = -1;
+    }
+    const auto site_of = [&](const SiteIndex p) {
+        return static_cast<int>(rank.empty() ? p :
+            SiteIndex(rank[p / constants::FCC_BASIS_COUNT])
+            *constants::FCC_BASIS_COUNT + p % constants::FCC_BASIS_COUNT);
+    };
+
+    // Each site (i,j,k,b) has grid coords (gx,gy,gz) = (2i+bx, 2j+by, 2k+bz);
+    // its 12 neighbors are the NN offsets wrapped with PBC and mapped back to
+    // (cell, basis). The stencil holds that map per (b, q) as a cell shift
+    // and neighbor basis, so cells are independent and rows run in parallel.
+    const FccNeighbors stencil = FccNeighbors::stencil(nx, ny, nz);
+    #pragma omp parallel for schedule(static)
+    for (int row=0; row < stencil.n_rows(); ++row) {
+        const int ci = row / ny, cj = row % ny;
+        FccNeighbors::WideList scratch[constants::FCC_BASIS_COUNT];
+        for (int ck=0; ck < nz; ++ck) {
+            const SiteIndex p0 = stencil.first_site(row, ck);
+            const FccNeighbors::WideList* nb4 =
+                stencil.stencil_cell(p0, ci, cj, ck, scratch);
+            for (int b=0; b < constants::FCC_BASIS_COUNT; ++b) {
+                const int p = static_cast<int>(p0) + b;
+                const int s = site_of(p);
+                for (int q=0; q < constants::FCC_NN_COUNT; ++q)
+                    nearest_neighbors[s][q] = site_of(nb4[b][q]);
+                if (!rank.empty()) {
+                    perm->to_lattice[s] = p;
+                    perm->to_site[p] = s;
                 }
             }
         }
     }
 }
 
-// Reproducible random assignment by fraction using hash+sort trick
-void assign_species_by_fraction(const int N, double frac1,
+FccNeighbors FccNeighbors::from_table(
+    std::span<const List> nearest_neighbors,
+    const int nx, const int ny, const int nz, const int species_split)
+{
+    FccNeighbors nb{};
+    nb.table = nearest_neighbors.data();
+    nb.nx = nx; nb.ny = ny; nb.nz = nz;
+    nb.species_split = species_split;
+    return nb;
+}
+
+FccNeighbors FccNeighbors::stencil(const int nx, const int ny, const int nz) {
+    FccNeighbors nb{};
+    nb.nx = nx; nb.ny = ny; nb.nz = nz;
+    for (int b=0; b < constants::FCC_BASIS_COUNT; ++b) {
+        for (int q=0; q < constants::FCC_NN_COUNT; ++q) {
+            // Half-step offset within [-1, 2]: cell shift is floor(v/2).
+            int cell[3], rem[3];
+            for (int a=0; a < 3; ++a) {
+                const int v = BASIS_OFF[b][a] + NN12_OFF[q][a];
+                cell[a] = (v < 0) ? -1 : v >> 1;
+                rem[a]  = v & 1;
+            }
+            const int nei_b = fcc_basis_from_remainders(rem[0], rem[1], rem[2]);
+            nb.shift[b][q][0] = cell[0];
+            nb.shift[b][q][1] = cell[1];
+            nb.shift[b][q][2] = cell[2];
+            nb.shift[b][q][3] = nei_b;
+            nb.delta[b][q] =
+                ((cell[0]*ny + cell[1])*nz + cell[2])*constants::FCC_BASIS_COUNT
+                + nei_b - b;
+        }
+    }
+    return nb;
+}
+
+// Reproducible random assignment by fraction: the target_ones sites with the
+// smallest splitmix64 keys become 1. The mixer is a bijection, so the keys
+// are distinct and this is the set a full sort of the keys picks; it is found
+// by radix selection instead: a parallel histogram of the top key bits, then
+// nth_element on the keys of the one bucket that holds the threshold.
+void assign_species_by_fraction(const SiteIndex N, double frac1,
     std::vector<uint8_t>& species, uint32_t shuffle_seed)
 {
     species.resize(N, 0);
     if (N == 0) return;
 
     frac1 = std::clamp(frac1, 0.0, 1.0);
-    const int target_ones = static_cast<int>(std::round(frac1 * N));
+    const SiteIndex target_ones =
+        static_cast<SiteIndex>(std::round(frac1 * static_cast<double>(N)));
     if (target_ones <= 0) return;
     if (target_ones == N) {species.assign(N, 1); return;}
 
-    std::vector<uint64_t> keys(N);
-    std::vector<int>      idx(N);
-    std::iota(idx.begin(), idx.end(), 0);
-
     // splitmix64 mixer
     auto mix = [shuffle_seed](uint64_t x){
         x += (uint64_t)0x9E3779B97F4A7C15ULL + shuffle_seed;
@@ -119,10 +228,86 @@ void assign_species_by_fraction(const int N, double frac1,
         x =  x ^ (x >> 31);
         return x;
     };
-    for (int i=0; i<N; ++i) keys[i] = mix(static_cast<uint64_t>(i));
 
-    std::sort(idx.begin(), idx.end(),
-        [&keys](const int a, const int b){ return keys[a] < keys[b]; });
+    constexpr int RADIX_BITS = 16;
+    constexpr std::size_t N_BUCKETS = std::size_t(1) << RADIX_BITS;
+    const auto bucket_of = [](const uint64_t key) {
+        return static_cast<std::size_t>(key >> (64 - RADIX_BITS));
+    };
+    std::vector<SiteIndex> hist(N_BUCKETS, 0);
+    #pragma omp parallel
+    {
+        std::vector<SiteIndex> local(N_BUCKETS, 0);
+        #pragma omp for schedule(static)
+        for (SiteIndex i=0; i<N; ++i)
+            ++local[bucket_of(mix(static_cast<uint64_t>(i)))];
+        #pragma omp critical
+        for (std::size_t b=0; b < N_BUCKETS; ++b) hist[b] += local[b];
+    }
+
+    // Bucket of the target_ones-th smallest key, and the keys below it.
+    std::size_t bucket = 0;
+    SiteIndex below = 0;
+    while (below + hist[bucket] < target_ones) below += hist[bucket++];
 
-    for (int r=0; r<target_ones; ++r) species[idx[r]] = 1;
+    std::vector<uint64_t> candidates;
+    candidates.reserve(static_cast<std::size_t>(hist[bucket]));
+    #pragma omp parallel
+    {
+        std::vector<uint64_t> local;
+        #pragma omp for schedule(static)
+        for (SiteIndex i=0; i<N; ++i) {
+            const uint64_t key = mix(static_cast<uint64_t>(i));
+            if (bucket_of(key) == bucket) local.push_back(key);
+        }
+        #pragma omp critical
+        candidates.insert(candidates.end(), local.begin(), local.end());
+    }
+    const auto nth = candidates.begin() + (target_ones - below - 1);
+    std::nth_element(candidates.begin(), nth, candidates.end());
+    const uint64_t threshold = *nth;
+
+    #pragma omp parallel for schedule(static)
+    for (SiteIndex i=0; i<N; ++i)
+        species[i] = (mix(static_cast<uint64_t>(i)) <= threshold) ? 1 : 0;
+}
+
+void partition_sites_by_species(std::vector<uint8_t>& species,
+    std::vector<std::array<int,constants::FCC_NN_COUNT>>& nearest_neighbors,
+    SitePermutation& perm)
+{
+    const int N = static_cast<int>(species.size());
+
+    // Stable partition: Fe in current order, then Gd in current order.
+    int n_Fe = 0;
+    for (int s=0; s < N; ++s) n_Fe += (species[s] == 0);
+    std::vector<int> old_of_new(N), new_of_old(N);
+    int next[2] = {0, n_Fe};
+    for (int s=0; s < N; ++s) {
+        const int t = next[species[s] == 0 ? 0 : 1]++;
+        old_of_new[t] = s;
+        new_of_old[s] = t;
+    }
+
+    std::vector<std::array<int,constants::FCC_NN_COUNT>> permuted(N);
+    #pragma omp parallel for schedule(static)
+    for (int t=0; t < N; ++t) {
+        const auto& nn_s = nearest_neighbors[old_of_new[t]];
+        for (int q=0; q < constants::FCC_NN_COUNT; ++q)
+            permuted[t][q] = new_of_old[nn_s[q]];
+    }
+    nearest_neighbors.swap(permuted);
+
+    for (int t=0; t < N; ++t) species[t] = (t < n_Fe) ? 0 : 1;
+
+    // Compose with the previous order (identity or a cell curve).
+    std::vector<int> to_lattice(N);
+    for (int t=0; t < N; ++t) {
+        const int s = old_of_new[t];
+        to_lattice[t] = perm.is_identity() ? s : perm.to_lattice[s];
+    }
+    perm.to_lattice.swap(to_lattice);
+    perm.to_site.resize(N);
+    for (int t=0; t < N; ++t) perm.to_site[perm.to_lattice[t]] = t;
+    perm.n_Fe = n_Fe;
 }
@@ -3,29 +3,195 @@
 #include <vector>
 #include <array>
 #include <cstdint>
+#include <span>
 #include "params.h"
 
-inline int count_fcc_sites(const int nx, const int ny, const int nz) {
-    return 4 * nx * ny * nz;
+/// Site count 4*nx*ny*nz in 64 bits.
+inline SiteIndex count_fcc_sites(const int nx, const int ny, const int nz) {
+    return SiteIndex(4) * nx * ny * nz;
 }
 
 // Invert p = (((i*ny + j)*nz + k)*n_basis + b)
-inline void invert_linear_index(int p,
+inline void invert_linear_index(SiteIndex p,
     const int nx, const int ny, const int nz, const int n_basis,
     int& i, int& j, int& k, int& b)
 {
-    b = p % n_basis;    p /= n_basis;
-    k = p % nz;         p /= nz;
-    j = p % ny;         p /= ny;
-    i = p;
+    b = static_cast<int>(p % n_basis);  p /= n_basis;
+    k = static_cast<int>(p % nz);       p /= nz;
+    j = static_cast<int>(p % ny);       p /= ny;
+    i = static_cast<int>(p);
 }
 
-/** Build FCC lattice and nearest-neighbor table with PBC. */
+/** Nearest-neighbor lookup used by the kernels. Either wraps the explicit
+ *  table from build_fcc_nn, or (stencil) computes the 12 neighbors of site
+ *  p = (((i*ny + j)*nz + k)*4 + b) on the fly: interior cells add a fixed
+ *  offset per (b, q), boundary cells wrap periodically. Both give the same
+ *  indices in the same order as build_fcc_nn. Table entries are 32-bit
+ *  (List, N <= INT32_MAX); the stencil produces 64-bit lists (WideList), so
+ *  it covers any N. */
+struct FccNeighbors {
+    using List = std::array<int, constants::FCC_NN_COUNT>;
+    using WideList = std::array<SiteIndex, constants::FCC_NN_COUNT>;
+
+    const List* table{nullptr}; // nullptr = stencil
+    int nx{0}, ny{0}, nz{0};
+    // Species-partitioned table (SitePermutation::n_Fe): sites
+    // [0, species_split) are Fe, [species_split, N) Gd. -1 otherwise.
+    int species_split{-1};
+    int delta[constants::FCC_BASIS_COUNT][constants::FCC_NN_COUNT]{};
+    // Neighbor q of basis b: cell shift (di, dj, dk) in {-1,0,1}, basis nb.
+    int shift[constants::FCC_BASIS_COUNT][constants::FCC_NN_COUNT][4]{};
+
+    static FccNeighbors from_table(std::span<const List> nearest_neighbors,
+        int nx, int ny, int nz, int species_split = -1);
+    static FccNeighbors stencil(int nx, int ny, int nz);
+
+    bool is_stencil() const { return table == nullptr; }
+    bool is_partitioned() const { return species_split >= 0; }
+    int n_rows() const { return nx*ny; } // rows of nz cells, (i, j) fixed
+    /// First site of cell ck of row (i, j) = (row / ny, row % ny).
+    SiteIndex first_site(const int row, const int ck) const {
+        return (static_cast<SiteIndex>(row)*nz + ck)*constants::FCC_BASIS_COUNT;
+    }
+
+    /// Stencil neighbors of the 4 sites of cell (i, j, k), whose first site
+    /// is p, written to scratch.
+    const WideList* stencil_cell(const SiteIndex p,
+        const int i, const int j, const int k, WideList scratch[4]) const
+    {
+        const bool interior = i > 0 && i < nx-1 && j > 0 && j < ny-1 &&
+            k > 0 && k < nz-1;
+        for (int b = 0; b < constants::FCC_BASIS_COUNT; ++b) {
+            if (interior) {
+                for (int q = 0; q < constants::FCC_NN_COUNT; ++q)
+                    scratch[b][q] = p + b + delta[b][q];
+            }
+            else {
+                fill_boundary(i, j, k, b, scratch[b]);
+            }
+        }
+        return scratch;
+    }
+
+    /// Stencil neighbors of site p alone, written to scratch.
+    const WideList& stencil_site(const SiteIndex p, WideList& scratch) const {
+        const int b = static_cast<int>(p % constants::FCC_BASIS_COUNT);
+        const SiteIndex cell = p / constants::FCC_BASIS_COUNT;
+        const int k = static_cast<int>(cell % nz);
+        const SiteIndex row = cell / nz;
+        const int i = static_cast<int>(row / ny), j = static_cast<int>(row % ny);
+        if (i > 0 && i < nx-1 && j > 0 && j < ny-1 && k > 0 && k < nz-1) {
+            for (int q = 0; q < constants::FCC_NN_COUNT; ++q)
+                scratch[q] = p + delta[b][q];
+        }
+        else {
+            fill_boundary(i, j, k, b, scratch);
+        }
+        return scratch;
+    }
+
+    /// f(nb4) with the neighbor lists of the 4 sites of cell (i, j, k):
+    /// nb4 is a const List* into the table, or a const WideList* to scratch
+    /// filled by the stencil, so f is usually a generic lambda.
+    template <typename F>
+    void visit_cell(const SiteIndex p, const int i, const int j, const int k,
+        WideList scratch[4], F&& f) const
+    {
+        if (table) f(table + p);
+        else       f(stencil_cell(p, i, j, k, scratch));
+    }
+
+    /// f(nb) with the neighbor list of site p (List or WideList, as above).
+    template <typename F>
+    void visit_site(const SiteIndex p, WideList& scratch, F&& f) const {
+        if (table) f(table[p]);
+        else       f(stencil_site(p, scratch));
+    }
+
+private:
+    void fill_boundary(const int i, const int j, const int k, const int b,
+        WideList& out) const
+    {
+        for (int q = 0; q < constants::FCC_NN_COUNT; ++q) {
+            const int* s = shift[b][q];
+            int ni = i + s[0], nj = j + s[1], nk = k + s[2];
+            ni = (ni < 0) ? ni + nx : (ni >= nx ? ni - nx : ni);
+            nj = (nj < 0) ? nj + ny : (nj >= ny ? nj - ny : nj);
+            nk = (nk < 0) ? nk + nz : (nk >= nz ? nk - nz : nk);
+            out[q] = ((static_cast<SiteIndex>(ni)*ny + nj)*nz + nk)
+                *constants::FCC_BASIS_COUNT + s[3];
+        }
+    }
+};
+
+/** Storage order of the sites relative to the row-major lattice index
+ *  p = (((i*ny + j)*nz + k)*4 + b): site s holds lattice site to_lattice[s],
+ *  lattice site p is stored at to_site[p]. Empty maps = row-major order.
+ *  Only the table modes reorder sites, so the maps hold 32-bit indices. */
+struct SitePermutation {
+    std::vector<int> to_lattice;
+    std::vector<int> to_site;
+    int n_Fe{-1}; // species-partitioned: [0, n_Fe) Fe, [n_Fe, N) Gd; else -1
+
+    bool is_identity() const { return to_lattice.empty(); }
+};
+
+/// Invert a site index of a permuted order to (i, j, k, b).
+inline void invert_linear_index(const SiteIndex s, const SitePermutation& perm,
+    const int nx, const int ny, const int nz, const int n_basis,
+    int& i, int& j, int& k, int& b)
+{
+    invert_linear_index(perm.is_identity() ? s : perm.to_lattice[s],
+        nx, ny, nz, n_basis, i, j, k, b);
+}
+
+/** Build FCC lattice and nearest-neighbor table with PBC.
+ *  With a MORTON or HILBERT cell order, cells are numbered along the curve
+ *  (site = 4*rank(cell) + b), so most of the 12 neighbors of a site are
+ *  nearby in memory in all three directions; the table then uses these site
+ *  indices and perm receives the map to the row-major lattice index.
+ *  Entries are 32-bit: throws std::length_error above INT32_MAX sites. */
 void build_fcc_nn(int nx, int ny, int nz,
-    std::vector<std::array<int,constants::FCC_NN_COUNT>>& nearest_neighbors);
+    std::vector<std::array<int,constants::FCC_NN_COUNT>>& nearest_neighbors,
+    CellOrder order = CellOrder::ROW_MAJOR, SitePermutation* perm = nullptr);
 
 /** Assign species by fraction (e.g., frac1=0.25 means 25% of sites = 1). */
-void assign_species_by_fraction(int N, double frac1,
+void assign_species_by_fraction(SiteIndex N, double frac1,
     std::vector<uint8_t>& species, uint32_t shuffle_seed=0);
 
+/** Species-partitioned site order: all Fe sites, then all Gd sites, each
+ *  group in its current order. Permutes species (now n_Fe zeros followed by
+ *  ones) and the neighbor table in place: entries are moved to their new
+ *  rows and renumbered. perm is composed with the new order. */
+void partition_sites_by_species(std::vector<uint8_t>& species,
+    std::vector<std::array<int,constants::FCC_NN_COUNT>>& nearest_neighbors,
+    SitePermutation& perm);
+
+/** Per-site array in row-major lattice order, e.g. for site-resolved
+ *  outputs. Returned as is for the identity permutation. */
+template <typename T>
+std::vector<T> to_lattice_order(const SitePermutation& perm,
+    const std::vector<T>& per_site)
+{
+    if (perm.is_identity()) return per_site;
+    std::vector<T> out(per_site.size());
+    #pragma omp parallel for schedule(static)
+    for (size_t s = 0; s < per_site.size(); ++s)
+        out[perm.to_lattice[s]] = per_site[s];
+    return out;
+}
+
+/** Inverse of to_lattice_order: row-major per-site array to storage order. */
+template <typename T>
+std::vector<T> to_site_order(const SitePermutation& perm,
+    const std::vector<T>& per_lattice_site)
+{
+    if (perm.is_identity()) return per_lattice_site;
+    std::vector<T> out(per_lattice_site.size());
+    #pragma omp parallel for schedule(static)
+    for (size_t s = 0; s < per_lattice_site.size(); ++s)
+        out[s] = per_lattice_site[perm.to_lattice[s]];
+    return out;
+}
+
 #endif //LATTICE_H
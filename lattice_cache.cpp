@@ -0,0 +1,202 @@
+#include "lattice_cache.h"
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    constexpr char MAGIC[8] = {'G', 'D', 'F', 'E', 'L', 'A', 'T', '\0'};
+    constexpr uint32_t VERSION = 1;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t header_bytes;
+        int32_t nx, ny, nz;
+        uint32_t seed;
+        double frac_Gd;
+        int32_t cell_order, site_order;
+        int64_t n_sites;
+        int64_t n_Fe;        // SitePermutation::n_Fe
+        int64_t perm_sites;  // 0 (row-major order) or n_sites
+        uint64_t table_offset, species_offset;
+        uint64_t to_lattice_offset, to_site_offset;
+        uint64_t file_bytes;
+        uint64_t checksum;   // of the sections, see checksum()
+    };
+
+    using binary_file::align_up;
+
+    /// Header with the section layout of n_sites sites (checksum not set).
+    Header layout(const lattice_cache::Key& key, const int64_t n_sites,
+        const int64_t perm_sites, const int64_t n_Fe)
+    {
+        Header h{};
+        std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+        h.version = VERSION;
+        h.header_bytes = sizeof(Header);
+        h.nx = key.nx; h.ny = key.ny; h.nz = key.nz;
+        h.seed = key.seed;
+        h.frac_Gd = key.frac_Gd;
+        h.cell_order = static_cast<int32_t>(key.cell_order);
+        h.site_order = static_cast<int32_t>(key.site_order);
+        h.n_sites = n_sites;
+        h.n_Fe = n_Fe;
+        h.perm_sites = perm_sites;
+        const uint64_t n = static_cast<uint64_t>(n_sites);
+        h.table_offset = align_up(sizeof(Header));
+        h.species_offset = align_up(h.table_offset +
+            n*sizeof(FccNeighbors::List));
+        h.to_lattice_offset = align_up(h.species_offset + n);
+        h.to_site_offset = align_up(h.to_lattice_offset +
+            static_cast<uint64_t>(h.perm_sites)*sizeof(int));
+        h.file_bytes = h.to_site_offset +
+            static_cast<uint64_t>(h.perm_sites)*sizeof(int);
+        return h;
+    }
+
+    uint64_t checksum(std::span<const FccNeighbors::List> table,
+        std::span<const uint8_t> species, std::span<const int> to_lattice,
+        std::span<const int> to_site)
+    {
+        const auto bytes = [](const auto s) {
+            return binary_file::hash(s.data(), s.size_bytes());
+        };
+        uint64_t h = bytes(table);
+        h = binary_file::hash_combine(h, bytes(species));
+        h = binary_file::hash_combine(h, bytes(to_lattice));
+        h = binary_file::hash_combine(h, bytes(to_site));
+        return h;
+    }
+
+    const char* order_name(const CellOrder order) {
+        switch (order) {
+            case CellOrder::MORTON:  return "morton";
+            case CellOrder::HILBERT: return "hilbert";
+            default:                 return "row";
+        }
+    }
+}
+
+namespace lattice_cache {
+    std::string path_for(const std::string& dir, const Key& key) {
+        // Shortest text that round-trips the double, so the name is exact.
+        char frac[32];
+        const auto res = std::to_chars(frac, frac + sizeof(frac), key.frac_Gd);
+        const std::string name = "fcc_" + std::to_string(key.nx) + "x" +
+            std::to_string(key.ny) + "x" + std::to_string(key.nz) + "_Gd" +
+            std::string(frac, res.ptr) + "_seed" + std::to_string(key.seed) +
+            "_" + order_name(key.cell_order) +
+            (key.site_order == SiteOrder::SPECIES ? "_species" : "_lattice") +
+            ".lat";
+        return (std::filesystem::path(dir) / name).string();
+    }
+
+    void write(const std::string& path, const Key& key,
+        std::span<const FccNeighbors::List> table,
+        std::span<const uint8_t> species, const SitePermutation& perm)
+    {
+        if (species.size() != table.size() || (!perm.is_identity() &&
+            (perm.to_lattice.size() != table.size() ||
+             perm.to_site.size() != table.size()))) {
+            throw std::runtime_error(
+                "lattice_cache:write: table, species and order sizes differ");
+        }
+        const int64_t n_sites = static_cast<int64_t>(table.size());
+        Header h = layout(key, n_sites, perm.is_identity() ? 0 : n_sites,
+            perm.n_Fe);
+        h.checksum = checksum(table, species, perm.to_lattice, perm.to_site);
+
+        const binary_file::Section sections[] = {
+            {0, &h, sizeof(h)},
+            {h.table_offset, table.data(), table.size_bytes()},
+            {h.species_offset, species.data(), species.size_bytes()},
+            {h.to_lattice_offset, perm.to_lattice.data(),
+                perm.to_lattice.size()*sizeof(int)},
+            {h.to_site_offset, perm.to_site.data(),
+                perm.to_site.size()*sizeof(int)}};
+        binary_file::write_atomic(path, sections, h.file_bytes,
+            "lattice_cache:write");
+    }
+
+    Mapping::Mapping(const std::string& path, const Key& key)
+        : file_(path)
+    {
+        if (!file_.valid()) { reason_ = "no cache file"; return; }
+        if (file_.size() < sizeof(Header)) {
+            file_.reset();
+            reason_ = "truncated header";
+            return;
+        }
+        Header h;
+        std::memcpy(&h, file_.data(), sizeof(h));
+        const int64_t n_sites = count_fcc_sites(key.nx, key.ny, key.nz);
+        const bool key_ok = h.nx == key.nx && h.ny == key.ny &&
+            h.nz == key.nz && h.seed == key.seed && h.frac_Gd == key.frac_Gd &&
+            h.cell_order == static_cast<int32_t>(key.cell_order) &&
+            h.site_order == static_cast<int32_t>(key.site_order);
+        if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            h.version != VERSION || h.header_bytes != sizeof(Header)) {
+            reason_ = "unknown format or version";
+        }
+        else if (!key_ok || h.n_sites != n_sites) {
+            reason_ = "different lattice";
+        }
+        else {
+            // Offsets must be exactly the layout of this key, so every
+            // section lies inside the file.
+            const Header expect = layout(key, n_sites, h.perm_sites, h.n_Fe);
+            if ((h.perm_sites != 0 && h.perm_sites != n_sites) ||
+                h.table_offset != expect.table_offset ||
+                h.species_offset != expect.species_offset ||
+                h.to_lattice_offset != expect.to_lattice_offset ||
+                h.to_site_offset != expect.to_site_offset ||
+                h.file_bytes != expect.file_bytes ||
+                h.file_bytes != file_.size()) {
+                reason_ = "corrupt layout";
+            }
+            else if (checksum(table(), species(),
+                perm_section(h.to_lattice_offset),
+                perm_section(h.to_site_offset)) != h.checksum) {
+                reason_ = "checksum mismatch";
+            }
+        }
+        if (!reason_.empty()) file_.reset();
+    }
+
+    std::span<const FccNeighbors::List> Mapping::table() const {
+        if (!valid()) return {};
+        Header h;
+        std::memcpy(&h, file_.data(), sizeof(h));
+        return {reinterpret_cast<const FccNeighbors::List*>(
+            file_.data() + h.table_offset), static_cast<std::size_t>(h.n_sites)};
+    }
+
+    std::span<const uint8_t> Mapping::species() const {
+        if (!valid()) return {};
+        Header h;
+        std::memcpy(&h, file_.data(), sizeof(h));
+        return {file_.data() + h.species_offset, static_cast<std::size_t>(h.n_sites)};
+    }
+
+    std::span<const int> Mapping::perm_section(const uint64_t offset) const {
+        Header h;
+        std::memcpy(&h, file_.data(), sizeof(h));
+        return {reinterpret_cast<const int*>(file_.data() + offset),
+            static_cast<std::size_t>(h.perm_sites)};
+    }
+
+    SitePermutation Mapping::permutation() const {
+        SitePermutation perm;
+        if (!valid()) return perm;
+        Header h;
+        std::memcpy(&h, file_.data(), sizeof(h));
+        const std::span<const int> to_lattice = perm_section(h.to_lattice_offset);
+        const std::span<const int> to_site = perm_section(h.to_site_offset);
+        perm.to_lattice.assign(to_lattice.begin(), to_lattice.end());
+        perm.to_site.assign(to_site.begin(), to_site.end());
+        perm.n_Fe = static_cast<int>(h.n_Fe);
+        return perm;
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef LATTICE_CACHE_H
+#define LATTICE_CACHE_H
+#include <cstdint>
+#include <span>
+#include <string>
+#include "binary_file.h"
+#include "lattice.h"
+#include "params.h"
+
+/// On-disk cache of the setup of one lattice: neighbor table, species and
+/// site order, as built for (nx, ny, nz, frac_Gd, seed, cell_order,
+/// site_order). The file is a fixed header (magic, version, key, N, n_Fe,
+/// section offsets, checksum) followed by page-aligned sections: table
+/// (N x 12 int32), species (N bytes), to_lattice and to_site (N int32 each,
+/// absent for the row-major order). Native byte order; a file from another
+/// version or key is rejected by its header. Reloads map the file read-only
+/// and shared, so concurrent runs of one lattice share its page cache pages
+/// instead of each building and holding a copy.
+namespace lattice_cache {
+    struct Key {
+        int nx{0}, ny{0}, nz{0};
+        double frac_Gd{0.0};
+        uint32_t seed{0};
+        CellOrder cell_order{CellOrder::ROW_MAJOR};
+        SiteOrder site_order{SiteOrder::LATTICE};
+    };
+
+    /// Cache file of key in dir, e.g. dir/fcc_32x32x32_Gd0.25_seed7_row_lattice.lat
+    std::string path_for(const std::string& dir, const Key& key);
+
+    /// Write the cache file atomically (temporary file, then rename), so a
+    /// concurrent reader sees either the old file or the complete new one.
+    /// Throws std::runtime_error.
+    void write(const std::string& path, const Key& key,
+        std::span<const FccNeighbors::List> table,
+        std::span<const uint8_t> species, const SitePermutation& perm);
+
+    /// Read-only shared mapping of a cache file.
+    class Mapping {
+    public:
+        Mapping() = default;
+        /// Maps path and checks header and checksum against key; on any
+        /// mismatch (or a missing file) the mapping is empty and reason()
+        /// says why.
+        Mapping(const std::string& path, const Key& key);
+
+        bool valid() const { return file_.valid(); }
+        const std::string& reason() const { return reason_; }
+
+        std::span<const FccNeighbors::List> table() const;
+        std::span<const uint8_t> species() const;
+        /// Stored site order (identity for the row-major lattice order).
+        SitePermutation permutation() const;
+
+    private:
+        std::span<const int> perm_section(uint64_t offset) const;
+
+        binary_file::Mapping file_;
+        std::string reason_;
+    };
+}
+
+#endif //LATTICE_CACHE_H
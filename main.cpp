@@ -1,136 +1,995 @@
 #include "params.h"
+#include "bulk_series.h"
+#include "checkpoint.h"
+#include "ensemble.h"
 #include "fields.h"
 #include "init.h"
 #include "integrator.h"
 #include "io.h"
 #include "io_temperature_csv.h"
+#include "kernels_avx2.h"
 #include "lattice.h"
+#include "lattice_cache.h"
+#include "monte_carlo.h"
+#include "parallel_utils.h"
+#include "precision.h"
 #include "reductions.h"
 #include "rng.h"
+#include "save_cadence.h"
+#include "shutdown.h"
+#include "step_control.h"
+#include "sweep.h"
+#include "site_memory.h"
+#include "snapshot.h"
 #include "test.h"
+#include "topology.h"
+#include "workspace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <filesystem>
+#include <iomanip>
+#include <memory>
 #include <iostream>
+#include <sstream>
+#include <thread>
 namespace fs = std::filesystem;
 
-int main() {
-    // 1. Read input parameters ------------------------------------------------
-    ControlParams control{};
-    LatParams lat{};
-    MatParams mat[2]{};
+namespace {
+    /// Bulk values of one saved step, with its step and temperature.
+    struct TraceRow {
+        int time_step;
+        double T_kelvin;
+        BulkValues bulk;
+    };
+
+    /// Steps, start state, noise and outputs of one run of the time loop.
+    struct LoopRun {
+        int last_step{0};             // runs steps start .. last_step
+        /// State to resume from (checked against the input by the caller);
+        /// null = initial magnetization at step 0.
+        const checkpoint::Reader* start{nullptr};
+        /// Noise stream: 0 = the run's own (MT19937 state carried over from
+        /// start), k > 0 = independent stream k from the start step on.
+        uint32_t stream{0};
+        std::string out_csv;          // bulk series (skipped if empty)
+        std::string snapshot_path;    // every snapshot_steps (empty = off)
+        std::vector<TraceRow>* trace{nullptr};
+        std::string checkpoint_path;  // every checkpoint_steps (empty = off)
+        std::string final_checkpoint; // state after last_step (empty = none)
+        std::string label;            // prefix of the progress lines
+    };
+
+    /// Allocate the per-site arrays in precision P and run the Heun time loop
+    /// as described by run. The bulk values of each saved step are appended
+    /// to run.out_csv and to run.trace.
+    template <typename P>
+    void run_time_loop(const ControlParams& control, const LatParams& lat,
+        const MatParams mat[2], const FccNeighbors& neighbors,
+        const std::vector<uint8_t>& species, const SitePermutation* perm,
+        const std::vector<double>& Te_kelvin_arr, const LoopRun& run)
+    {
+        using Real = typename P::real;
+        const checkpoint::Reader* restart = run.start;
+
+        // 4. Allocate & initialize other arrays ------------------------------
+        const int row_sites = lat.nz * constants::FCC_BASIS_COUNT;
+        HeunWorkspace<Real> ws(lat.N, row_sites);
+        double Hx_appl_tesla=lat.Hx_appl_tesla;
+        double Hy_appl_tesla=lat.Hy_appl_tesla;
+        double Hz_appl_tesla=lat.Hz_appl_tesla;
+        RNG rng(control.seed);
+        const CounterRNG counter_rng(control.seed, run.stream);
+        const std::span<Real> state[checkpoint::N_ARRAYS] = {
+            ws.mx, ws.my, ws.mz, ws.mx_mid, ws.my_mid, ws.mz_mid};
+
+        SaveCadence cadence(control, Te_kelvin_arr);
+        StepControl stepper(control, Te_kelvin_arr);
+        int first_step = 0;
+        if (restart) {
+            // m and m_mid both carry state (the corrector renormalizes m_mid
+            // in Acc), so both come back from the file, copied straight out
+            // of the mapping.
+            for (int k = 0; k < checkpoint::N_ARRAYS; ++k) {
+                site_memory::first_touch(state[k].data(), state[k].size(),
+                    static_cast<std::size_t>(row_sites), Real(0),
+                    restart->array<Real>(k).data());
+            }
+            if (control.rng_kind == RngKind::MT19937 && run.stream == 0) {
+                std::istringstream mt{std::string(restart->mt_state())};
+                mt >> rng.gen;
+            }
+            first_step = restart->next_step();
+            cadence.restore(restart->cadence());
+            stepper.restore(restart->steps());
+        }
+        else {
+            initialize_m(species.data(), lat.N,
+                ws.mx.data(), ws.my.data(), ws.mz.data(),
+                lat.mx_init_Fe, lat.my_init_Fe, lat.mz_init_Fe,
+                lat.mx_init_Gd, lat.my_init_Gd, lat.mz_init_Gd);
+            // Monte Carlo equilibration at pre_Te_kelvin replaces the LLG
+            // pre-steps: the time loop starts from its state at pre_steps.
+            if (control.pre_mc_sweeps > 0) {
+                monte_carlo::Metropolis mc(mat, lat.J_joule_per_link,
+                    neighbors, species, perm,
+                    Hx_appl_tesla, Hy_appl_tesla, Hz_appl_tesla,
+                    control.pre_Te_kelvin,
+                    CounterRNG(control.seed, monte_carlo::STREAM));
+                monte_carlo::SweepStats stats{};
+                for (int n = 0; n < control.pre_mc_sweeps; ++n) {
+                    stats = mc.sweep<Real>(ws.mx, ws.my, ws.mz);
+                }
+                std::cout << run.label << "Monte Carlo = "
+                          << control.pre_mc_sweeps << " sweeps at "
+                          << control.pre_Te_kelvin << " K, last acceptance Fe "
+                          << stats.acceptance[0] << " (cone " << stats.sigma[0]
+                          << "), Gd " << stats.acceptance[1] << " (cone "
+                          << stats.sigma[1] << ")\n";
+                first_step = control.pre_steps;
+                // Fixed steps keep the Philox counter equal to the step.
+                stepper.restore({stepper.state().h,
+                    static_cast<int64_t>(first_step)});
+            }
+            // m_mid = normalize(m) feeds the first predictor; afterwards the
+            // corrector keeps it up to date.
+            advance_and_normalize_m<P>(ws.mx, ws.my, ws.mz,
+                ws.mx_mid, ws.my_mid, ws.mz_mid,
+                ws.dmx_dt_st1, ws.dmy_dt_st1, ws.dmz_dt_st1, 0.0);
+        }
+        if (control.rng_kind == RngKind::MT19937 && run.stream != 0) {
+            std::seed_seq seq{control.seed, run.stream};
+            rng.gen.seed(seq);
+        }
+        const int last_step = run.last_step;
+        std::vector<TraceRow>* trace = run.trace;
+        // Rows are formatted into a buffer and written in the background.
+        std::unique_ptr<BulkSeriesWriter> out_csv;
+        if (!run.out_csv.empty()) {
+            out_csv = std::make_unique<BulkSeriesWriter>(run.out_csv,
+                control.bulk_format);
+        }
+        std::unique_ptr<snapshot::Writer> snapshots;
+        if (!run.snapshot_path.empty() && control.snapshot_steps > 0) {
+            snapshots = std::make_unique<snapshot::Writer>(run.snapshot_path,
+                lat.nx, lat.ny, lat.nz, species, perm,
+                control.snapshot_keyframe, row_sites);
+        }
+        std::unique_ptr<checkpoint::Writer<Real>> writer;
+        if (!run.checkpoint_path.empty() && control.checkpoint_steps > 0) {
+            writer = std::make_unique<checkpoint::Writer<Real>>(
+                run.checkpoint_path, lat.N, row_sites);
+        }
+        // State before step next_step, copied now and written by w's thread.
+        const auto save_checkpoint = [&](checkpoint::Writer<Real>& w,
+            const int next_step)
+        {
+            const std::span<const Real> m[checkpoint::N_ARRAYS] = {
+                state[0], state[1], state[2], state[3], state[4], state[5]};
+            w.submit(next_step, checkpoint::input_hash(control, lat, mat,
+                Te_kelvin_arr, next_step, precision_name<P>()),
+                control.rng_kind, rng, m, cadence.state(), stepper.state());
+        };
+        // Whole positions an adaptive step lands on: the next output,
+        // snapshot or checkpoint step, the end of the pre-steps or of the
+        // run. A stop signal waits for the next one, so a restart takes the
+        // same steps as an uninterrupted run.
+        const int end_step = last_step + 1;
+        const auto next_event = [&](const double s) {
+            const int k = static_cast<int>(std::floor(s)) + 1;
+            int event = end_step;
+            const auto upto_multiple = [&](const int every) {
+                if (every > 0) {
+                    event = std::min(event, (k + every - 1) / every * every);
+                }
+            };
+            upto_multiple(control.save_steps);
+            upto_multiple(control.save_steps_fast);
+            if (snapshots) upto_multiple(control.snapshot_steps);
+            if (writer) upto_multiple(control.checkpoint_steps);
+            if (k <= control.pre_steps) event = std::min(event, control.pre_steps);
+            return event;
+        };
+        bool stopped = false;
+        // Position in units of dt_sec; fixed steps advance it by 1, adaptive
+        // ones land on whole positions where step outputs are due.
+        double s = first_step;
+        while (s < end_step)
+        {
+            const int curr_step = static_cast<int>(s);
+            const bool whole = s == curr_step;
+            const int event = next_event(s);
+            const double h = stepper.next(s, event);
+            const double dt_sec = h * control.dt_sec;
+            // Set temperature
+            const double T_kelvin = stepper.T_kelvin(s);
+            if (control.rng_kind == RngKind::PHILOX) {
+                compute_ther_field_counter<P>(mat, species, T_kelvin,
+                    dt_sec, counter_rng,
+                    static_cast<uint64_t>(stepper.state().taken),
+                    ws.Hx_ther_tesla, ws.Hy_ther_tesla, ws.Hz_ther_tesla,
+                    perm);
+            }
+            else {
+                compute_ther_field_once<P>(mat, species, T_kelvin,
+                    dt_sec, rng,
+                    ws.Hx_ther_tesla, ws.Hy_ther_tesla, ws.Hz_ther_tesla,
+                    perm);
+            }
+
+            // Stage 1 (predictor). Depondt-Mertens keeps its rotation vector
+            // in the dm/dt_st1 arrays.
+            if (control.integrator == Integrator::DEPONDT) {
+                depondt_predictor_fused<P>(mat, lat.J_joule_per_link,
+                    neighbors, species,
+                    ws.mx, ws.my, ws.mz,
+                    ws.mx_mid, ws.my_mid, ws.mz_mid,
+                    Hx_appl_tesla, Hy_appl_tesla, Hz_appl_tesla,
+                    ws.Hx_ther_tesla, ws.Hy_ther_tesla, ws.Hz_ther_tesla,
+                    dt_sec,
+                    ws.dmx_dt_st1, ws.dmy_dt_st1, ws.dmz_dt_st1,
+                    ws.mx_pred, ws.my_pred, ws.mz_pred);
+            }
+            else {
+                heun_predictor_fused<P>(mat, lat.J_joule_per_link, neighbors,
+                    species,
+                    ws.mx, ws.my, ws.mz,
+                    ws.mx_mid, ws.my_mid, ws.mz_mid,
+                    Hx_appl_tesla, Hy_appl_tesla, Hz_appl_tesla,
+                    ws.Hx_ther_tesla, ws.Hy_ther_tesla, ws.Hz_ther_tesla,
+                    dt_sec,
+                    ws.dmx_dt_st1, ws.dmy_dt_st1, ws.dmz_dt_st1,
+                    ws.mx_pred, ws.my_pred, ws.mz_pred);
+            }
+
+            // Reductions & outputs. The per-term fields of m_mid are reduced
+            // block by block instead of being stored by the predictor. With
+            // the adaptive cadence the bulk m of every probe step decides
+            // whether its row is written.
+            if (whole && cadence.probe_due(curr_step)) {
+                BulkValues bulk_vals{};
+                compute_bulk_m<Real>(species, ws.mx, ws.my, ws.mz, bulk_vals,
+                    perm);
+                if (cadence.save(curr_step, bulk_vals)) {
+                    if (trace) {
+                        trace->push_back({curr_step, T_kelvin, bulk_vals});
+                    }
+                    if (out_csv) {
+                        BulkFields bulk_fields{};
+                        compute_bulk_fields_from_m<P>(mat,
+                            lat.J_joule_per_link, neighbors, species,
+                            ws.mx_mid, ws.my_mid, ws.mz_mid,
+                            ws.Hx_ther_tesla, ws.Hy_ther_tesla,
+                            ws.Hz_ther_tesla, bulk_fields, perm);
+                        out_csv->append(curr_step, T_kelvin, bulk_vals,
+                            bulk_fields);
+                    }
+                }
+            }
+
+            // Spin snapshot of m at this step: quantized here, compressed and
+            // written in the background.
+            if (snapshots && whole && curr_step % control.snapshot_steps == 0) {
+                snapshots->submit<Real>(curr_step, T_kelvin,
+                    ws.mx, ws.my, ws.mz);
+            }
+
+            // Stage 2 (corrector) and advance m; also refreshes m_mid ---------
+            if (control.integrator == Integrator::DEPONDT) {
+                depondt_corrector_fused<P>(mat, lat.J_joule_per_link,
+                    neighbors, species,
+                    ws.mx_pred, ws.my_pred, ws.mz_pred,
+                    Hx_appl_tesla, Hy_appl_tesla, Hz_appl_tesla,
+                    ws.Hx_ther_tesla, ws.Hy_ther_tesla, ws.Hz_ther_tesla,
+                    ws.dmx_dt_st1, ws.dmy_dt_st1, ws.dmz_dt_st1,
+                    dt_sec,
+                    ws.mx, ws.my, ws.mz,
+                    ws.mx_mid, ws.my_mid, ws.mz_mid);
+            }
+            else {
+                heun_corrector_fused<P>(mat, lat.J_joule_per_link, neighbors,
+                    species,
+                    ws.mx_pred, ws.my_pred, ws.mz_pred,
+                    Hx_appl_tesla, Hy_appl_tesla, Hz_appl_tesla,
+                    ws.Hx_ther_tesla, ws.Hy_ther_tesla, ws.Hz_ther_tesla,
+                    ws.dmx_dt_st1, ws.dmy_dt_st1, ws.dmz_dt_st1,
+                    dt_sec,
+                    ws.mx, ws.my, ws.mz,
+                    ws.mx_mid, ws.my_mid, ws.mz_mid);
+            }
+
+            // The local error of the step sets the next adaptive one.
+            stepper.accept(h, stepper.adaptive() ? max_distance<Real>(
+                ws.mx, ws.my, ws.mz, ws.mx_pred, ws.my_pred, ws.mz_pred) : 0.0);
+            s = (s + h >= event - 1e-9) ? event : s + h;
+
+            const int shown = (curr_step + control.show_steps - (whole ? 1 : 0))
+                / control.show_steps * control.show_steps;
+            if (shown < s) {
+                std::cout << (run.label + std::to_string(shown) + "\n")
+                          << std::flush;
+            }
+
+            // Periodic checkpoint, and one on a stop signal so that
+            // --restart continues from here; the writers flush on return.
+            const int next_step = static_cast<int>(s);
+            if (s != next_step) continue;
+            const bool stop = shutdown::requested() != 0;
+            if (writer && next_step < end_step && (stop ||
+                next_step % control.checkpoint_steps == 0)) {
+                save_checkpoint(*writer, next_step);
+            }
+            if (stop && next_step < end_step) {
+                std::cout << run.label << "stopped by signal "
+                          << shutdown::requested() << " after step "
+                          << next_step - 1 << std::endl;
+                stopped = true;
+                break;
+            }
+        }
+        if (stepper.adaptive()) {
+            std::cout << run.label << "Adaptive steps = "
+                      << stepper.state().taken << " (fixed dt_sec: "
+                      << end_step << ")\n";
+        }
+
+        if (!run.final_checkpoint.empty() && !stopped) {
+            checkpoint::Writer<Real> final_writer(run.final_checkpoint, lat.N,
+                row_sites);
+            save_checkpoint(final_writer, last_step + 1);
+        }
+    }
+
+    /// File name of the bulk time series in a run directory.
+    std::string bulk_file_name(const ControlParams& control) {
+        return control.bulk_format == BulkFormat::BINARY ?
+            "bulk_values_vs_time.bin" : "bulk_values_vs_time.csv";
+    }
+
+    /// Whether checkpoint c was written by this input at step next_step: same
+    /// lattice size, precision, RNG, parameters and temperatures before it.
+    bool written_by_input(const checkpoint::Reader& c,
+        const ControlParams& control, const LatParams& lat,
+        const MatParams mat[2], const std::vector<double>& Te_kelvin_arr,
+        const int next_step)
+    {
+        return c.n_sites() == lat.N &&
+            c.real_bytes() == sizeof(PrecSim::real) &&
+            c.rng_kind() == control.rng_kind && c.next_step() == next_step &&
+            c.input_hash() == checkpoint::input_hash(control, lat, mat,
+                Te_kelvin_arr, next_step, precision_name<PrecSim>());
+    }
+
+    /// Equilibrate once, fork many: the pre-steps at pre_Te_kelvin do not
+    /// depend on the Te file, so they run once (not at all if equilibrated
+    /// already holds their end state for this input) and the run phase of
+    /// every file in control.fork_Te_filepaths starts from that state, with
+    /// noise stream k + 1 for file k. fork_jobs phases run at once, each
+    /// with an equal share of the threads, and write
+    /// run_dir/<file stem>/bulk_values_vs_time.csv (or .bin).
+    void run_forks(const ControlParams& control, const LatParams& lat,
+        const MatParams mat[2], const FccNeighbors& neighbors,
+        const std::vector<uint8_t>& species, const SitePermutation* perm,
+        const fs::path& run_dir)
+    {
+        const std::vector<std::string>& files = control.fork_Te_filepaths;
+        std::vector<fs::path> out_dirs;
+        for (const std::string& f : files) {
+            const fs::path dir = run_dir / fs::path(f).stem();
+            if (std::find(out_dirs.begin(), out_dirs.end(), dir) !=
+                out_dirs.end()) {
+                throw std::runtime_error("fork_Te_files: two files named " +
+                    fs::path(f).stem().string());
+            }
+            out_dirs.push_back(dir);
+        }
+
+        const std::string eq_path = control.equilibrated_path.empty() ?
+            (run_dir / "equilibrated.bin").string() : control.equilibrated_path;
+        const std::vector<double> no_Te;
+        std::unique_ptr<checkpoint::Reader> eq;
+        try {
+            eq = std::make_unique<checkpoint::Reader>(eq_path);
+            if (!written_by_input(*eq, control, lat, mat, no_Te,
+                control.pre_steps)) {
+                eq.reset();
+            }
+        }
+        catch (const std::runtime_error&) {} // missing or damaged: rerun
+        std::cout << "Equilibrated = " << eq_path
+                  << (eq ? " (reused)" : " (running pre-steps)") << "\n";
+        if (!eq) {
+            LoopRun pre;
+            pre.last_step = control.pre_steps - 1;
+            pre.out_csv = (run_dir / bulk_file_name(control)).string();
+            pre.snapshot_path = (run_dir / "m_snapshots.bin").string();
+            pre.final_checkpoint = eq_path;
+            run_time_loop<PrecSim>(control, lat, mat, neighbors, species, perm,
+                no_Te, pre);
+            if (shutdown::requested()) return;
+            eq = std::make_unique<checkpoint::Reader>(eq_path);
+        }
+
+        const int n_forks = static_cast<int>(files.size());
+        const int n_threads = get_num_threads();
+        const int jobs = std::clamp(control.fork_jobs > 0 ?
+            control.fork_jobs : n_threads, 1, n_forks);
+        const int threads_per_job = std::max(1, n_threads / jobs);
+        std::cout << "Forks = " << n_forks << " run phases, " << jobs
+                  << " at a time with " << threads_per_job << " threads\n";
+
+        std::atomic<int> next_fork{0};
+        std::vector<std::exception_ptr> errors(jobs);
+        std::vector<std::thread> pool;
+        for (int j = 0; j < jobs; ++j) {
+            pool.emplace_back([&, j] {
+                try {
+                    set_num_threads(threads_per_job);
+                    for (int k; !shutdown::requested() &&
+                        (k = next_fork++) < n_forks;) {
+                        std::vector<double> Te_kelvin_arr;
+                        read_temperature_series_csv(files[k], Te_kelvin_arr);
+                        if (static_cast<int>(Te_kelvin_arr.size()) <
+                            control.run_steps) {
+                            throw std::runtime_error("Temperature data not "
+                                "enough in " + files[k] + " (" +
+                                std::to_string(control.run_steps) +
+                                " required)");
+                        }
+                        LoopRun run;
+                        run.last_step = control.pre_steps + control.run_steps;
+                        run.start = eq.get();
+                        run.stream = static_cast<uint32_t>(k + 1);
+                        run.out_csv =
+                            (out_dirs[k] / bulk_file_name(control)).string();
+                        run.snapshot_path =
+                            (out_dirs[k] / "m_snapshots.bin").string();
+                        run.label = out_dirs[k].filename().string() + ": ";
+                        run_time_loop<PrecSim>(control, lat, mat, neighbors,
+                            species, perm, Te_kelvin_arr, run);
+                    }
+                }
+                catch (...) {
+                    errors[j] = std::current_exception();
+                }
+            });
+        }
+        for (std::thread& t : pool) t.join();
+        for (const std::exception_ptr& e : errors) {
+            if (e) std::rethrow_exception(e);
+        }
+    }
+
+    /// control.replicas replicas of the run in one time loop (ensemble.h):
+    /// replica r writes run_dir/replica_<r>/bulk_values_vs_time.csv (or .bin)
+    /// and the mean and variance over the replicas of every saved step go to
+    /// run_dir/ensemble_mean.csv.
+    template <typename P>
+    void run_ensemble(const ControlParams& control, const LatParams& lat,
+        const MatParams mat[2], const FccNeighbors& neighbors,
+        const std::vector<uint8_t>& species, const SitePermutation* perm,
+        const std::vector<double>& Te_kelvin_arr, const fs::path& run_dir)
+    {
+        using Real = typename P::real;
+        const int R = control.replicas;
+        const SiteIndex N = lat.N;
+
+        // Species of each replica in site order, and interleaved.
+        std::vector<std::vector<uint8_t>> species_of(R, species);
+        if (control.replica_species == ReplicaSpecies::INDEPENDENT) {
+            for (int r = 1; r < R; ++r) {
+                std::vector<uint8_t> s;
+                assign_species_by_fraction(N, lat.frac_Gd, s,
+                    control.seed + static_cast<uint32_t>(r));
+                species_of[r] = perm ? to_site_order(*perm, s) : s;
+            }
+        }
+        std::vector<uint8_t> species_R(static_cast<std::size_t>(N) * R);
+        for (int r = 0; r < R; ++r) {
+            for (SiteIndex i = 0; i < N; ++i) species_R[i*R + r] = species_of[r][i];
+        }
+
+        const int row_sites = lat.nz * constants::FCC_BASIS_COUNT;
+        HeunWorkspace<Real> ws(N * R, row_sites * R);
+        initialize_m(species_R.data(), N * R,
+            ws.mx.data(), ws.my.data(), ws.mz.data(),
+            lat.mx_init_Fe, lat.my_init_Fe, lat.mz_init_Fe,
+            lat.mx_init_Gd, lat.my_init_Gd, lat.mz_init_Gd);
+        advance_and_normalize_m<P>(ws.mx, ws.my, ws.mz,
+            ws.mx_mid, ws.my_mid, ws.mz_mid,
+            ws.dmx_dt_st1, ws.dmy_dt_st1, ws.dmz_dt_st1, 0.0);
+
+        std::vector<std::unique_ptr<BulkSeriesWriter>> out(R);
+        for (int r = 0; r < R; ++r) {
+            out[r] = std::make_unique<BulkSeriesWriter>((run_dir /
+                ("replica_" + std::to_string(r)) / bulk_file_name(control))
+                .string(), control.bulk_format);
+        }
+        ensemble::MomentsWriter moments_csv(
+            (run_dir / "ensemble_mean.csv").string());
+        // One replica's m_mid, m and thermal field at a time, in site order.
+        std::vector<Real> buf(static_cast<std::size_t>(N) * 9);
+        const std::span<Real> one(buf);
+        const auto part = [&](const int q) { return one.subspan(q * N, N); };
+        const auto cpart = [&](const int q) {
+            return std::span<const Real>(part(q));
+        };
+
+        const StepControl temperature(control, Te_kelvin_arr);
+        const int last_step = control.pre_steps + control.run_steps;
+        std::cout << "Ensemble = " << R << " replicas ("
+                  << (control.replica_species == ReplicaSpecies::SHARED ?
+                      "shared" : "independent") << " species)\n";
+        for (int curr_step = 0; curr_step <= last_step; ++curr_step) {
+            const double T_kelvin = temperature.T_kelvin(curr_step);
+            ensemble::ther_field<P>(mat, species_R, R, T_kelvin,
+                control.dt_sec, control.seed,
+                static_cast<uint64_t>(curr_step),
+                ws.Hx_ther_tesla, ws.Hy_ther_tesla, ws.Hz_ther_tesla, perm);
+
+            ensemble::heun_predictor<P>(mat, lat.J_joule_per_link, neighbors,
+                species_R, R,
+                ws.mx, ws.my, ws.mz,
+                ws.mx_mid, ws.my_mid, ws.mz_mid,
+                lat.Hx_appl_tesla, lat.Hy_appl_tesla, lat.Hz_appl_tesla,
+                ws.Hx_ther_tesla, ws.Hy_ther_tesla, ws.Hz_ther_tesla,
+                control.dt_sec,
+                ws.dmx_dt_st1, ws.dmy_dt_st1, ws.dmz_dt_st1,
+                ws.mx_pred, ws.my_pred, ws.mz_pred);
+
+            if (curr_step % control.save_steps == 0) {
+                ensemble::Moments moments;
+                for (int r = 0; r < R; ++r) {
+                    const std::span<const Real> src[9] = {ws.mx, ws.my, ws.mz,
+                        ws.mx_mid, ws.my_mid, ws.mz_mid, ws.Hx_ther_tesla,
+                        ws.Hy_ther_tesla, ws.Hz_ther_tesla};
+                    for (int q = 0; q < 9; ++q) {
+                        ensemble::gather<Real>(src[q], R, r, part(q));
+                    }
+                    BulkValues bulk_vals{};
+                    compute_bulk_m<Real>(species_of[r], cpart(0), cpart(1),
+                        cpart(2), bulk_vals, perm);
+                    BulkFields bulk_fields{};
+                    compute_bulk_fields_from_m<P>(mat, lat.J_joule_per_link,
+                        neighbors, species_of[r], cpart(3), cpart(4), cpart(5),
+                        cpart(6), cpart(7), cpart(8), bulk_fields, perm);
+                    out[r]->append(curr_step, T_kelvin, bulk_vals,
+                        bulk_fields);
+                    moments.add(bulk_vals);
+                }
+                moments_csv.append(curr_step, T_kelvin, moments);
+            }
+
+            ensemble::heun_corrector<P>(mat, lat.J_joule_per_link, neighbors,
+                species_R, R,
+                ws.mx_pred, ws.my_pred, ws.mz_pred,
+                lat.Hx_appl_tesla, lat.Hy_appl_tesla, lat.Hz_appl_tesla,
+                ws.Hx_ther_tesla, ws.Hy_ther_tesla, ws.Hz_ther_tesla,
+                ws.dmx_dt_st1, ws.dmy_dt_st1, ws.dmz_dt_st1,
+                control.dt_sec,
+                ws.mx, ws.my, ws.mz,
+                ws.mx_mid, ws.my_mid, ws.mz_mid);
+
+            if (curr_step % control.show_steps == 0) {
+                std::cout << (std::to_string(curr_step) + "\n") << std::flush;
+            }
+            if (const int sig = shutdown::requested()) {
+                std::cout << "stopped by signal " << sig << " after step "
+                          << curr_step << std::endl;
+                break;
+            }
+        }
+    }
+
+    /// Bytes of the per-site data that live for the whole run.
+    void print_footprint(const SiteIndex N, const std::size_t workspace_bytes,
+        const std::size_t species_bytes, const std::size_t neighbor_bytes,
+        const std::size_t perm_bytes)
+    {
+        const std::size_t total = workspace_bytes + species_bytes +
+            neighbor_bytes + perm_bytes;
+        const auto per_site = [N](const std::size_t bytes) {
+            return static_cast<double>(bytes) /
+                static_cast<double>(std::max<SiteIndex>(N, 1));
+        };
+        std::cout << "Memory = " << static_cast<double>(total) / (1 << 20)
+                  << " MiB, " << per_site(total) << " bytes/site (state "
+                  << per_site(workspace_bytes) << ", species "
+                  << per_site(species_bytes) << ", neighbors "
+                  << per_site(neighbor_bytes) << ", order "
+                  << per_site(perm_bytes) << ")\n";
+    }
+
+    double distance(const double ax, const double ay, const double az,
+        const double bx, const double by, const double bz)
+    {
+        return std::sqrt((ax-bx)*(ax-bx) + (ay-by)*(ay-by) + (az-bz)*(az-bz));
+    }
+
+    /// One run of the input: build (or map) the lattice, then the time loop,
+    /// the forks or the ensemble writing to run_dir, then the precision
+    /// validation. geometry: the neighbor table of a sweep job shared with
+    /// the other jobs of its lattice size (null = build it here); label
+    /// prefixes the progress lines.
+    void run_job(const ControlParams& control, const LatParams& lat,
+        const MatParams mat[2], const fs::path& run_dir, const bool restart,
+        std::string restart_path, const sweep::Geometry* geometry,
+        const std::string& label)
+    {
+        // 2. Allocate lattice arrays -----------------------------------------
+        // std::vector<double> x_m, y_m, z_m; // site positions
+        std::vector<std::array<int, constants::FCC_NN_COUNT>> nearest_neighbors;
+        std::vector<uint8_t> species; // 0=Fe,1=Gd
+        species.reserve(lat.N);
+
+        // 3. Build lattice, assign species -----------------------------------
+        // The stencil mode needs no table: 48 bytes/site less. A cell curve order
+        // or the species order permute the sites; site_perm maps them back to the
+        // row-major lattice index (species, thermal noise and site-resolved
+        // outputs are defined on that index, so results do not depend on order).
+        FccNeighbors neighbors{};
+        SitePermutation site_perm{};
+        // With a lattice cache, a run of an already built lattice maps the stored
+        // table, species and order read-only instead of building them; the
+        // table's pages are shared with every other run mapping the same file.
+        const lattice_cache::Key cache_key{lat.nx, lat.ny, lat.nz, lat.frac_Gd,
+            control.seed, control.cell_order, control.site_order};
+        const std::string cache_path = control.lattice_cache_dir.empty() ? "" :
+            lattice_cache::path_for(control.lattice_cache_dir, cache_key);
+        lattice_cache::Mapping cached;
+        if (!cache_path.empty()) {
+            cached = lattice_cache::Mapping(cache_path, cache_key);
+            std::cout << "Lattice cache = " << cache_path << " ("
+                      << (cached.valid() ? "mapped" : "rebuild: " + cached.reason())
+                      << ")\n";
+        }
+        const int row_sites = lat.nz * constants::FCC_BASIS_COUNT;
+        site_memory::SiteArray<FccNeighbors::List> nn_table;
+        std::span<const FccNeighbors::List> table;
+        if (cached.valid()) {
+            species.assign(cached.species().begin(), cached.species().end());
+            site_perm = cached.permutation();
+            table = cached.table();
+        }
+        else {
+            if (control.exchange_mode == ExchangeMode::STENCIL) {
+                neighbors = FccNeighbors::stencil(lat.nx, lat.ny, lat.nz);
+            }
+            else if (geometry) {
+                site_perm = geometry->perm;
+            }
+            else {
+                build_fcc_nn(lat.nx, lat.ny, lat.nz, nearest_neighbors,
+                    control.cell_order, &site_perm);
+            }
+            assign_species_by_fraction(lat.N, lat.frac_Gd, species, control.seed);
+            species = to_site_order(site_perm, species);
+            // Species order: Fe sites first, then Gd, so the kernels run one
+            // branch-free loop per species.
+            if (control.site_order == SiteOrder::SPECIES) {
+                partition_sites_by_species(species, nearest_neighbors, site_perm);
+            }
+            if (!cache_path.empty()) {
+                try {
+                    lattice_cache::write(cache_path, cache_key, nearest_neighbors,
+                        species, site_perm);
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Warning: " << e.what() << "\n";
+                }
+            }
+            // The kernels read a first-touched copy of the table in site memory.
+            nn_table = site_memory::SiteArray<FccNeighbors::List>(
+                std::span<const FccNeighbors::List>(nearest_neighbors),
+                static_cast<std::size_t>(row_sites));
+            std::vector<FccNeighbors::List>().swap(nearest_neighbors);
+            table = geometry ? geometry->table.span() : nn_table.span();
+        }
+        if (control.exchange_mode == ExchangeMode::TABLE) {
+            neighbors = FccNeighbors::from_table(table,
+                lat.nx, lat.ny, lat.nz, site_perm.n_Fe);
+        }
+        const SitePermutation* perm = site_perm.is_identity() ? nullptr : &site_perm;
 
+        // 5. Read temperature series -----------------------------------------
+        std::vector<double> Te_kelvin_arr;
+        read_temperature_series_csv(control.Te_filepath, Te_kelvin_arr);
+        if (static_cast<int>(Te_kelvin_arr.size()) < control.run_steps) {
+            throw std::runtime_error("Temperature data not enough (" +
+                std::to_string(control.run_steps) + " required)");
+        }
+
+        // 6. Time evolve -----------------------------------------------------
+        // Binary topology (lattice order, 48 bytes/site, one streamed write);
+        // topology_to_text makes nearest_neighbors.txt and Gd_sites.txt from it.
+        if (control.write_topology) {
+            try {
+                topology::write((run_dir / "topology.bin").string(), neighbors,
+                    species, perm);
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Warning: " << e.what() << "\n";
+            }
+        }
+        count_atoms(species);
+        print_footprint(lat.N,
+            HeunWorkspace<PrecSim::real>::bytes_for(lat.N * control.replicas),
+            species.size() * sizeof(uint8_t),
+            table.size_bytes(),
+            (site_perm.to_lattice.size() + site_perm.to_site.size()) * sizeof(int));
+        fs::path run_filepath = run_dir / bulk_file_name(control);
+        const std::string snapshot_path = (run_dir / "m_snapshots.bin").string();
+        const std::string checkpoint_path = control.checkpoint_path.empty() ?
+            (run_dir / "checkpoint.bin").string() : control.checkpoint_path;
+        // A double build's single run is the double reference of the precision
+        // validation when it takes the fixed steps from step 0.
+        std::vector<TraceRow> ref;
+        const bool run_is_ref = PrecSim::is_double && control.validate_precision &&
+            control.fork_Te_filepaths.empty() && !restart &&
+            control.save_steps_fast == 0 && control.dt_tol == 0.0;
+        if (control.replicas > 1) {
+            if (restart) {
+                throw std::runtime_error("--restart does not apply to replicas "
+                    "(ensemble runs write no checkpoints)");
+            }
+            run_ensemble<PrecSim>(control, lat, mat, neighbors, species, perm,
+                Te_kelvin_arr, run_dir);
+        }
+        else if (!control.fork_Te_filepaths.empty()) {
+            if (restart) {
+                throw std::runtime_error("--restart does not apply to "
+                    "fork_Te_files (the equilibrated state is reused)");
+            }
+            run_forks(control, lat, mat, neighbors, species, perm, run_dir);
+        }
+        else {
+            // A restart maps the checkpoint and resumes from it if it was written
+            // by this input (same parameters, precision, RNG and temperatures so
+            // far); the bulk rows it will write again are dropped from the CSV
+            // first.
+            std::unique_ptr<checkpoint::Reader> restart_from;
+            if (restart) {
+                if (restart_path.empty()) restart_path = checkpoint_path;
+                restart_from = std::make_unique<checkpoint::Reader>(restart_path);
+                const int next_step = restart_from->next_step();
+                if (next_step < 0 ||
+                    next_step > control.pre_steps + control.run_steps ||
+                    !written_by_input(*restart_from, control, lat, mat,
+                        Te_kelvin_arr, next_step)) {
+                    throw std::runtime_error("checkpoint: " + restart_path +
+                        " was not written by this input");
+                }
+                if (control.bulk_format == BulkFormat::BINARY) {
+                    bulk_series::truncate_binary(run_filepath.string(), next_step);
+                }
+                else {
+                    truncate_bulk_values(run_filepath.string(), next_step);
+                }
+                snapshot::truncate(snapshot_path, next_step);
+                std::cout << "Restart = " << restart_path << " at step "
+                          << next_step << "\n";
+            }
+            LoopRun run;
+            run.last_step = control.pre_steps + control.run_steps;
+            run.start = restart_from.get();
+            run.out_csv = run_filepath.string();
+            run.snapshot_path = snapshot_path;
+            run.label = label;
+            if (run_is_ref) run.trace = &ref;
+            if (control.checkpoint_steps > 0) {
+                run.checkpoint_path = checkpoint_path;
+                std::cout << "Checkpoint = " << checkpoint_path << " every "
+                          << control.checkpoint_steps << " steps\n";
+            }
+            run_time_loop<PrecSim>(control, lat, mat, neighbors, species, perm,
+                Te_kelvin_arr, run);
+        }
+
+        // Stopped by a signal: outputs are flushed, main exits 128 + signal.
+        if (shutdown::requested()) return;
+
+        // 7. Precision validation --------------------------------------------
+        // Same run (same noise) in double, mixed and float; the divergence of the
+        // bulk magnetizations from double shows what float storage costs.
+        if (control.validate_precision) {
+            std::vector<TraceRow> mixed, flt;
+            // Fixed cadence and steps: the three runs compare the same steps and
+            // draw the same noise.
+            ControlParams fixed = control;
+            fixed.save_steps_fast = 0;
+            fixed.dt_tol = 0.0;
+            LoopRun run;
+            run.last_step = control.pre_steps + control.run_steps;
+            if (!run_is_ref) {
+                run.trace = &ref;
+                run_time_loop<PrecDouble>(fixed, lat, mat, neighbors, species,
+                    perm, Te_kelvin_arr, run);
+            }
+            run.trace = &mixed;
+            run_time_loop<PrecMixed>(fixed, lat, mat, neighbors, species, perm,
+                Te_kelvin_arr, run);
+            run.trace = &flt;
+            run_time_loop<PrecFloat>(fixed, lat, mat, neighbors, species, perm,
+                Te_kelvin_arr, run);
+
+            std::vector<int> steps;
+            std::vector<double> T_kelvin;
+            std::vector<std::array<double, 6>> divergence;
+            std::array<double, 6> max_div{};
+            // Rows carry their own step (pre_mc_sweeps starts the loop at
+            // pre_steps), so they match the rows of the bulk series.
+            for (size_t r = 0; r < ref.size(); ++r) {
+                steps.push_back(ref[r].time_step);
+                T_kelvin.push_back(ref[r].T_kelvin);
+                std::array<double, 6> d{};
+                for (int q = 0; q < 2; ++q) {
+                    const BulkValues& a = ref[r].bulk;
+                    const BulkValues& b = (q == 0) ? mixed[r].bulk : flt[r].bulk;
+                    d[3*q + 0] = distance(a.mx_bulk, a.my_bulk, a.mz_bulk,
+                        b.mx_bulk, b.my_bulk, b.mz_bulk);
+                    d[3*q + 1] = distance(a.mx_Fe, a.my_Fe, a.mz_Fe,
+                        b.mx_Fe, b.my_Fe, b.mz_Fe);
+                    d[3*q + 2] = distance(a.mx_Gd, a.my_Gd, a.mz_Gd,
+                        b.mx_Gd, b.my_Gd, b.mz_Gd);
+                }
+                for (int c = 0; c < 6; ++c) max_div[c] = std::max(max_div[c], d[c]);
+                divergence.push_back(d);
+            }
+            write_precision_validation(
+                (run_dir / "precision_validation.csv").string(),
+                steps, T_kelvin, divergence);
+            std::cout << "Max |dm_bulk| vs double: mixed = " << max_div[0]
+                      << ", float = " << max_div[3] << "\n";
+        }
+    }
+
+    /// The jobs of a sweep run side by side (sweep.h): job k writes to
+    /// <run_parent_dir>/<run_base_folder>/job_<k> of its own row, and
+    /// sweep_index.csv in the first job's <run_parent_dir>/<run_base_folder>
+    /// lists them with their parameters and status. A failed job is
+    /// reported and the others go on. Returns false if a job failed.
+    bool run_sweep(const InputSweep& input) {
+        // Jobs that build a plain neighbor table share it by lattice size
+        // and cell order (species order permutes the table per job, and a
+        // lattice cache maps a shared file already).
+        const auto shares_geometry = [](const ControlParams& c) {
+            return c.exchange_mode == ExchangeMode::TABLE &&
+                c.site_order == SiteOrder::LATTICE &&
+                c.lattice_cache_dir.empty();
+        };
+        const auto geometry_of = [](const InputSweep::Job& job) {
+            return sweep::Geometries::Key{job.lat.nx, job.lat.ny, job.lat.nz,
+                job.control.cell_order};
+        };
+
+        const int n_jobs = static_cast<int>(input.jobs.size());
+        std::vector<std::string> run_dirs;
+        std::vector<double> cost;
+        std::vector<sweep::Geometries::Key> shared;
+        for (int k = 0; k < n_jobs; ++k) {
+            const InputSweep::Job& job = input.jobs[k];
+            const ControlParams& c = job.control;
+            std::ostringstream name;
+            name << "job_" << std::setw(4) << std::setfill('0') << k;
+            run_dirs.push_back((fs::path(c.run_parent_dir) /
+                c.run_base_folder / name.str()).string());
+            // Work ~ sites x steps (forks: the pre-steps once, a run phase
+            // per file).
+            const int phases = std::max<int>(1, c.fork_Te_filepaths.size());
+            cost.push_back(static_cast<double>(job.lat.N) * c.replicas *
+                (c.pre_steps + static_cast<double>(phases) * c.run_steps));
+            if (shares_geometry(c)) shared.push_back(geometry_of(job));
+        }
+        sweep::Geometries geometries(shared);
+        std::sort(shared.begin(), shared.end());
+        const auto n_tables = std::unique(shared.begin(), shared.end()) -
+            shared.begin();
+
+        const ControlParams& first = input.jobs.front().control;
+        const std::string index_path = (fs::path(first.run_parent_dir) /
+            first.run_base_folder / "sweep_index.csv").string();
+        sweep::Index index(index_path, input, run_dirs);
+        const int n_threads = get_num_threads();
+        const int workers = std::clamp(first.sweep_jobs > 0 ?
+            first.sweep_jobs : n_threads, 1, n_jobs);
+        std::cout << "Sweep = " << n_jobs << " jobs, " << workers
+                  << " at a time on " << n_threads << " threads, "
+                  << n_tables << " shared neighbor tables, index "
+                  << index_path << "\n";
+
+        std::atomic<bool> failed{false};
+        sweep::run_jobs(cost, workers, n_threads, [&](int k, int threads) {
+            const InputSweep::Job& job = input.jobs[k];
+            const std::string label =
+                fs::path(run_dirs[k]).filename().string() + ": ";
+            index.set(k, sweep::Status::RUNNING, threads);
+            set_num_threads(threads);
+            const auto t0 = std::chrono::steady_clock::now();
+            sweep::Status status = sweep::Status::DONE;
+            try {
+                std::shared_ptr<const sweep::Geometry> geometry;
+                if (shares_geometry(job.control)) {
+                    geometry = geometries.get(geometry_of(job));
+                }
+                run_job(job.control, job.lat, job.mat, run_dirs[k], false, "",
+                    geometry.get(), label);
+                if (shutdown::requested()) status = sweep::Status::STOPPED;
+            }
+            catch (const std::exception& e) {
+                std::cerr << label << e.what() << "\n";
+                status = sweep::Status::FAILED;
+                failed = true;
+            }
+            const double seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - t0).count();
+            index.set(k, status, 0, seconds);
+            if (status == sweep::Status::DONE) {
+                std::cout << (label + "done in " + std::to_string(seconds) +
+                    " s with " + std::to_string(threads) + " threads\n")
+                          << std::flush;
+            }
+        });
+        return !failed;
+    }
+}
+
+int main(int argc, char** argv) {
+    // 0. Command line: --restart [checkpoint file] ---------------------------
+    bool restart = false;
+    std::string restart_path;
+    for (int a = 1; a < argc; ++a) {
+        const std::string arg = argv[a];
+        if (arg == "--restart") {
+            restart = true;
+            if (a + 1 < argc && std::string(argv[a + 1]).rfind("--", 0) != 0) {
+                restart_path = argv[++a];
+            }
+        }
+        else {
+            throw std::runtime_error("Unknown argument: " + arg +
+                " (usage: " + argv[0] + " [--restart [checkpoint file]])");
+        }
+    }
+
+    // 1. Read input parameters ------------------------------------------------
+    // Every value row of input.csv is a job, and sweep cells expand a row
+    // into several (io.h); the process-wide settings are the first job's.
     fs::path input_filepath = fs::current_path() / "input.csv";
-    read_input_csv(input_filepath.string(), control, lat, mat);
+    InputSweep input = read_input_jobs(input_filepath.string());
     /// Compute N, normalize easy axes and initial magnetizations
-    process_input(lat, mat);
-
-    // 2. Allocate lattice arrays ----------------------------------------------
-    // std::vector<double> x_m, y_m, z_m; // site positions
-    std::vector<std::array<int, constants::FCC_NN_COUNT>> nearest_neighbors;
-    nearest_neighbors.reserve(lat.N);
-    std::vector<uint8_t> species; // 0=Fe,1=Gd
-    species.reserve(lat.N);
-
-    // 3. Build lattice, assign species ----------------------------------------
-    build_fcc_nn(lat.nx, lat.ny, lat.nz, nearest_neighbors);
-    RNG rng(control.seed);
-    assign_species_by_fraction(lat.N, lat.frac_Gd, species, control.seed);
-
-    // 4. Allocate & initialize other arrays -----------------------------------
-    std::vector<double> mx, my, mz;
-    std::vector<double> mx_mid(lat.N), my_mid(lat.N), mz_mid(lat.N);
-    std::vector<double> dmx_dt_st1(lat.N), dmy_dt_st1(lat.N), dmz_dt_st1(lat.N);
-    std::vector<double> dmx_dt_st2(lat.N), dmy_dt_st2(lat.N), dmz_dt_st2(lat.N);
-    std::vector<double> Hx_exch_tesla(lat.N), Hy_exch_tesla(lat.N), Hz_exch_tesla(lat.N);
-    std::vector<double> Hx_anis_tesla(lat.N), Hy_anis_tesla(lat.N), Hz_anis_tesla(lat.N);
-    std::vector<double> Hx_ther_tesla(lat.N), Hy_ther_tesla(lat.N), Hz_ther_tesla(lat.N);
-    std::vector<double> Hx_total_tesla(lat.N),Hy_total_tesla(lat.N),Hz_total_tesla(lat.N);
-
-    initialize_m(species, mx, my, mz,
-        lat.mx_init_Fe, lat.my_init_Fe, lat.mz_init_Fe,
-        lat.mx_init_Gd, lat.my_init_Gd, lat.mz_init_Gd);
-    double Hx_appl_tesla=lat.Hx_appl_tesla;
-    double Hy_appl_tesla=lat.Hy_appl_tesla;
-    double Hz_appl_tesla=lat.Hz_appl_tesla;
-
-    // 5. Read temperature series ----------------------------------------------
-    std::vector<double> Te_kelvin_arr;
-    read_temperature_series_csv(control.Te_filepath, Te_kelvin_arr);
-    if (static_cast<int>(Te_kelvin_arr.size()) < control.run_steps) {
-        throw std::runtime_error("Temperature data not enough (" +
-            std::to_string(control.run_steps) + " required)");
+    for (InputSweep::Job& job : input.jobs) process_input(job.lat, job.mat);
+    const ControlParams& control = input.jobs.front().control;
+    set_num_threads(control.num_threads);
+    shutdown::install_handlers();
+    std::cout << "Threads = " << get_num_threads() << "\n";
+    simd::configure(control.simd_mode);
+    std::cout << "Kernels = " << simd::active_name() << "\n";
+    std::cout << "Precision = " << precision_name<PrecSim>() << "\n";
+    if (!site_memory::configure(control.numa_policy, control.numa_node)) {
+        std::cerr << "Warning: NUMA policy not available, using first touch\n";
     }
+    std::cout << "Memory policy = " << site_memory::policy_name()
+              << ", huge pages = " << site_memory::huge_page_mode() << "\n";
 
-    // 6. Time evolve ----------------------------------------------------------
-    fs::path run_dir = fs::path(control.run_parent_dir) /
-        control.run_base_folder;
-    // fs::path out_nn = run_dir / "nearest_neighbors.txt";
-    // write_nearest_neighbors(out_nn.string(), lat.nx, lat.ny, lat.nz, constants::FCC_BASIS_COUNT, nearest_neighbors);
-    // fs::path out_site_species = run_dir / "Gd_sites.txt";
-    // write_site_species(out_site_species.string(), lat.nx, lat.ny, lat.nz, constants::FCC_BASIS_COUNT, species);
-    count_atoms(species);
-    for (int curr_step=0; curr_step <= control.pre_steps + control.run_steps;
-        ++curr_step)
-    {
-        // Set temperature
-        double T_kelvin = (curr_step < control.pre_steps) ?
-            control.pre_Te_kelvin :
-            Te_kelvin_arr[curr_step - control.pre_steps];
-        compute_ther_field_once(mat, species, T_kelvin, control.dt_sec, rng,
-            Hx_ther_tesla, Hy_ther_tesla, Hz_ther_tesla);
-
-        // Heun stage-1 --------------------------------------------------------
-        advance_and_normalize_m(mx, my, mz,
-            mx_mid, my_mid, mz_mid,
-            dmx_dt_st1, dmy_dt_st1, dmz_dt_st1, 0.0);
-        compute_total_field(mat, lat.J_joule_per_link, nearest_neighbors,
-            species,
-            mx_mid, my_mid, mz_mid,
-            Hx_appl_tesla,  Hy_appl_tesla,  Hz_appl_tesla,
-            Hx_exch_tesla,  Hy_exch_tesla,  Hz_exch_tesla,
-            Hx_anis_tesla,  Hy_anis_tesla,  Hz_anis_tesla,
-            Hx_ther_tesla,  Hy_ther_tesla,  Hz_ther_tesla,
-            Hx_total_tesla, Hy_total_tesla, Hz_total_tesla);
-        // Reductions & outputs
-        if (curr_step % control.save_steps == 0) {
-            BulkValues bulk_vals{};
-            compute_bulk_m(species, mx, my, mz, bulk_vals);
-            BulkFields bulk_fields{};
-            compute_bulk_fields(species, Hx_exch_tesla, Hy_exch_tesla, Hz_exch_tesla, Hx_anis_tesla, Hy_anis_tesla, Hz_anis_tesla, Hx_ther_tesla, Hy_ther_tesla, Hz_ther_tesla, bulk_fields);
-            fs::path run_filepath = run_dir / "bulk_values_vs_time.csv";
-            write_bulk_values(run_filepath.string(), curr_step,
-                T_kelvin, bulk_vals, bulk_fields);
-        }
-        compute_dm_dt_kernel(mat, species,
-            mx_mid, my_mid, mz_mid,
-            Hx_total_tesla, Hy_total_tesla, Hz_total_tesla,
-            dmx_dt_st1, dmy_dt_st1, dmz_dt_st1);
-
-        // Heun stage-2 --------------------------------------------------------
-        advance_and_normalize_m(mx, my, mz,
-            mx_mid, my_mid, mz_mid,
-            dmx_dt_st1, dmy_dt_st1, dmz_dt_st1, control.dt_sec);
-        compute_total_field(mat, lat.J_joule_per_link, nearest_neighbors,
-            species,
-            mx_mid, my_mid, mz_mid,
-            Hx_appl_tesla,  Hy_appl_tesla,  Hz_appl_tesla,
-            Hx_exch_tesla,  Hy_exch_tesla,  Hz_exch_tesla,
-            Hx_anis_tesla,  Hy_anis_tesla,  Hz_anis_tesla,
-            Hx_ther_tesla,  Hy_ther_tesla,  Hz_ther_tesla,
-            Hx_total_tesla, Hy_total_tesla, Hz_total_tesla);
-        compute_dm_dt_kernel(mat, species,
-            mx_mid, my_mid, mz_mid,
-            Hx_total_tesla, Hy_total_tesla, Hz_total_tesla,
-            dmx_dt_st2, dmy_dt_st2, dmz_dt_st2);
-
-        // Advance m -----------------------------------------------------------
-        advance_and_normalize_m_Heun(mx, my, mz,
-            dmx_dt_st1, dmy_dt_st1, dmz_dt_st1,
-            dmx_dt_st2, dmy_dt_st2, dmz_dt_st2, control.dt_sec);
-
-        if (curr_step % control.show_steps == 0) {
-            std::cout << curr_step << std::endl;
+    // 2. Run ------------------------------------------------------------------
+    bool ok = true;
+    if (input.jobs.size() == 1) {
+        const InputSweep::Job& job = input.jobs.front();
+        run_job(job.control, job.lat, job.mat,
+            fs::path(control.run_parent_dir) / control.run_base_folder,
+            restart, restart_path, nullptr, "");
+    }
+    else {
+        if (restart) {
+            throw std::runtime_error("--restart does not apply to sweeps "
+                "(restart a job from its own directory)");
         }
+        ok = run_sweep(input);
     }
 
-    return 0;
+    // Stopped by a signal: outputs are flushed, exit 128 + signal as the
+    // shell would.
+    if (const int sig = shutdown::requested()) return 128 + sig;
+    return ok ? 0 : 1;
 }
@@ -6,9 +6,10 @@
 #include <vector>
 #include "params.h"
 
-inline void normalize3(double& x, double& y, double& z) {
-    if (const double n = std::sqrt(x*x + y*y + z*z); n > 0.0) {
-        const double inv = 1.0 / n;
+template <typename T>
+inline void normalize3(T& x, T& y, T& z) {
+    if (const T n = std::sqrt(x*x + y*y + z*z); n > T(0)) {
+        const T inv = T(1) / n;
         x *= inv; y *= inv; z *= inv;
     }
 }
@@ -0,0 +1,103 @@
+#include "monte_carlo.h"
+#include "fields.h"
+#include <algorithm>
+#include <cmath>
+
+namespace monte_carlo {
+    Metropolis::Metropolis(const MatParams mat[2],
+        const double J_joule_per_link[2][2], const FccNeighbors& neighbors,
+        const std::vector<uint8_t>& species, const SitePermutation* perm,
+        const double Hx_appl_tesla, const double Hy_appl_tesla,
+        const double Hz_appl_tesla, const double T_kelvin,
+        const CounterRNG& rng)
+        : mat_(mat), J_(J_joule_per_link), neighbors_(neighbors),
+          species_(species), perm_(perm),
+          H_appl_{Hx_appl_tesla, Hy_appl_tesla, Hz_appl_tesla},
+          T_kelvin_(T_kelvin), rng_(rng)
+    {}
+
+    template <typename Real>
+    SweepStats Metropolis::sweep(std::span<Real> mx, std::span<Real> my,
+        std::span<Real> mz)
+    {
+        constexpr int COLORS = constants::FCC_BASIS_COUNT;
+        const SiteIndex n_cells = static_cast<SiteIndex>(species_.size()) /
+            COLORS;
+        const std::span<const Real> cmx(mx), cmy(my), cmz(mz);
+        const double kT = constants::KB_JOULE_PER_KELVIN * T_kelvin_;
+        const uint64_t draw = 2 * n_sweeps_;
+        int64_t tried_Fe = 0, tried_Gd = 0, accepted_Fe = 0, accepted_Gd = 0;
+
+        for (int b = 0; b < COLORS; ++b) {
+            // Sites of color b only read the moments of the other colors.
+            #pragma omp parallel for schedule(static) \
+                reduction(+:tried_Fe, tried_Gd, accepted_Fe, accepted_Gd)
+            for (SiteIndex c = 0; c < n_cells; ++c) {
+                const SiteIndex l = c*COLORS + b;
+                const SiteIndex p = perm_ ? perm_->to_site[l] : l;
+                const int s = species_[p];
+                const MatParams& mat = mat_[s];
+
+                double Hx, Hy, Hz;
+                FccNeighbors::WideList scratch;
+                neighbors_.visit_site(p, scratch, [&](const auto& nb) {
+                    exch_field_at<double>(p, nb, mat_, J_, species_,
+                        cmx, cmy, cmz, Hx, Hy, Hz);
+                });
+                Hx += H_appl_[0]; Hy += H_appl_[1]; Hz += H_appl_[2];
+
+                const double mx_old = mx[p], my_old = my[p], mz_old = mz[p];
+                double gx, gy, gz;
+                rng_.normal3(draw, static_cast<uint64_t>(l), gx, gy, gz);
+                double mx_new = mx_old + sigma_[s]*gx;
+                double my_new = my_old + sigma_[s]*gy;
+                double mz_new = mz_old + sigma_[s]*gz;
+                const double inv_norm = 1.0 / std::sqrt(mx_new*mx_new +
+                    my_new*my_new + mz_new*mz_new);
+                mx_new *= inv_norm; my_new *= inv_norm; mz_new *= inv_norm;
+
+                const double ex = mat.easy_axis.x, ey = mat.easy_axis.y,
+                    ez = mat.easy_axis.z;
+                const double dot_old = mx_old*ex + my_old*ey + mz_old*ez;
+                const double dot_new = mx_new*ex + my_new*ey + mz_new*ez;
+                const double dE = -mat.mu_ampere_m2 * ((mx_new - mx_old)*Hx +
+                    (my_new - my_old)*Hy + (mz_new - mz_old)*Hz) -
+                    mat.ku_joule_per_atom * (dot_new*dot_new - dot_old*dot_old);
+
+                bool accept = dE <= 0.0;
+                if (!accept && kT > 0.0) {
+                    double u[4];
+                    rng_.uniform4(draw + 1, static_cast<uint64_t>(l), u);
+                    accept = u[0] < std::exp(-dE / kT);
+                }
+                if (accept) {
+                    mx[p] = static_cast<Real>(mx_new);
+                    my[p] = static_cast<Real>(my_new);
+                    mz[p] = static_cast<Real>(mz_new);
+                }
+                if (s == 0) { ++tried_Fe; accepted_Fe += accept; }
+                else        { ++tried_Gd; accepted_Gd += accept; }
+            }
+        }
+        ++n_sweeps_;
+
+        // Cone width towards acceptance 1/2, at most 2x per sweep.
+        SweepStats stats;
+        const int64_t tried[2] = {tried_Fe, tried_Gd};
+        const int64_t accepted[2] = {accepted_Fe, accepted_Gd};
+        for (int s = 0; s < 2; ++s) {
+            stats.sigma[s] = sigma_[s];
+            if (tried[s] == 0) continue;
+            stats.acceptance[s] = static_cast<double>(accepted[s]) /
+                static_cast<double>(tried[s]);
+            sigma_[s] = std::clamp(sigma_[s] *
+                std::clamp(2.0 * stats.acceptance[s], 0.5, 2.0), 1e-3, 4.0);
+        }
+        return stats;
+    }
+
+    template SweepStats Metropolis::sweep<double>(std::span<double>,
+        std::span<double>, std::span<double>);
+    template SweepStats Metropolis::sweep<float>(std::span<float>,
+        std::span<float>, std::span<float>);
+}
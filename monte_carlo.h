@@ -0,0 +1,63 @@
+#ifndef MONTE_CARLO_H
+#define MONTE_CARLO_H
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "lattice.h"
+#include "params.h"
+#include "rng.h"
+
+/// Metropolis Monte Carlo equilibration of the moments at a fixed
+/// temperature, with the Hamiltonian of the LLG fields (exchange over the
+/// 12 neighbors, uniaxial anisotropy, applied field).
+/// Checkerboard: the FCC basis index b = p % 4 of the lattice index is a
+/// 4-coloring (every nearest-neighbor vector joins two different basis
+/// sublattices), so the sites of one color do not interact and are updated
+/// in parallel, color after color. A move m -> m' = normalize(m + sigma g)
+/// (g standard normal: a Gaussian cone) is accepted with probability
+/// min(1, exp(-dE / kB T)), where dE is local:
+///   dE = -mu (m' - m).(H_exch + H_appl) - ku ((m'.e)^2 - (m.e)^2).
+/// The cone width sigma of each species adapts after every sweep towards an
+/// acceptance rate of 1/2. The random numbers are keyed by (sweep, lattice
+/// site), so the result does not depend on the thread count or site order.
+namespace monte_carlo {
+    /// CounterRNG stream of the Monte Carlo moves (the LLG runs use small
+    /// stream numbers).
+    constexpr uint32_t STREAM = 0xFFFFFFFFu;
+
+    /// Per species (0 = Fe, 1 = Gd): acceptance rate of a sweep and the cone
+    /// width it used.
+    struct SweepStats {
+        double acceptance[2]{};
+        double sigma[2]{};
+    };
+
+    class Metropolis {
+    public:
+        Metropolis(const MatParams mat[2], const double J_joule_per_link[2][2],
+            const FccNeighbors& neighbors, const std::vector<uint8_t>& species,
+            const SitePermutation* perm, double Hx_appl_tesla,
+            double Hy_appl_tesla, double Hz_appl_tesla, double T_kelvin,
+            const CounterRNG& rng);
+
+        /// One sweep (every site once) of the moments in storage order;
+        /// instantiated for double and float.
+        template <typename Real>
+        SweepStats sweep(std::span<Real> mx, std::span<Real> my,
+            std::span<Real> mz);
+
+    private:
+        const MatParams* mat_;
+        const double (*J_)[2];
+        const FccNeighbors& neighbors_;
+        const std::vector<uint8_t>& species_;
+        const SitePermutation* perm_;
+        double H_appl_[3];
+        double T_kelvin_;
+        CounterRNG rng_;
+        double sigma_[2]{0.5, 0.5};
+        uint64_t n_sweeps_{0};
+    };
+}
+
+#endif //MONTE_CARLO_H
@@ -0,0 +1,56 @@
+#ifndef PARALLEL_UTILS_H
+#define PARALLEL_UTILS_H
+#include <vector>
+#include "params.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace constants {
+    /// Sites per reduction block. Fixed (not derived from the thread count)
+    /// so that partial sums, and hence the final sum, do not depend on how
+    /// many threads ran the reduction.
+    constexpr int REDUCTION_BLOCK_SITES = 4096;
+}
+
+/// Set the number of threads used by the per-site kernels.
+/// n <= 0 keeps the OpenMP default (OMP_NUM_THREADS or all cores).
+inline void set_num_threads(const int n) {
+#ifdef _OPENMP
+    if (n > 0) omp_set_num_threads(n);
+#else
+    (void)n;
+#endif
+}
+
+inline int get_num_threads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+/// Deterministic parallel reduction over [0, N).
+/// block_fn(begin, end) returns the partial result of one block; blocks have
+/// a fixed size and are combined serially in index order, so the result is
+/// bit-identical for any thread count. Acc must provide operator+=.
+template <typename Acc, typename BlockFn>
+Acc blocked_reduce(const SiteIndex N, BlockFn&& block_fn) {
+    constexpr SiteIndex B = constants::REDUCTION_BLOCK_SITES;
+    const SiteIndex n_blocks = (N + B - 1) / B;
+    std::vector<Acc> partial(static_cast<std::size_t>(n_blocks));
+
+    #pragma omp parallel for schedule(static)
+    for (SiteIndex blk = 0; blk < n_blocks; ++blk) {
+        const SiteIndex begin = blk * B;
+        const SiteIndex end   = (begin + B < N) ? begin + B : N;
+        partial[blk] = block_fn(begin, end);
+    }
+
+    Acc total{};
+    for (const Acc& p : partial) total += p;
+    return total;
+}
+
+#endif //PARALLEL_UTILS_H
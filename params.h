@@ -1,7 +1,9 @@
 #ifndef PARAMS_H
 #define PARAMS_H
+#include <array>
 #include <cstdint>
 #include <string>
+#include <vector>
 
 namespace constants {
     constexpr double KB_JOULE_PER_KELVIN = 1.380649e-23;
@@ -10,6 +12,49 @@ namespace constants {
     constexpr double EXCH_FACTOR  = 1.0;
 }
 
+/// Site index and site count. 64-bit, so lattices past 2^31 sites run; the
+/// explicit neighbor table keeps 32-bit entries and is limited to INT32_MAX
+/// sites (see build_fcc_nn), the stencil has no limit.
+using SiteIndex = std::int64_t;
+
+/// Thermal-noise generator: MT19937 = one sequential stream (legacy, serial),
+/// PHILOX = counter-based, parallel and thread-count independent.
+enum class RngKind { MT19937, PHILOX };
+
+/// Kernel instruction set: AUTO = AVX2 if the CPU has it, else scalar.
+enum class SimdMode { AUTO, SCALAR, AVX2 };
+
+/// Neighbor lookup: TABLE = precomputed 12 ints per site (build_fcc_nn),
+/// STENCIL = computed on the fly from (i,j,k,b), no table in memory.
+enum class ExchangeMode { TABLE, STENCIL };
+
+/// Site storage order: LATTICE = p = (((i*ny + j)*nz + k)*4 + b),
+/// SPECIES = all Fe sites, then all Gd sites (see partition_sites_by_species).
+enum class SiteOrder { LATTICE, SPECIES };
+
+/// Order of the cells in the site index: ROW_MAJOR = (i, j, k), MORTON =
+/// Z-order curve, HILBERT = Hilbert curve (see build_fcc_nn).
+enum class CellOrder { ROW_MAJOR, MORTON, HILBERT };
+
+/// Page placement of the large per-site arrays (site_memory.h):
+/// FIRST_TOUCH = pages land on the node of the thread that first writes them
+/// (parallel init with the kernels' partition), INTERLEAVE = round-robin
+/// over all online nodes, BIND = all on one node.
+enum class NumaPolicy { FIRST_TOUCH, INTERLEAVE, BIND };
+
+/// Time step: HEUN = Euler predictor and trapezoid corrector, each followed
+/// by normalize3; DEPONDT = Depondt-Mertens, the same two stages as rotations
+/// of m (norm-preserving, stays accurate at larger dt_sec).
+enum class Integrator { HEUN, DEPONDT };
+
+/// Format of the bulk time series: CSV text or the binary columnar format
+/// of bulk_series.h (convert with bulk_to_csv).
+enum class BulkFormat { CSV, BINARY };
+
+/// Species of the ensemble replicas: SHARED = every replica has the species
+/// of seed, INDEPENDENT = replica r draws its own with seed + r.
+enum class ReplicaSpecies { SHARED, INDEPENDENT };
+
 struct Vec3 {
     double x{0.0}, y{0.0}, z{0.0};
 };
@@ -25,6 +70,37 @@ struct ControlParams {
     std::string run_parent_dir;
     std::string run_base_folder;
     std::string Te_filepath;
+    int num_threads{0}; // optional, <= 0 = OpenMP default
+    RngKind rng_kind{RngKind::MT19937}; // optional
+    SimdMode simd_mode{SimdMode::AUTO}; // optional
+    Integrator integrator{Integrator::HEUN}; // optional
+    ExchangeMode exchange_mode{ExchangeMode::TABLE}; // optional
+    SiteOrder site_order{SiteOrder::LATTICE}; // optional
+    CellOrder cell_order{CellOrder::ROW_MAJOR}; // optional
+    bool validate_precision{false}; // optional, rerun in float/mixed and compare
+    NumaPolicy numa_policy{NumaPolicy::FIRST_TOUCH}; // optional
+    int numa_node{0}; // optional, node of NumaPolicy::BIND
+    std::string lattice_cache_dir; // optional, empty = no lattice cache
+    int checkpoint_steps{0}; // optional, 0 = no checkpoints
+    std::string checkpoint_path; // optional, empty = <run dir>/checkpoint.bin
+    std::vector<std::string> fork_Te_filepaths; // optional, run phases to fork
+    int fork_jobs{0}; // optional, <= 0 = min(forks, threads) at a time
+    std::string equilibrated_path; // optional, empty = <run dir>/equilibrated.bin
+    BulkFormat bulk_format{BulkFormat::CSV}; // optional
+    int snapshot_steps{0}; // optional, 0 = no spin snapshots
+    int snapshot_keyframe{16}; // optional, every n-th snapshot is a keyframe
+    bool write_topology{true}; // optional, topology.bin of the lattice (topology.h)
+    int save_steps_fast{0}; // optional, 0 = save every save_steps (save_cadence.h)
+    double save_dm_dt_per_ps{0.05}; // optional, adaptive cadence thresholds
+    double save_dT_dt_kelvin_per_ps{100.0};
+    double dt_tol{0.0}; // optional, > 0 = adaptive step (step_control.h)
+    double dt_min_sec{0.0}; // optional, adaptive step bounds (io: dt_sec/4,
+    double dt_max_sec{0.0}; // 32 dt_sec)
+    double dt_max_dT_kelvin{10.0}; // optional, largest T change per step
+    int pre_mc_sweeps{0}; // optional, > 0 = Monte Carlo instead of LLG pre-steps
+    int replicas{1}; // optional, > 1 = ensemble run (ensemble.h)
+    ReplicaSpecies replica_species{ReplicaSpecies::SHARED}; // optional
+    int sweep_jobs{0}; // optional, <= 0 = min(jobs, threads) at a time (sweep.h)
 };
 struct LatParams {
     int nx, ny, nz; // number of cells
@@ -35,7 +111,7 @@ struct LatParams {
     double mx_init_Gd, my_init_Gd, mz_init_Gd;
     double Hx_appl_tesla, Hy_appl_tesla, Hz_appl_tesla;
     /// Derived
-    int N{0};
+    SiteIndex N{0};
 };
 struct MatParams {
     double mu_ampere_m2;
@@ -0,0 +1,37 @@
+#ifndef PRECISION_H
+#define PRECISION_H
+#include <type_traits>
+
+/// Precision policy of the per-site kernels: real = storage type of the
+/// per-site arrays, acc = arithmetic type of a site update. Bulk reductions
+/// always accumulate in double.
+template <typename Real, typename Acc>
+struct Precision {
+    using real = Real;
+    using acc  = Acc;
+    /// The explicit AVX2 kernels (kernels_avx2.h) exist for double only.
+    static constexpr bool is_double =
+        std::is_same_v<Real, double> && std::is_same_v<Acc, double>;
+};
+
+using PrecDouble = Precision<double, double>;
+using PrecFloat  = Precision<float, float>;
+using PrecMixed  = Precision<float, double>; // float arrays, double math
+
+/// Precision of the simulation, fixed at build time (CMake GDFE_PRECISION).
+#if defined(GDFE_PRECISION_FLOAT)
+using PrecSim = PrecFloat;
+#elif defined(GDFE_PRECISION_MIXED)
+using PrecSim = PrecMixed;
+#else
+using PrecSim = PrecDouble;
+#endif
+
+template <typename P>
+constexpr const char* precision_name() {
+    if constexpr (std::is_same_v<P, PrecFloat>) return "float";
+    else if constexpr (std::is_same_v<P, PrecMixed>) return "mixed";
+    else return "double";
+}
+
+#endif //PRECISION_H
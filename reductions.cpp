@@ -1,160 +1,342 @@
 #include "reductions.h"
+#include "fields.h"
+#include "parallel_utils.h"
+#include <algorithm>
 #include <cmath>
 
-void compute_bulk_m(const std::vector<uint8_t>& species,
-    const std::vector<double>& mx,
-    const std::vector<double>& my,
-    const std::vector<double>& mz, BulkValues& bulk)
-{
-    double sum_mx_Fe  = 0.0, sum_my_Fe  = 0.0, sum_mz_Fe  = 0.0;
-    double sum_mx_Gd  = 0.0, sum_my_Gd  = 0.0, sum_mz_Gd  = 0.0;
-    double sum_mx_all = 0.0, sum_my_all = 0.0, sum_mz_all = 0.0;
-    int    cnt_Fe = 0, cnt_Gd = 0;
-
-    const int N = static_cast<int>(species.size());
-    for (int i = 0; i < N; ++i) {
-        const double mx_i = mx[i];
-        const double my_i = my[i];
-        const double mz_i = mz[i];
-
-        sum_mx_all += mx_i;
-        sum_my_all += my_i;
-        sum_mz_all += mz_i;
-
-        if (species[i] == 0) // Fe
-        {
-            sum_mx_Fe += mx_i;
-            sum_my_Fe += my_i;
-            sum_mz_Fe += mz_i;
-            ++cnt_Fe;
+namespace {
+    struct MSums {
+        double mx_Fe{0},  my_Fe{0},  mz_Fe{0};
+        double mx_Gd{0},  my_Gd{0},  mz_Gd{0};
+        double mx_all{0}, my_all{0}, mz_all{0};
+        SiteIndex cnt_Fe{0}, cnt_Gd{0};
+
+        MSums& operator+=(const MSums& o) {
+            mx_Fe  += o.mx_Fe;  my_Fe  += o.my_Fe;  mz_Fe  += o.mz_Fe;
+            mx_Gd  += o.mx_Gd;  my_Gd  += o.my_Gd;  mz_Gd  += o.mz_Gd;
+            mx_all += o.mx_all; my_all += o.my_all; mz_all += o.mz_all;
+            cnt_Fe += o.cnt_Fe; cnt_Gd += o.cnt_Gd;
+            return *this;
         }
-        else if (species[i] == 1) // Gd
-        {
-            sum_mx_Gd += mx_i;
-            sum_my_Gd += my_i;
-            sum_mz_Gd += mz_i;
-            ++cnt_Gd;
+    };
+
+    struct MaxDistance {
+        double d2{0};
+
+        MaxDistance& operator+=(const MaxDistance& o) {
+            d2 = std::max(d2, o.d2);
+            return *this;
         }
-    }
+    };
 
-    if (N > 0) {
-        const double inv = 1.0 / static_cast<double>(N);
-        bulk.mx_bulk = sum_mx_all * inv;
-        bulk.my_bulk = sum_my_all * inv;
-        bulk.mz_bulk = sum_mz_all * inv;
-    }
-    else {
-        bulk.mx_bulk = bulk.my_bulk = bulk.mz_bulk = 0.0;
-    }
+    struct HSums {
+        struct Terms {
+            double Hx_exch{0}, Hy_exch{0}, Hz_exch{0};
+            double Hx_anis{0}, Hy_anis{0}, Hz_anis{0};
+            double Hx_ther{0}, Hy_ther{0}, Hz_ther{0};
+            SiteIndex cnt{0};
+        };
+        Terms by_species[2]{}; // 0=Fe, 1=Gd
 
-    if (cnt_Fe > 0) {
-        const double inv = 1.0 / static_cast<double>(cnt_Fe);
-        bulk.mx_Fe = sum_mx_Fe * inv;
-        bulk.my_Fe = sum_my_Fe * inv;
-        bulk.mz_Fe = sum_mz_Fe * inv;
-    }
-    else {
-        bulk.mx_Fe = bulk.my_Fe = bulk.mz_Fe = 0.0;
+        HSums& operator+=(const HSums& o) {
+            for (int s = 0; s < 2; ++s) {
+                Terms& t = by_species[s];
+                const Terms& u = o.by_species[s];
+                t.Hx_exch += u.Hx_exch; t.Hy_exch += u.Hy_exch; t.Hz_exch += u.Hz_exch;
+                t.Hx_anis += u.Hx_anis; t.Hy_anis += u.Hy_anis; t.Hz_anis += u.Hz_anis;
+                t.Hx_ther += u.Hx_ther; t.Hy_ther += u.Hy_ther; t.Hz_ther += u.Hz_ther;
+                t.cnt += u.cnt;
+            }
+            return *this;
+        }
+    };
+
+    // Species-partitioned order: Fe is [0, n_Fe), Gd is [n_Fe, N).
+    template <typename Real>
+    MSums partitioned_m_sums(const SiteIndex n_Fe, const SiteIndex N,
+        std::span<const Real> mx,
+        std::span<const Real> my,
+        std::span<const Real> mz)
+    {
+        const MSums Fe = blocked_reduce<MSums>(n_Fe,
+            [&](const SiteIndex begin, const SiteIndex end) {
+            MSums acc{};
+            for (SiteIndex i = begin; i < end; ++i) {
+                acc.mx_Fe += mx[i];
+                acc.my_Fe += my[i];
+                acc.mz_Fe += mz[i];
+            }
+            acc.cnt_Fe = end - begin;
+            return acc;
+        });
+        const MSums Gd = blocked_reduce<MSums>(N - n_Fe,
+            [&](const SiteIndex begin, const SiteIndex end) {
+            MSums acc{};
+            for (SiteIndex i = n_Fe + begin; i < n_Fe + end; ++i) {
+                acc.mx_Gd += mx[i];
+                acc.my_Gd += my[i];
+                acc.mz_Gd += mz[i];
+            }
+            acc.cnt_Gd = end - begin;
+            return acc;
+        });
+        MSums sums = Fe;
+        sums += Gd;
+        sums.mx_all = Fe.mx_Fe + Gd.mx_Gd;
+        sums.my_all = Fe.my_Fe + Gd.my_Gd;
+        sums.mz_all = Fe.mz_Fe + Gd.mz_Gd;
+        return sums;
     }
 
-    if (cnt_Gd > 0) {
-        const double inv = 1.0 / static_cast<double>(cnt_Gd);
-        bulk.mx_Gd = sum_mx_Gd * inv;
-        bulk.my_Gd = sum_my_Gd * inv;
-        bulk.mz_Gd = sum_mz_Gd * inv;
+    template <typename Real>
+    void add_terms(HSums::Terms& t,
+        const Real Hx_exch, const Real Hy_exch, const Real Hz_exch,
+        const Real Hx_anis, const Real Hy_anis, const Real Hz_anis,
+        const Real Hx_ther, const Real Hy_ther, const Real Hz_ther)
+    {
+        t.Hx_exch += std::fabs(Hx_exch);
+        t.Hy_exch += std::fabs(Hy_exch);
+        t.Hz_exch += std::fabs(Hz_exch);
+
+        t.Hx_anis += (Hx_anis);
+        t.Hy_anis += (Hy_anis);
+        t.Hz_anis += (Hz_anis);
+
+        t.Hx_ther += std::fabs(Hx_ther);
+        t.Hy_ther += std::fabs(Hy_ther);
+        t.Hz_ther += std::fabs(Hz_ther);
+
+        ++t.cnt;
     }
-    else {
-        bulk.mx_Gd = bulk.my_Gd = bulk.mz_Gd = 0.0;
+
+    /// Per-species field sums; add_site(t, i) adds site i to t.
+    template <typename AddSite>
+    HSums field_sums(const std::vector<uint8_t>& species,
+        const SitePermutation* perm, const AddSite& add_site)
+    {
+        const SiteIndex N = static_cast<SiteIndex>(species.size());
+        HSums sums{};
+        if (perm && perm->n_Fe >= 0) {
+            const SiteIndex begin[3] = {0, perm->n_Fe, N};
+            for (int s = 0; s < 2; ++s) {
+                sums += blocked_reduce<HSums>(begin[s+1] - begin[s],
+                    [&](const SiteIndex b, const SiteIndex e) {
+                    HSums acc{};
+                    for (SiteIndex i = begin[s] + b; i < begin[s] + e; ++i)
+                        add_site(acc.by_species[s], i);
+                    return acc;
+                });
+            }
+        }
+        else {
+            sums = blocked_reduce<HSums>(N,
+                [&](const SiteIndex begin, const SiteIndex end) {
+                HSums acc{};
+                for (SiteIndex i = begin; i < end; ++i) { // 0=Fe, 1=Gd
+                    const int s = species[i];
+                    if (s != 0 && s != 1) continue;
+                    add_site(acc.by_species[s], i);
+                }
+                return acc;
+            });
+        }
+        return sums;
     }
-}
 
-void compute_bulk_fields(const std::vector<uint8_t>& species,
-    const std::vector<double>& Hx_exch_tesla, const std::vector<double>& Hy_exch_tesla, const std::vector<double>& Hz_exch_tesla,
-    const std::vector<double>& Hx_anis_tesla, const std::vector<double>& Hy_anis_tesla, const std::vector<double>& Hz_anis_tesla,
-    const std::vector<double>& Hx_ther_tesla, const std::vector<double>& Hy_ther_tesla, const std::vector<double>& Hz_ther_tesla,
-    BulkFields& bulk_fields)
-{
-    double sum_Hx_exch_tesla_Fe  = 0.0, sum_Hy_exch_tesla_Fe  = 0.0, sum_Hz_exch_tesla_Fe  = 0.0;
-    double sum_Hx_anis_tesla_Fe  = 0.0, sum_Hy_anis_tesla_Fe  = 0.0, sum_Hz_anis_tesla_Fe  = 0.0;
-    double sum_Hx_ther_tesla_Fe  = 0.0, sum_Hy_ther_tesla_Fe  = 0.0, sum_Hz_ther_tesla_Fe  = 0.0;
+    void finish_bulk_fields(const HSums& sums, BulkFields& bulk_fields) {
+        const HSums::Terms& Fe = sums.by_species[0];
+        const HSums::Terms& Gd = sums.by_species[1];
+        const SiteIndex cnt_Fe = Fe.cnt, cnt_Gd = Gd.cnt;
 
-    double sum_Hx_exch_tesla_Gd  = 0.0, sum_Hy_exch_tesla_Gd  = 0.0, sum_Hz_exch_tesla_Gd  = 0.0;
-    double sum_Hx_anis_tesla_Gd  = 0.0, sum_Hy_anis_tesla_Gd  = 0.0, sum_Hz_anis_tesla_Gd  = 0.0;
-    double sum_Hx_ther_tesla_Gd  = 0.0, sum_Hy_ther_tesla_Gd  = 0.0, sum_Hz_ther_tesla_Gd  = 0.0;
+        if (cnt_Fe > 0) {
+            const double inv = 1.0 / static_cast<double>(cnt_Fe);
+            bulk_fields.Hx_exch_tesla_Fe = Fe.Hx_exch * inv;
+            bulk_fields.Hy_exch_tesla_Fe = Fe.Hy_exch * inv;
+            bulk_fields.Hz_exch_tesla_Fe = Fe.Hz_exch * inv;
 
-    int cnt_Fe = 0, cnt_Gd = 0;
+            bulk_fields.Hx_anis_tesla_Fe = Fe.Hx_anis * inv;
+            bulk_fields.Hy_anis_tesla_Fe = Fe.Hy_anis * inv;
+            bulk_fields.Hz_anis_tesla_Fe = Fe.Hz_anis * inv;
 
-    const int N = static_cast<int>(species.size());
-    for (int i = 0; i < N; ++i) { // 0=Fe, 1=Gd
-        if (species[i] == 0) {
-            sum_Hx_exch_tesla_Fe += fabs(Hx_exch_tesla[i]);
-            sum_Hy_exch_tesla_Fe += fabs(Hy_exch_tesla[i]);
-            sum_Hz_exch_tesla_Fe += fabs(Hz_exch_tesla[i]);
+            bulk_fields.Hx_ther_tesla_Fe = Fe.Hx_ther * inv;
+            bulk_fields.Hy_ther_tesla_Fe = Fe.Hy_ther * inv;
+            bulk_fields.Hz_ther_tesla_Fe = Fe.Hz_ther * inv;
+        }
+        else {
+            bulk_fields.Hx_exch_tesla_Fe = bulk_fields.Hy_exch_tesla_Fe = bulk_fields.Hz_exch_tesla_Fe = 0.0;
+            bulk_fields.Hx_anis_tesla_Fe = bulk_fields.Hy_anis_tesla_Fe = bulk_fields.Hz_anis_tesla_Fe = 0.0;
+            bulk_fields.Hx_ther_tesla_Fe = bulk_fields.Hy_ther_tesla_Fe = bulk_fields.Hz_ther_tesla_Fe = 0.0;
+        }
 
-            sum_Hx_anis_tesla_Fe += (Hx_anis_tesla[i]);
-            sum_Hy_anis_tesla_Fe += (Hy_anis_tesla[i]);
-            sum_Hz_anis_tesla_Fe += (Hz_anis_tesla[i]);
+        if (cnt_Gd > 0) {
+            const double inv = 1.0 / static_cast<double>(cnt_Gd);
+            bulk_fields.Hx_exch_tesla_Gd = Gd.Hx_exch * inv;
+            bulk_fields.Hy_exch_tesla_Gd = Gd.Hy_exch * inv;
+            bulk_fields.Hz_exch_tesla_Gd = Gd.Hz_exch * inv;
 
-            sum_Hx_ther_tesla_Fe += fabs(Hx_ther_tesla[i]);
-            sum_Hy_ther_tesla_Fe += fabs(Hy_ther_tesla[i]);
-            sum_Hz_ther_tesla_Fe += fabs(Hz_ther_tesla[i]);
+            bulk_fields.Hx_anis_tesla_Gd = Gd.Hx_anis * inv;
+            bulk_fields.Hy_anis_tesla_Gd = Gd.Hy_anis * inv;
+            bulk_fields.Hz_anis_tesla_Gd = Gd.Hz_anis * inv;
 
-            ++cnt_Fe;
+            bulk_fields.Hx_ther_tesla_Gd = Gd.Hx_ther * inv;
+            bulk_fields.Hy_ther_tesla_Gd = Gd.Hy_ther * inv;
+            bulk_fields.Hz_ther_tesla_Gd = Gd.Hz_ther * inv;
         }
-        else if (species[i] == 1) {
-            sum_Hx_exch_tesla_Gd += fabs(Hx_exch_tesla[i]);
-            sum_Hy_exch_tesla_Gd += fabs(Hy_exch_tesla[i]);
-            sum_Hz_exch_tesla_Gd += fabs(Hz_exch_tesla[i]);
+        else {
+            bulk_fields.Hx_exch_tesla_Gd = bulk_fields.Hy_exch_tesla_Gd = bulk_fields.Hz_exch_tesla_Gd = 0.0;
+            bulk_fields.Hx_anis_tesla_Gd = bulk_fields.Hy_anis_tesla_Gd = bulk_fields.Hz_anis_tesla_Gd = 0.0;
+            bulk_fields.Hx_ther_tesla_Gd = bulk_fields.Hy_ther_tesla_Gd = bulk_fields.Hz_ther_tesla_Gd = 0.0;
+        }
+    }
+}
 
-            sum_Hx_anis_tesla_Gd += (Hx_anis_tesla[i]);
-            sum_Hy_anis_tesla_Gd += (Hy_anis_tesla[i]);
-            sum_Hz_anis_tesla_Gd += (Hz_anis_tesla[i]);
+template <typename Real>
+void compute_bulk_m(const std::vector<uint8_t>& species,
+    std::span<const Real> mx,
+    std::span<const Real> my,
+    std::span<const Real> mz, BulkValues& bulk,
+    const SitePermutation* perm)
+{
+    const SiteIndex N = static_cast<SiteIndex>(species.size());
+    const MSums sums = (perm && perm->n_Fe >= 0) ?
+        partitioned_m_sums(perm->n_Fe, N, mx, my, mz) :
+        blocked_reduce<MSums>(N,
+        [&](const SiteIndex begin, const SiteIndex end) {
+        MSums acc{};
+        for (SiteIndex i = begin; i < end; ++i) {
+            const double mx_i = mx[i];
+            const double my_i = my[i];
+            const double mz_i = mz[i];
 
-            sum_Hx_ther_tesla_Gd += fabs(Hx_ther_tesla[i]);
-            sum_Hy_ther_tesla_Gd += fabs(Hy_ther_tesla[i]);
-            sum_Hz_ther_tesla_Gd += fabs(Hz_ther_tesla[i]);
+            acc.mx_all += mx_i;
+            acc.my_all += my_i;
+            acc.mz_all += mz_i;
 
-            ++cnt_Gd;
+            if (species[i] == 0) // Fe
+            {
+                acc.mx_Fe += mx_i;
+                acc.my_Fe += my_i;
+                acc.mz_Fe += mz_i;
+                ++acc.cnt_Fe;
+            }
+            else if (species[i] == 1) // Gd
+            {
+                acc.mx_Gd += mx_i;
+                acc.my_Gd += my_i;
+                acc.mz_Gd += mz_i;
+                ++acc.cnt_Gd;
+            }
         }
+        return acc;
+    });
+    const SiteIndex cnt_Fe = sums.cnt_Fe, cnt_Gd = sums.cnt_Gd;
+
+    if (N > 0) {
+        const double inv = 1.0 / static_cast<double>(N);
+        bulk.mx_bulk = sums.mx_all * inv;
+        bulk.my_bulk = sums.my_all * inv;
+        bulk.mz_bulk = sums.mz_all * inv;
+    }
+    else {
+        bulk.mx_bulk = bulk.my_bulk = bulk.mz_bulk = 0.0;
     }
 
     if (cnt_Fe > 0) {
         const double inv = 1.0 / static_cast<double>(cnt_Fe);
-        bulk_fields.Hx_exch_tesla_Fe = sum_Hx_exch_tesla_Fe * inv;
-        bulk_fields.Hy_exch_tesla_Fe = sum_Hy_exch_tesla_Fe * inv;
-        bulk_fields.Hz_exch_tesla_Fe = sum_Hz_exch_tesla_Fe * inv;
-
-        bulk_fields.Hx_anis_tesla_Fe = sum_Hx_anis_tesla_Fe * inv;
-        bulk_fields.Hy_anis_tesla_Fe = sum_Hy_anis_tesla_Fe * inv;
-        bulk_fields.Hz_anis_tesla_Fe = sum_Hz_anis_tesla_Fe * inv;
-
-        bulk_fields.Hx_ther_tesla_Fe = sum_Hx_ther_tesla_Fe * inv;
-        bulk_fields.Hy_ther_tesla_Fe = sum_Hy_ther_tesla_Fe * inv;
-        bulk_fields.Hz_ther_tesla_Fe = sum_Hz_ther_tesla_Fe * inv;
+        bulk.mx_Fe = sums.mx_Fe * inv;
+        bulk.my_Fe = sums.my_Fe * inv;
+        bulk.mz_Fe = sums.mz_Fe * inv;
     }
     else {
-        bulk_fields.Hx_exch_tesla_Fe = bulk_fields.Hy_exch_tesla_Fe = bulk_fields.Hz_exch_tesla_Fe = 0.0;
-        bulk_fields.Hx_anis_tesla_Fe = bulk_fields.Hy_anis_tesla_Fe = bulk_fields.Hz_anis_tesla_Fe = 0.0;
-        bulk_fields.Hx_ther_tesla_Fe = bulk_fields.Hy_ther_tesla_Fe = bulk_fields.Hz_ther_tesla_Fe = 0.0;
+        bulk.mx_Fe = bulk.my_Fe = bulk.mz_Fe = 0.0;
     }
 
     if (cnt_Gd > 0) {
         const double inv = 1.0 / static_cast<double>(cnt_Gd);
-        bulk_fields.Hx_exch_tesla_Gd = sum_Hx_exch_tesla_Gd * inv;
-        bulk_fields.Hy_exch_tesla_Gd = sum_Hy_exch_tesla_Gd * inv;
-        bulk_fields.Hz_exch_tesla_Gd = sum_Hz_exch_tesla_Gd * inv;
-
-        bulk_fields.Hx_anis_tesla_Gd = sum_Hx_anis_tesla_Gd * inv;
-        bulk_fields.Hy_anis_tesla_Gd = sum_Hy_anis_tesla_Gd * inv;
-        bulk_fields.Hz_anis_tesla_Gd = sum_Hz_anis_tesla_Gd * inv;
-
-        bulk_fields.Hx_ther_tesla_Gd = sum_Hx_ther_tesla_Gd * inv;
-        bulk_fields.Hy_ther_tesla_Gd = sum_Hy_ther_tesla_Gd * inv;
-        bulk_fields.Hz_ther_tesla_Gd = sum_Hz_ther_tesla_Gd * inv;
+        bulk.mx_Gd = sums.mx_Gd * inv;
+        bulk.my_Gd = sums.my_Gd * inv;
+        bulk.mz_Gd = sums.mz_Gd * inv;
     }
     else {
-        bulk_fields.Hx_exch_tesla_Gd = bulk_fields.Hy_exch_tesla_Gd = bulk_fields.Hz_exch_tesla_Gd = 0.0;
-        bulk_fields.Hx_anis_tesla_Gd = bulk_fields.Hy_anis_tesla_Gd = bulk_fields.Hz_anis_tesla_Gd = 0.0;
-        bulk_fields.Hx_ther_tesla_Gd = bulk_fields.Hy_ther_tesla_Gd = bulk_fields.Hz_ther_tesla_Gd = 0.0;
+        bulk.mx_Gd = bulk.my_Gd = bulk.mz_Gd = 0.0;
     }
 }
+
+template <typename P>
+void compute_bulk_fields_from_m(const MatParams mat[2],
+    const double J_joule_per_link[2][2],
+    const FccNeighbors& neighbors,
+    const std::vector<uint8_t>& species,
+    std::span<const typename P::real> mx,
+    std::span<const typename P::real> my,
+    std::span<const typename P::real> mz,
+    std::span<const typename P::real> Hx_ther_tesla,
+    std::span<const typename P::real> Hy_ther_tesla,
+    std::span<const typename P::real> Hz_ther_tesla,
+    BulkFields& bulk_fields,
+    const SitePermutation* perm)
+{
+    using Acc = typename P::acc;
+    using Real = typename P::real;
+    const HSums sums = field_sums(species, perm,
+        [&](HSums::Terms& t, const SiteIndex i) {
+        FccNeighbors::WideList scratch;
+        Acc Hx_exch, Hy_exch, Hz_exch;
+        neighbors.visit_site(i, scratch, [&](const auto& nb) {
+            exch_field_at(i, nb, mat, J_joule_per_link, species, mx, my, mz,
+                Hx_exch, Hy_exch, Hz_exch);
+        });
+        Acc Hx_anis, Hy_anis, Hz_anis;
+        anis_field_at<Acc>(mat[species[i]], mx[i], my[i], mz[i],
+            Hx_anis, Hy_anis, Hz_anis);
+        // Rounded to Real, as the per-site fields of P would be stored.
+        add_terms(t, static_cast<Real>(Hx_exch), static_cast<Real>(Hy_exch),
+            static_cast<Real>(Hz_exch), static_cast<Real>(Hx_anis),
+            static_cast<Real>(Hy_anis), static_cast<Real>(Hz_anis),
+            Hx_ther_tesla[i], Hy_ther_tesla[i], Hz_ther_tesla[i]);
+    });
+    finish_bulk_fields(sums, bulk_fields);
+}
+
+template <typename Real>
+double max_distance(std::span<const Real> ax, std::span<const Real> ay,
+    std::span<const Real> az, std::span<const Real> bx,
+    std::span<const Real> by, std::span<const Real> bz)
+{
+    const SiteIndex N = static_cast<SiteIndex>(ax.size());
+    const MaxDistance m = blocked_reduce<MaxDistance>(N,
+        [&](const SiteIndex begin, const SiteIndex end) {
+        MaxDistance acc{};
+        for (SiteIndex i = begin; i < end; ++i) {
+            const double dx = static_cast<double>(ax[i]) - bx[i];
+            const double dy = static_cast<double>(ay[i]) - by[i];
+            const double dz = static_cast<double>(az[i]) - bz[i];
+            acc.d2 = std::max(acc.d2, dx*dx + dy*dy + dz*dz);
+        }
+        return acc;
+    });
+    return std::sqrt(m.d2);
+}
+
+#define INSTANTIATE_REDUCTIONS(Real) \
+    template void compute_bulk_m<Real>(const std::vector<uint8_t>&, \
+        std::span<const Real>, std::span<const Real>, \
+        std::span<const Real>, BulkValues&, const SitePermutation*); \
+    template double max_distance<Real>(std::span<const Real>, \
+        std::span<const Real>, std::span<const Real>, std::span<const Real>, \
+        std::span<const Real>, std::span<const Real>);
+
+INSTANTIATE_REDUCTIONS(double)
+INSTANTIATE_REDUCTIONS(float)
+
+#define INSTANTIATE_BULK_FIELDS_FROM_M(P) \
+    template void compute_bulk_fields_from_m<P>(const MatParams[2], \
+        const double[2][2], const FccNeighbors&, const std::vector<uint8_t>&, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, std::span<const P::real>, \
+        std::span<const P::real>, std::span<const P::real>, \
+        BulkFields&, const SitePermutation*);
+
+INSTANTIATE_BULK_FIELDS_FROM_M(PrecDouble)
+INSTANTIATE_BULK_FIELDS_FROM_M(PrecMixed)
+INSTANTIATE_BULK_FIELDS_FROM_M(PrecFloat)
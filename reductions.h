@@ -1,22 +1,49 @@
 #ifndef REDUCTIONS_H
 #define REDUCTIONS_H
 #include <cstdint>
+#include <span>
 #include <vector>
+#include "lattice.h"
 #include "params.h"
+#include "precision.h"
 
 /// species[i]: 0 = Fe, 1 = Gd
 /// If a species is absent, its outputs are 0.
+/// In the species-partitioned order (perm->n_Fe >= 0), each species is
+/// reduced over its contiguous range without testing species[i].
+/// Real is the per-site storage type (double or float); the sums are always
+/// accumulated in double. Instantiated for both in reductions.cpp.
+template <typename Real>
 void compute_bulk_m(const std::vector<uint8_t>& species,
-    const std::vector<double>& mx,
-    const std::vector<double>& my,
-    const std::vector<double>& mz, BulkValues& bulk);
+    std::span<const Real> mx,
+    std::span<const Real> my,
+    std::span<const Real> mz, BulkValues& bulk,
+    const SitePermutation* perm = nullptr);
 
-void compute_bulk_fields(const std::vector<uint8_t>& species,
-    const std::vector<double> &Hx_exch_tesla, const std::vector<double> &Hy_exch_tesla, const std::vector<double> &Hz_exch_tesla,
-    const std::vector<double>& Hx_anis_tesla, const std::vector<double>& Hy_anis_tesla,
-    const std::vector<double>& Hz_anis_tesla,
-    const std::vector<double>& Hx_ther_tesla, const std::vector<double>& Hy_ther_tesla,
-    const std::vector<double>& Hz_ther_tesla,
-    BulkFields& bulk_fields);
+/// max_i |a_i - b_i| over the sites (the local error estimate of the
+/// adaptive step: a = corrector, b = predictor result). Order-free, so
+/// deterministic for any thread count.
+template <typename Real>
+double max_distance(std::span<const Real> ax, std::span<const Real> ay,
+    std::span<const Real> az, std::span<const Real> bx,
+    std::span<const Real> by, std::span<const Real> bz);
+
+/// Bulk exchange, anisotropy and thermal field averages per species of the
+/// moments m: exchange and anisotropy are computed per site inside the
+/// reduction blocks, so no per-site field arrays are needed. Instantiated
+/// for the three policies.
+template <typename P>
+void compute_bulk_fields_from_m(const MatParams mat[2],
+    const double J_joule_per_link[2][2],
+    const FccNeighbors& neighbors,
+    const std::vector<uint8_t>& species,
+    std::span<const typename P::real> mx,
+    std::span<const typename P::real> my,
+    std::span<const typename P::real> mz,
+    std::span<const typename P::real> Hx_ther_tesla,
+    std::span<const typename P::real> Hy_ther_tesla,
+    std::span<const typename P::real> Hz_ther_tesla,
+    BulkFields& bulk_fields,
+    const SitePermutation* perm = nullptr);
 
 #endif //REDUCTIONS_H
@@ -1,6 +1,8 @@
 #ifndef RNG_H
 #define RNG_H
+#include <array>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
 #include <random>
 
@@ -17,4 +19,74 @@ struct RNG {
     }
 };
 
+/** Philox4x32-10 counter-based generator (Salmon et al., SC'11).
+ *  A pure function of (counter, key): no state, so any thread can draw the
+ *  numbers of any (step, site) independently and in any order. */
+struct Philox4x32 {
+    using Counter = std::array<uint32_t, 4>;
+    using Key     = std::array<uint32_t, 2>;
+
+    static Counter generate(Counter ctr, Key key) {
+        constexpr uint32_t M0 = 0xD2511F53u, M1 = 0xCD9E8D57u;
+        constexpr uint32_t W0 = 0x9E3779B9u, W1 = 0xBB67AE85u;
+        for (int round = 0; round < 10; ++round) {
+            const uint64_t p0 = static_cast<uint64_t>(M0) * ctr[0];
+            const uint64_t p1 = static_cast<uint64_t>(M1) * ctr[2];
+            ctr = {static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0],
+                   static_cast<uint32_t>(p1),
+                   static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1],
+                   static_cast<uint32_t>(p0)};
+            key[0] += W0;
+            key[1] += W1;
+        }
+        return ctr;
+    }
+};
+
+/** Standard normals keyed by (seed, stream, step, site).
+ *  One Philox call per (step, site) gives four 32-bit uniforms, turned into
+ *  four normals by Box-Muller; components x, y, z use the first three.
+ *  stream separates independent trajectories sharing one seed. */
+struct CounterRNG {
+    uint32_t seed{0};
+    uint32_t stream{0};
+
+    CounterRNG() = default;
+    explicit CounterRNG(const uint32_t seed_, const uint32_t stream_ = 0)
+        : seed(seed_), stream(stream_) {}
+
+    void normal3(const uint64_t step, const uint64_t site,
+        double& zx, double& zy, double& zz) const
+    {
+        const Philox4x32::Counter r = Philox4x32::generate(
+            {static_cast<uint32_t>(site), static_cast<uint32_t>(site >> 32),
+             static_cast<uint32_t>(step), static_cast<uint32_t>(step >> 32)},
+            {seed, stream});
+
+        // Uniforms in (0, 1): never 0, so log() is finite.
+        constexpr double TWO_POW_M32 = 1.0 / 4294967296.0;
+        constexpr double TWO_PI = 6.283185307179586;
+        const double u0 = (r[0] + 0.5) * TWO_POW_M32;
+        const double u1 = (r[1] + 0.5) * TWO_POW_M32;
+        const double u2 = (r[2] + 0.5) * TWO_POW_M32;
+        const double u3 = (r[3] + 0.5) * TWO_POW_M32;
+
+        const double rad0 = std::sqrt(-2.0 * std::log(u0));
+        const double rad1 = std::sqrt(-2.0 * std::log(u2));
+        zx = rad0 * std::cos(TWO_PI * u1);
+        zy = rad0 * std::sin(TWO_PI * u1);
+        zz = rad1 * std::cos(TWO_PI * u3);
+    }
+
+    /// Four uniforms in (0, 1) keyed by (step, site), as normal3 draws them.
+    void uniform4(const uint64_t step, const uint64_t site, double u[4]) const {
+        const Philox4x32::Counter r = Philox4x32::generate(
+            {static_cast<uint32_t>(site), static_cast<uint32_t>(site >> 32),
+             static_cast<uint32_t>(step), static_cast<uint32_t>(step >> 32)},
+            {seed, stream});
+        constexpr double TWO_POW_M32 = 1.0 / 4294967296.0;
+        for (int c = 0; c < 4; ++c) u[c] = (r[c] + 0.5) * TWO_POW_M32;
+    }
+};
+
 #endif //RNG_H
@@ -0,0 +1,48 @@
+#include "save_cadence.h"
+#include <algorithm>
+#include <cmath>
+
+SaveCadence::SaveCadence(const ControlParams& control,
+    const std::vector<double>& Te_kelvin_arr)
+    : Te_kelvin_arr_(Te_kelvin_arr),
+      pre_steps_(control.pre_steps),
+      pre_Te_kelvin_(control.pre_Te_kelvin),
+      dt_ps_(control.dt_sec * 1e12),
+      save_(control.save_steps),
+      fast_(control.save_steps_fast),
+      dm_dt_per_ps_(control.save_dm_dt_per_ps),
+      dT_dt_kelvin_per_ps_(control.save_dT_dt_kelvin_per_ps)
+{}
+
+double SaveCadence::T_kelvin(const int step) const {
+    if (step < pre_steps_ || Te_kelvin_arr_.empty()) return pre_Te_kelvin_;
+    const std::size_t i = std::min<std::size_t>(
+        static_cast<std::size_t>(step - pre_steps_), Te_kelvin_arr_.size() - 1);
+    return Te_kelvin_arr_[i];
+}
+
+bool SaveCadence::save(const int step, const BulkValues& bulk) {
+    if (fast_ <= 0) return step % save_ == 0;
+    const double m[6] = {bulk.mx_Fe, bulk.my_Fe, bulk.mz_Fe,
+        bulk.mx_Gd, bulk.my_Gd, bulk.mz_Gd};
+    bool fast = false;
+    if (state_.probe_step >= 0 && state_.probe_step < step) {
+        const double span_ps = static_cast<double>(step - state_.probe_step)
+            * dt_ps_;
+        double dm2[2] = {0.0, 0.0};
+        for (int c = 0; c < 6; ++c) {
+            const double d = m[c] - state_.m[c];
+            dm2[c / 3] += d*d;
+        }
+        fast = std::sqrt(std::max(dm2[0], dm2[1])) / span_ps > dm_dt_per_ps_;
+    }
+    const double T = T_kelvin(step);
+    const double interval_ps = fast_ * dt_ps_;
+    fast = fast ||
+        std::abs(T - T_kelvin(step - fast_)) / interval_ps > dT_dt_kelvin_per_ps_ ||
+        std::abs(T_kelvin(step + fast_) - T) / interval_ps > dT_dt_kelvin_per_ps_;
+    if (fast) state_.fast_until = static_cast<int64_t>(step) + save_;
+    state_.probe_step = step;
+    std::copy(m, m + 6, state_.m);
+    return step % save_ == 0 || step <= state_.fast_until;
+}
@@ -0,0 +1,53 @@
+#ifndef SAVE_CADENCE_H
+#define SAVE_CADENCE_H
+#include <cstdint>
+#include <vector>
+#include "params.h"
+
+/// Which steps write a bulk row. Fixed cadence: every save_steps. Adaptive
+/// (save_steps_fast > 0): the bulk m is probed every save_steps_fast steps
+/// (one compute_bulk_m, no fields) and a probe is written while the run is
+/// fast, that is within save_steps steps after a probe where
+/// - max(|dm_Fe|, |dm_Gd|)/dt since the previous probe exceeds
+///   save_dm_dt_per_ps, or
+/// - |dT/dt| over the previous or the next probe interval exceeds
+///   save_dT_dt_kelvin_per_ps (the temperatures are known ahead, so the
+///   fast cadence starts before a pulse arrives).
+/// Every save_steps-th step is written in either mode.
+class SaveCadence {
+public:
+    /// What the decisions depend on besides the current step; a checkpoint
+    /// carries it so a restart writes the same rows.
+    struct State {
+        int64_t probe_step{-1};   // last probe, -1 = none yet
+        int64_t fast_until{-1};   // probes up to this step are written
+        double m[6]{};            // m_Fe, m_Gd of the last probe
+    };
+
+    SaveCadence(const ControlParams& control,
+        const std::vector<double>& Te_kelvin_arr);
+
+    bool adaptive() const { return fast_ > 0; }
+    /// Whether step needs the bulk m (a probe or a fixed save step).
+    bool probe_due(const int step) const {
+        return step % save_ == 0 || (fast_ > 0 && step % fast_ == 0);
+    }
+    /// For a probe_due step: whether to write its row, given its bulk m.
+    bool save(int step, const BulkValues& bulk);
+
+    const State& state() const { return state_; }
+    void restore(const State& s) { state_ = s; }
+
+private:
+    double T_kelvin(int step) const;
+
+    const std::vector<double>& Te_kelvin_arr_;
+    int pre_steps_;
+    double pre_Te_kelvin_;
+    double dt_ps_;
+    int save_, fast_;
+    double dm_dt_per_ps_, dT_dt_kelvin_per_ps_;
+    State state_;
+};
+
+#endif //SAVE_CADENCE_H
@@ -0,0 +1,24 @@
+#include "shutdown.h"
+#include <atomic>
+#include <csignal>
+
+namespace {
+    std::atomic<int> g_signal{0};
+    static_assert(std::atomic<int>::is_always_lock_free);
+
+    extern "C" void on_signal(const int sig) {
+        g_signal.store(sig, std::memory_order_relaxed);
+        std::signal(sig, SIG_DFL); // the next one is not caught
+    }
+}
+
+namespace shutdown {
+    void install_handlers() {
+        std::signal(SIGINT, on_signal);
+        std::signal(SIGTERM, on_signal);
+    }
+
+    int requested() {
+        return g_signal.load(std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef SHUTDOWN_H
+#define SHUTDOWN_H
+
+/// Orderly stop on SIGINT / SIGTERM: the handler only records the signal;
+/// the time loop polls requested() once per step, finishes the step, writes
+/// a checkpoint (if checkpointing) and returns, so the output writers flush
+/// in their destructors. A second signal terminates at once.
+namespace shutdown {
+    void install_handlers();
+    /// Signal number received, 0 if none.
+    int requested();
+}
+
+#endif //SHUTDOWN_H
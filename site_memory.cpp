@@ -0,0 +1,139 @@
+#include "site_memory.h"
+#include <cstdint>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr std::size_t HUGE_PAGE_BYTES = std::size_t(2) << 20;
+    constexpr std::size_t SMALL_ALIGN_BYTES = 64;
+
+    NumaPolicy g_policy = NumaPolicy::FIRST_TOUCH;
+    unsigned long g_node_mask = 0;
+
+    /// Mapped size of an allocation of bytes bytes.
+    std::size_t mapped_bytes(const std::size_t bytes) {
+        const std::size_t unit = (bytes >= HUGE_PAGE_BYTES) ?
+            HUGE_PAGE_BYTES : 4096;
+        return (std::max<std::size_t>(bytes, 1) + unit - 1) / unit * unit;
+    }
+
+#ifdef __linux__
+    /// Bit mask of the online NUMA nodes ("0-1,3" in sysfs); node 0 if
+    /// unknown. Nodes >= 64 are ignored.
+    unsigned long online_nodes() {
+        std::ifstream ifs("/sys/devices/system/node/online");
+        std::string list;
+        if (!(ifs >> list)) return 1ul;
+        unsigned long mask = 0;
+        std::stringstream ss(list);
+        std::string range;
+        while (std::getline(ss, range, ',')) {
+            const std::size_t dash = range.find('-');
+            const int lo = std::stoi(range.substr(0, dash));
+            const int hi = (dash == std::string::npos) ? lo :
+                std::stoi(range.substr(dash + 1));
+            for (int n = lo; n <= hi && n < 64; ++n) mask |= 1ul << n;
+        }
+        return mask ? mask : 1ul;
+    }
+
+    bool apply_policy(void* p, const std::size_t len) {
+        if (g_policy == NumaPolicy::FIRST_TOUCH) return true;
+        const int mode = (g_policy == NumaPolicy::INTERLEAVE) ?
+            MPOL_INTERLEAVE : MPOL_BIND;
+        return syscall(SYS_mbind, p, len, mode, &g_node_mask,
+            8 * sizeof(g_node_mask), 0) == 0;
+    }
+#endif
+}
+
+namespace site_memory {
+    bool configure(const NumaPolicy policy, const int node) {
+        g_policy = NumaPolicy::FIRST_TOUCH;
+        if (policy == NumaPolicy::FIRST_TOUCH) return true;
+#ifdef __linux__
+        if (policy == NumaPolicy::BIND && (node < 0 || node >= 64)) return false;
+        g_node_mask = (policy == NumaPolicy::INTERLEAVE) ?
+            online_nodes() : (1ul << node);
+        g_policy = policy;
+        // Probe with one page, so an invalid node fails here, not later.
+        void* probe = mmap(nullptr, 4096, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        const bool ok = (probe != MAP_FAILED) && apply_policy(probe, 4096);
+        if (probe != MAP_FAILED) munmap(probe, 4096);
+        if (!ok) g_policy = NumaPolicy::FIRST_TOUCH;
+        return ok;
+#else
+        (void)node;
+        return false;
+#endif
+    }
+
+    const char* policy_name() {
+        switch (g_policy) {
+            case NumaPolicy::INTERLEAVE: return "interleave";
+            case NumaPolicy::BIND:       return "bind";
+            default:                     return "first_touch";
+        }
+    }
+
+    const char* huge_page_mode() {
+        std::ifstream ifs("/sys/kernel/mm/transparent_hugepage/enabled");
+        std::string modes;
+        if (!std::getline(ifs, modes)) return "n/a";
+        if (modes.find("[always]") != std::string::npos) return "always";
+        if (modes.find("[madvise]") != std::string::npos) return "madvise";
+        if (modes.find("[never]") != std::string::npos) return "never";
+        return "n/a";
+    }
+
+    void* allocate(const std::size_t bytes) {
+        const std::size_t len = mapped_bytes(bytes);
+#ifdef __linux__
+        if (len < HUGE_PAGE_BYTES) {
+            void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED) throw std::bad_alloc();
+            apply_policy(p, len);
+            return p;
+        }
+        // Over-map by one huge page, then trim to a 2 MiB aligned range.
+        void* raw = mmap(nullptr, len + HUGE_PAGE_BYTES,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) throw std::bad_alloc();
+        const auto base = reinterpret_cast<std::uintptr_t>(raw);
+        const std::uintptr_t aligned =
+            (base + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+        if (aligned > base) munmap(raw, aligned - base);
+        const std::uintptr_t tail = aligned + len;
+        if (base + len + HUGE_PAGE_BYTES > tail) {
+            munmap(reinterpret_cast<void*>(tail),
+                base + len + HUGE_PAGE_BYTES - tail);
+        }
+        void* p = reinterpret_cast<void*>(aligned);
+        madvise(p, len, MADV_HUGEPAGE);
+        apply_policy(p, len);
+        return p;
+#else
+        return ::operator new(len, std::align_val_t{SMALL_ALIGN_BYTES});
+#endif
+    }
+
+    void release(void* p, const std::size_t bytes) {
+        if (!p) return;
+#ifdef __linux__
+        munmap(p, mapped_bytes(bytes));
+#else
+        ::operator delete(p, std::align_val_t{SMALL_ALIGN_BYTES});
+        (void)bytes;
+#endif
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef SITE_MEMORY_H
+#define SITE_MEMORY_H
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include "params.h"
+
+/// Memory of the large per-site arrays (spins, fields, neighbor table):
+/// anonymous mappings aligned to 2 MiB and advised for transparent huge
+/// pages, placed by the NUMA policy, and first touched in parallel with the
+/// static partition over cell rows that the fused kernels use, so with
+/// FIRST_TOUCH each thread's sites sit on its own node.
+namespace site_memory {
+    /// NUMA policy of later allocations. INTERLEAVE spreads over the online
+    /// nodes, BIND uses node. Returns false and keeps FIRST_TOUCH if the
+    /// kernel rejects the policy (no NUMA support, offline node).
+    bool configure(NumaPolicy policy, int node = 0);
+    const char* policy_name();
+    /// Transparent huge page mode of the system: always, madvise, never, n/a.
+    const char* huge_page_mode();
+
+    /// At least bytes bytes, not yet touched; 2 MiB aligned above 2 MiB.
+    void* allocate(std::size_t bytes);
+    void release(void* p, std::size_t bytes);
+
+    /// Fill p[0, n) (src[0, n) if given, else value) in parallel, rows of
+    /// row consecutive elements split statically over the threads.
+    template <typename T>
+    void first_touch(T* p, const std::size_t n, const std::size_t row,
+        const T& value, const T* src = nullptr)
+    {
+        const std::size_t r = std::max<std::size_t>(row, 1);
+        const long long n_rows = static_cast<long long>((n + r - 1) / r);
+        #pragma omp parallel for schedule(static)
+        for (long long k = 0; k < n_rows; ++k) {
+            const std::size_t begin = static_cast<std::size_t>(k) * r;
+            const std::size_t end = std::min(begin + r, n);
+            if (src) std::copy(src + begin, src + end, p + begin);
+            else     std::fill(p + begin, p + end, value);
+        }
+    }
+
+    /// Owning array of n T's in site memory (T trivially copyable).
+    template <typename T>
+    class SiteArray {
+    public:
+        SiteArray() = default;
+        /// Value-initialized, first touched in rows of row elements.
+        SiteArray(const std::size_t n, const std::size_t row) : n_(n) {
+            p_ = static_cast<T*>(allocate(n * sizeof(T)));
+            first_touch(p_, n, row, T{});
+        }
+        /// Copy of src, first touched in rows of row elements.
+        SiteArray(std::span<const T> src, const std::size_t row)
+            : n_(src.size())
+        {
+            p_ = static_cast<T*>(allocate(n_ * sizeof(T)));
+            first_touch(p_, n_, row, T{}, src.data());
+        }
+        ~SiteArray() { if (p_) release(p_, n_ * sizeof(T)); }
+        SiteArray(const SiteArray&) = delete;
+        SiteArray& operator=(const SiteArray&) = delete;
+        SiteArray(SiteArray&& o) noexcept : p_(o.p_), n_(o.n_) {
+            o.p_ = nullptr; o.n_ = 0;
+        }
+        SiteArray& operator=(SiteArray&& o) noexcept {
+            std::swap(p_, o.p_); std::swap(n_, o.n_);
+            return *this;
+        }
+
+        T* data() { return p_; }
+        const T* data() const { return p_; }
+        std::size_t size() const { return n_; }
+        std::size_t bytes() const { return n_ * sizeof(T); }
+        std::span<T> span() { return {p_, n_}; }
+        std::span<const T> span() const { return {p_, n_}; }
+
+    private:
+        T* p_{nullptr};
+        std::size_t n_{0};
+    };
+}
+
+#endif //SITE_MEMORY_H
@@ -0,0 +1,454 @@
+#include "snapshot.h"
+#include "binary_file.h"
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    constexpr char MAGIC[8] = {'G', 'D', 'F', 'E', 'S', 'N', 'P', '\0'};
+    constexpr char FRAME_MAGIC[4] = {'G', 'D', 'S', 'F'};
+    constexpr uint32_t VERSION = 1;
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t header_bytes; // this header; the species follow
+        int32_t nx, ny, nz;
+        uint32_t block_sites;
+        int64_t n_sites;
+    };
+    struct FrameHeader {
+        char magic[4];
+        int32_t key;            // 1 = keyframe, 0 = delta frame
+        int64_t step;
+        double T_kelvin;
+        uint64_t payload_bytes; // block size table and blocks
+        uint64_t checksum;      // binary_file::hash of the payload
+    };
+
+    uint64_t n_blocks_of(const SiteIndex N) {
+        return static_cast<uint64_t>((N + snapshot::BLOCK_SITES - 1) /
+            snapshot::BLOCK_SITES);
+    }
+
+    /// Zigzag code of the signed 16-bit difference a - ref (mod 2^16).
+    uint32_t zigzag(const uint32_t a, const uint32_t ref) {
+        const auto d = static_cast<int16_t>(static_cast<uint16_t>(a - ref));
+        return ((static_cast<uint32_t>(d) << 1) ^
+            static_cast<uint32_t>(d >> 15)) & 0xFFFFu;
+    }
+    uint32_t unzigzag(const uint32_t z, const uint32_t ref) {
+        const auto d = static_cast<int32_t>(z >> 1) ^ -static_cast<int32_t>(z & 1);
+        return static_cast<uint16_t>(ref + static_cast<uint32_t>(d));
+    }
+
+    /// Rice code: z >> k in unary (ones, then a zero), then the k low bits;
+    /// quotients >= RICE_ESCAPE are RICE_ESCAPE ones and the 16 raw bits.
+    constexpr uint32_t RICE_ESCAPE = 24;
+
+    /// Best Rice parameter for values of mean sum / n.
+    uint32_t rice_k(const uint64_t sum, const uint64_t n) {
+        uint32_t k = 0;
+        while (k < 15 && (uint64_t(1) << (k + 1)) * n <= sum) ++k;
+        return k;
+    }
+
+    class BitWriter {
+    public:
+        explicit BitWriter(std::vector<uint8_t>& out) : out_(out) {}
+        void put(const uint64_t bits, const int n) { // n <= 32
+            acc_ |= bits << fill_;
+            fill_ += n;
+            while (fill_ >= 8) {
+                out_.push_back(static_cast<uint8_t>(acc_));
+                acc_ >>= 8;
+                fill_ -= 8;
+            }
+        }
+        void rice(const uint32_t z, const uint32_t k) {
+            const uint32_t q = z >> k;
+            if (q >= RICE_ESCAPE) {
+                put((uint64_t(1) << RICE_ESCAPE) - 1, RICE_ESCAPE);
+                put(z, 16);
+                return;
+            }
+            put((uint64_t(1) << q) - 1, static_cast<int>(q) + 1); // q ones, 0
+            put(z & ((1u << k) - 1), static_cast<int>(k));
+        }
+        void finish() { if (fill_ > 0) put(0, 8 - fill_); }
+    private:
+        std::vector<uint8_t>& out_;
+        uint64_t acc_{0};
+        int fill_{0};
+    };
+
+    class BitReader {
+    public:
+        BitReader(const uint8_t* p, const uint8_t* end) : p_(p), end_(end) {}
+        /// False past the end.
+        bool get(const int n, uint32_t& bits) {
+            while (fill_ < n) {
+                if (p_ == end_) return false;
+                acc_ |= static_cast<uint64_t>(*p_++) << fill_;
+                fill_ += 8;
+            }
+            bits = static_cast<uint32_t>(acc_ & ((uint64_t(1) << n) - 1));
+            acc_ >>= n;
+            fill_ -= n;
+            return true;
+        }
+        bool rice(const uint32_t k, uint32_t& z) {
+            uint32_t q = 0, bit = 0;
+            while (q < RICE_ESCAPE) {
+                if (!get(1, bit)) return false;
+                if (!bit) break;
+                ++q;
+            }
+            if (q == RICE_ESCAPE) return get(16, z);
+            uint32_t low = 0;
+            if (k > 0 && !get(static_cast<int>(k), low)) return false;
+            z = (q << k) | low;
+            return true;
+        }
+    private:
+        const uint8_t* p_;
+        const uint8_t* end_;
+        uint64_t acc_{0};
+        int fill_{0};
+    };
+
+    /// Frames of the file and the end of the last intact one. Only the last
+    /// frame's checksum is checked here: only it can be damaged by a crash.
+    struct Scan {
+        FileHeader header{};
+        std::vector<uint8_t> species;
+        std::vector<std::pair<FrameHeader, uint64_t>> frames; // header, offset
+        uint64_t valid_bytes{0};
+    };
+
+    Scan scan(const std::string& path, const char* who) {
+        std::ifstream ifs(path, std::ios::binary);
+        const auto fail = [&](const std::string& why) {
+            throw std::runtime_error(std::string(who) + ": " + path + ": " + why);
+        };
+        if (!ifs) fail("cannot open the file");
+        Scan sc;
+        const uint64_t file_bytes = std::filesystem::file_size(path);
+        if (!ifs.read(reinterpret_cast<char*>(&sc.header), sizeof(FileHeader)) ||
+            std::memcmp(sc.header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            sc.header.version != VERSION ||
+            sc.header.header_bytes != sizeof(FileHeader) ||
+            sc.header.n_sites < 0 ||
+            sizeof(FileHeader) + static_cast<uint64_t>(sc.header.n_sites) >
+                file_bytes) {
+            fail("not a snapshot file of this version");
+        }
+        sc.species.resize(static_cast<std::size_t>(sc.header.n_sites));
+        ifs.read(reinterpret_cast<char*>(sc.species.data()),
+            static_cast<std::streamsize>(sc.species.size()));
+        uint64_t pos = sizeof(FileHeader) + sc.species.size();
+        for (;;) {
+            FrameHeader fh;
+            if (pos + sizeof(fh) > file_bytes) break;
+            ifs.seekg(static_cast<std::streamoff>(pos));
+            if (!ifs.read(reinterpret_cast<char*>(&fh), sizeof(fh)) ||
+                std::memcmp(fh.magic, FRAME_MAGIC, sizeof(FRAME_MAGIC)) != 0 ||
+                fh.payload_bytes > file_bytes - pos - sizeof(fh)) {
+                break;
+            }
+            sc.frames.emplace_back(fh, pos + sizeof(fh));
+            pos += sizeof(fh) + fh.payload_bytes;
+        }
+        if (!sc.frames.empty()) {
+            const auto& [fh, offset] = sc.frames.back();
+            std::vector<char> payload(fh.payload_bytes);
+            ifs.clear();
+            ifs.seekg(static_cast<std::streamoff>(offset));
+            if (!ifs.read(payload.data(),
+                    static_cast<std::streamsize>(payload.size())) ||
+                binary_file::hash(payload.data(), payload.size()) != fh.checksum) {
+                pos = offset - sizeof(FrameHeader);
+                sc.frames.pop_back();
+            }
+        }
+        sc.valid_bytes = pos;
+        return sc;
+    }
+}
+
+namespace snapshot {
+    Writer::Writer(const std::string& path, const int nx, const int ny,
+        const int nz, const std::vector<uint8_t>& species,
+        const SitePermutation* perm, const int keyframe_every,
+        const int row_sites)
+        : path_(path), perm_(perm),
+          N_(static_cast<SiteIndex>(species.size())),
+          keyframe_every_(std::max(keyframe_every, 1)), row_sites_(row_sites),
+          staging_(static_cast<std::size_t>(N_)),
+          current_(static_cast<std::size_t>(N_)),
+          previous_(static_cast<std::size_t>(N_))
+    {
+        try {
+            if (const std::filesystem::path p(path_); !p.parent_path().empty()) {
+                std::filesystem::create_directories(p.parent_path());
+            }
+        } catch (const std::exception& e) {
+            throw std::runtime_error(std::string(
+                "snapshot:Writer: Failed to create directories: ") + e.what());
+        }
+        species_ = perm ? to_lattice_order(*perm, species) : species;
+        for (uint8_t& sp : species_) sp = sp ? 1 : 0;
+        FileHeader h{};
+        std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+        h.version = VERSION;
+        h.header_bytes = sizeof(FileHeader);
+        h.nx = nx; h.ny = ny; h.nz = nz;
+        h.block_sites = static_cast<uint32_t>(BLOCK_SITES);
+        h.n_sites = N_;
+
+        const bool fresh = !std::filesystem::exists(path_) ||
+            std::filesystem::file_size(path_) == 0;
+        if (!fresh) {
+            // Append: same lattice, and a frame damaged by a crash is cut off.
+            const Scan sc = scan(path_, "snapshot:Writer");
+            if (std::memcmp(&sc.header, &h, sizeof(h)) != 0 ||
+                sc.species != species_) {
+                throw std::runtime_error("snapshot:Writer: " + path_ +
+                    " holds another lattice");
+            }
+            if (sc.valid_bytes < std::filesystem::file_size(path_)) {
+                std::filesystem::resize_file(path_, sc.valid_bytes);
+            }
+        }
+        ofs_.open(path_, std::ios::out | std::ios::app | std::ios::binary);
+        if (!ofs_) {
+            throw std::runtime_error(
+                "snapshot:Writer: Failed to open file: " + path_);
+        }
+        if (fresh) {
+            ofs_.write(reinterpret_cast<const char*>(&h), sizeof(h));
+            ofs_.write(reinterpret_cast<const char*>(species_.data()),
+                static_cast<std::streamsize>(species_.size()));
+            ofs_.flush();
+        }
+        thread_ = std::thread(&Writer::run, this);
+    }
+
+    Writer::~Writer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    template <typename Real>
+    void Writer::submit(const int step, const double T_kelvin,
+        std::span<const Real> mx, std::span<const Real> my,
+        std::span<const Real> mz)
+    {
+        {
+            // The thread takes the staging buffer as soon as it is free, so
+            // this waits only while two frames are ahead of the disk.
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return !pending_; });
+        }
+        const std::size_t row = static_cast<std::size_t>(
+            std::max(row_sites_, 1));
+        const long long n_rows = static_cast<long long>(
+            (static_cast<std::size_t>(N_) + row - 1) / row);
+        #pragma omp parallel for schedule(static)
+        for (long long r = 0; r < n_rows; ++r) {
+            const SiteIndex begin = static_cast<SiteIndex>(r * row);
+            const SiteIndex end = std::min<SiteIndex>(begin +
+                static_cast<SiteIndex>(row), N_);
+            for (SiteIndex p = begin; p < end; ++p) {
+                const SiteIndex s = perm_ ? perm_->to_site[p] : p;
+                staging_[p] = encode(mx[s], my[s], mz[s]);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            step_ = step;
+            T_kelvin_ = T_kelvin;
+            pending_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    template void Writer::submit<double>(int, double, std::span<const double>,
+        std::span<const double>, std::span<const double>);
+    template void Writer::submit<float>(int, double, std::span<const float>,
+        std::span<const float>, std::span<const float>);
+
+    void Writer::encode_current(const bool key) {
+        const uint64_t n_blocks = n_blocks_of(N_);
+        out_.assign(n_blocks*sizeof(uint32_t), 0);
+        std::vector<uint32_t> zu(static_cast<std::size_t>(BLOCK_SITES));
+        std::vector<uint32_t> zv(static_cast<std::size_t>(BLOCK_SITES));
+        for (uint64_t blk = 0; blk < n_blocks; ++blk) {
+            const SiteIndex begin = static_cast<SiteIndex>(blk)*BLOCK_SITES;
+            const SiteIndex end = std::min(begin + BLOCK_SITES, N_);
+            const std::size_t start = out_.size();
+            // Residuals: keyframe vs the previous site of the same species,
+            // delta frame vs the same site in the previous frame.
+            uint32_t ref[2] = {0, 0};
+            uint64_t sum_u = 0, sum_v = 0;
+            for (SiteIndex p = begin; p < end; ++p) {
+                const uint32_t q = current_[p];
+                const uint32_t r = key ? ref[species_[p]] : previous_[p];
+                zu[p - begin] = zigzag(q & 0xFFFFu, r & 0xFFFFu);
+                zv[p - begin] = zigzag(q >> 16, r >> 16);
+                sum_u += zu[p - begin];
+                sum_v += zv[p - begin];
+                ref[species_[p]] = q;
+            }
+            const uint64_t n = static_cast<uint64_t>(end - begin);
+            const uint32_t ku = rice_k(sum_u, n), kv = rice_k(sum_v, n);
+            out_.push_back(static_cast<uint8_t>(ku));
+            out_.push_back(static_cast<uint8_t>(kv));
+            BitWriter bits(out_);
+            for (uint64_t i = 0; i < n; ++i) {
+                bits.rice(zu[i], ku);
+                bits.rice(zv[i], kv);
+            }
+            bits.finish();
+            const auto bytes = static_cast<uint32_t>(out_.size() - start);
+            std::memcpy(out_.data() + blk*sizeof(uint32_t), &bytes,
+                sizeof(bytes));
+        }
+    }
+
+    void Writer::run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            cv_.wait(lock, [this] { return pending_ || stop_; });
+            if (!pending_) return;
+            std::swap(staging_, current_);
+            const int step = step_;
+            const double T_kelvin = T_kelvin_;
+            pending_ = false;
+            cv_.notify_all();
+            lock.unlock();
+
+            // The first frame after opening is a keyframe, so a file
+            // appended to by a restart decodes without the earlier run.
+            const bool key = frames_ % keyframe_every_ == 0;
+            encode_current(key);
+            FrameHeader fh{};
+            std::memcpy(fh.magic, FRAME_MAGIC, sizeof(FRAME_MAGIC));
+            fh.key = key ? 1 : 0;
+            fh.step = step;
+            fh.T_kelvin = T_kelvin;
+            fh.payload_bytes = out_.size();
+            fh.checksum = binary_file::hash(out_.data(), out_.size());
+            ofs_.write(reinterpret_cast<const char*>(&fh), sizeof(fh));
+            ofs_.write(reinterpret_cast<const char*>(out_.data()),
+                static_cast<std::streamsize>(out_.size()));
+            ofs_.flush();
+            if (!ofs_) {
+                std::cerr << "Warning: snapshot:Writer: Failed to write "
+                          << path_ << "\n";
+                ofs_.clear();
+            }
+            std::swap(current_, previous_);
+            ++frames_;
+            lock.lock();
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    Reader::Reader(const std::string& path) : path_(path) {
+        const Scan sc = scan(path, "snapshot:read");
+        nx_ = sc.header.nx; ny_ = sc.header.ny; nz_ = sc.header.nz;
+        N_ = sc.header.n_sites;
+        if (sc.header.block_sites != BLOCK_SITES ||
+            static_cast<SiteIndex>(count_fcc_sites(nx_, ny_, nz_)) != N_) {
+            throw std::runtime_error("snapshot:read: " + path +
+                ": inconsistent header");
+        }
+        species_ = sc.species;
+        for (const auto& [fh, offset] : sc.frames) {
+            frames_.push_back({static_cast<int>(fh.step), fh.T_kelvin,
+                fh.key != 0, offset, fh.payload_bytes, fh.checksum});
+        }
+    }
+
+    void Reader::decode_frame(const int f, std::vector<uint32_t>& q) const {
+        const Frame& fr = frames_[f];
+        const auto fail = [&](const std::string& why) {
+            throw std::runtime_error("snapshot:read: " + path_ + ": frame " +
+                std::to_string(f) + ": " + why);
+        };
+        std::ifstream ifs(path_, std::ios::binary);
+        std::vector<uint8_t> payload(fr.payload_bytes);
+        ifs.seekg(static_cast<std::streamoff>(fr.offset));
+        if (!ifs.read(reinterpret_cast<char*>(payload.data()),
+                static_cast<std::streamsize>(payload.size())) ||
+            binary_file::hash(payload.data(), payload.size()) != fr.checksum) {
+            fail("checksum mismatch");
+        }
+        const uint64_t n_blocks = n_blocks_of(N_);
+        if (payload.size() < n_blocks*sizeof(uint32_t)) fail("truncated");
+        q.resize(static_cast<std::size_t>(N_));
+        const uint8_t* p = payload.data() + n_blocks*sizeof(uint32_t);
+        const uint8_t* const end = payload.data() + payload.size();
+        for (uint64_t blk = 0; blk < n_blocks; ++blk) {
+            uint32_t bytes;
+            std::memcpy(&bytes, payload.data() + blk*sizeof(uint32_t),
+                sizeof(bytes));
+            if (bytes > static_cast<uint64_t>(end - p)) fail("truncated");
+            const uint8_t* const block_end = p + bytes;
+            const SiteIndex begin = static_cast<SiteIndex>(blk)*BLOCK_SITES;
+            const SiteIndex stop = std::min(begin + BLOCK_SITES, N_);
+            if (bytes < 2) fail("corrupt block");
+            const uint32_t ku = p[0], kv = p[1];
+            if (ku > 15 || kv > 15) fail("corrupt block");
+            BitReader bits(p + 2, block_end);
+            uint32_t ref[2] = {0, 0};
+            for (SiteIndex s = begin; s < stop; ++s) {
+                const uint8_t sp = species_[s] ? 1 : 0;
+                const uint32_t r = fr.key ? ref[sp] : q[s];
+                uint32_t zu, zv;
+                if (!bits.rice(ku, zu) || !bits.rice(kv, zv)) {
+                    fail("corrupt block");
+                }
+                q[s] = unzigzag(zu, r & 0xFFFFu) | (unzigzag(zv, r >> 16) << 16);
+                ref[sp] = q[s];
+            }
+            p = block_end;
+        }
+    }
+
+    std::vector<uint32_t> Reader::codes(const int f) const {
+        if (f < 0 || f >= frame_count()) {
+            throw std::runtime_error("snapshot:read: no frame " +
+                std::to_string(f));
+        }
+        int key = f;
+        while (key > 0 && !frames_[key].key) --key;
+        if (!frames_[key].key) {
+            throw std::runtime_error("snapshot:read: frame " +
+                std::to_string(f) + " has no keyframe");
+        }
+        std::vector<uint32_t> q;
+        for (int g = key; g <= f; ++g) decode_frame(g, q);
+        return q;
+    }
+
+    void truncate(const std::string& path, const int from_step) {
+        if (!std::filesystem::exists(path)) return;
+        const Scan sc = scan(path, "snapshot:truncate");
+        uint64_t keep = sc.valid_bytes;
+        for (const auto& [fh, offset] : sc.frames) {
+            if (fh.step >= from_step) {
+                keep = offset - sizeof(FrameHeader);
+                break;
+            }
+        }
+        std::filesystem::resize_file(path, keep);
+    }
+}
@@ -0,0 +1,153 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lattice.h"
+#include "params.h"
+
+/// Spin configuration snapshots: every frame stores m of all sites as
+/// octahedral unit vectors (2 x 16 bits), in row-major lattice order
+/// p = (((i*ny + j)*nz + k)*4 + b), so invert_linear_index maps entry p back
+/// to (i, j, k, b) whatever the storage order of the run.
+///
+/// File: header (magic "GDFESNP", version, nx, ny, nz, N, block_sites),
+/// species of every site (N bytes, lattice order), then frames. A frame is a
+/// header (magic "GDSF", step, T, kind, payload bytes, checksum), the byte
+/// size of each block of block_sites sites, and the blocks. A block holds
+/// the Rice parameters k_u, k_v (one byte each), then per site the two
+/// 16-bit components as Rice codes of the zigzag difference to a prediction:
+/// keyframes predict from the previous site of the same species in the
+/// block (the sublattices are ordered within), delta frames from the same
+/// site in the previous frame (most spins move little). Frames are appended
+/// whole; a damaged last frame is skipped by readers and cut off by the
+/// next writer.
+namespace snapshot {
+    /// Octahedral encoding of a non-zero vector: (u, v) of the point where
+    /// the ray through it meets |x|+|y|+|z| = 1, the lower half folded out,
+    /// as 16-bit fixed point; packed u | v << 16. Error about 3e-5 rad.
+    inline uint32_t encode(const double x, const double y, const double z) {
+        const double l1 = std::abs(x) + std::abs(y) + std::abs(z);
+        if (!(l1 > 0.0)) return 0x7FFF7FFFu; // no direction: +z
+        double u = x / l1, v = y / l1;
+        if (z < 0.0) {
+            const double fu = (1.0 - std::abs(v)) * (u >= 0.0 ? 1.0 : -1.0);
+            const double fv = (1.0 - std::abs(u)) * (v >= 0.0 ? 1.0 : -1.0);
+            u = fu; v = fv;
+        }
+        const auto q = [](const double t) {
+            return static_cast<uint32_t>(std::lround(
+                std::clamp((t + 1.0) * 0.5, 0.0, 1.0) * 65535.0));
+        };
+        return q(u) | (q(v) << 16);
+    }
+
+    /// Unit vector of a code of encode().
+    inline void decode(const uint32_t code, double& x, double& y, double& z) {
+        const double u = (code & 0xFFFFu) / 65535.0 * 2.0 - 1.0;
+        const double v = (code >> 16) / 65535.0 * 2.0 - 1.0;
+        x = u; y = v; z = 1.0 - std::abs(u) - std::abs(v);
+        if (z < 0.0) {
+            x = (1.0 - std::abs(v)) * (u >= 0.0 ? 1.0 : -1.0);
+            y = (1.0 - std::abs(u)) * (v >= 0.0 ? 1.0 : -1.0);
+        }
+        const double n = std::sqrt(x*x + y*y + z*z);
+        x /= n; y /= n; z /= n;
+    }
+
+    constexpr SiteIndex BLOCK_SITES = 4096;
+
+    /// Appends frames to a snapshot file. submit() encodes m into a staging
+    /// buffer with the loop's threads (gathered into lattice order) and
+    /// returns; a background thread compresses and writes it, keeping the
+    /// previous frame for the delta. submit waits only if the previous
+    /// frame is still being written.
+    class Writer {
+    public:
+        /// species in site order. Appending to an existing file requires the
+        /// same lattice. keyframe_every = n: every n-th frame is a keyframe
+        /// (1 = no delta frames). Throws std::runtime_error.
+        Writer(const std::string& path, int nx, int ny, int nz,
+            const std::vector<uint8_t>& species, const SitePermutation* perm,
+            int keyframe_every, int row_sites);
+        ~Writer();
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        template <typename Real>
+        void submit(int step, double T_kelvin, std::span<const Real> mx,
+            std::span<const Real> my, std::span<const Real> mz);
+
+    private:
+        void run();
+        void encode_current(bool key);
+
+        std::string path_;
+        const SitePermutation* perm_;
+        SiteIndex N_;
+        int keyframe_every_;
+        int row_sites_;
+        std::vector<uint8_t> species_; // lattice order
+        std::ofstream ofs_;
+        std::vector<uint32_t> staging_, current_, previous_;
+        std::vector<uint8_t> out_;
+        int frames_{0};       // frames since the file was opened
+        int step_{0};
+        double T_kelvin_{0.0};
+        bool pending_{false};
+        bool stop_{false};
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::thread thread_;
+    };
+
+    /// Frames of a snapshot file; each frame is read when decoded.
+    class Reader {
+    public:
+        /// Throws std::runtime_error("snapshot:read: ...").
+        explicit Reader(const std::string& path);
+
+        int nx() const { return nx_; }
+        int ny() const { return ny_; }
+        int nz() const { return nz_; }
+        SiteIndex n_sites() const { return N_; }
+        /// Species of lattice site p (0 = Fe, 1 = Gd).
+        const std::vector<uint8_t>& species() const { return species_; }
+        int frame_count() const { return static_cast<int>(frames_.size()); }
+        int frame_step(int f) const { return frames_[f].step; }
+        double frame_T_kelvin(int f) const { return frames_[f].T_kelvin; }
+        /// Codes of frame f in lattice order (decoding from its keyframe).
+        std::vector<uint32_t> codes(int f) const;
+
+    private:
+        struct Frame {
+            int step;
+            double T_kelvin;
+            bool key;
+            uint64_t offset;        // of the block size table in the file
+            uint64_t payload_bytes; // table and blocks
+            uint64_t checksum;
+        };
+        /// Apply frame f to q (q = frame f - 1 for a delta frame).
+        void decode_frame(int f, std::vector<uint32_t>& q) const;
+
+        std::string path_;
+        int nx_{0}, ny_{0}, nz_{0};
+        SiteIndex N_{0};
+        std::vector<uint8_t> species_;
+        std::vector<Frame> frames_;
+    };
+
+    /// Drop the frames of step >= from_step (a restart writes them again).
+    /// No-op if the file does not exist.
+    void truncate(const std::string& path, int from_step);
+}
+
+#endif //SNAPSHOT_H
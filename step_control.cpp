@@ -0,0 +1,61 @@
+#include "step_control.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+StepControl::StepControl(const ControlParams& control,
+    const std::vector<double>& Te_kelvin_arr)
+    : Te_kelvin_arr_(Te_kelvin_arr),
+      pre_steps_(control.pre_steps),
+      pre_Te_kelvin_(control.pre_Te_kelvin),
+      tol_(control.dt_tol),
+      h_min_(control.dt_min_sec / control.dt_sec),
+      h_max_(control.dt_max_sec / control.dt_sec),
+      max_dT_kelvin_(control.dt_max_dT_kelvin)
+{
+    // The first step is dt_sec within the bounds, so that accept's clamp
+    // range [h / 2, 2 h_prev] is never empty.
+    if (adaptive()) state_.h = std::clamp(state_.h, h_min_, h_max_);
+}
+
+double StepControl::T_kelvin(const double s) const {
+    if (s < pre_steps_ || Te_kelvin_arr_.empty()) return pre_Te_kelvin_;
+    const double x = s - pre_steps_;
+    const std::size_t last = Te_kelvin_arr_.size() - 1;
+    const std::size_t i = std::min(static_cast<std::size_t>(x), last);
+    if (i == last) return Te_kelvin_arr_[last];
+    const double w = x - static_cast<double>(i);
+    if (w == 0.0) return Te_kelvin_arr_[i];
+    return Te_kelvin_arr_[i] + w * (Te_kelvin_arr_[i + 1] - Te_kelvin_arr_[i]);
+}
+
+double StepControl::next(const double s, const int event) const {
+    if (!adaptive()) return 1.0;
+    double h = std::clamp(state_.h, h_min_, h_max_);
+    // T is piecewise linear between whole positions: the first whole one
+    // past the allowed change ends the step, else the end point is checked.
+    const double T0 = T_kelvin(s);
+    for (double j = std::floor(s) + 1.0; j < s + h; j += 1.0) {
+        if (std::abs(T_kelvin(j) - T0) > max_dT_kelvin_) {
+            h = std::max(h_min_, j - s);
+            break;
+        }
+    }
+    while (h > h_min_ && std::abs(T_kelvin(s + h) - T0) > max_dT_kelvin_) {
+        h = std::max(h_min_, h / 2);
+    }
+    // Land on the event, without leaving a sliver before it.
+    const double left = event - s;
+    if (h >= left) return left;
+    if (left < 1.5 * h) return left / 2;
+    return h;
+}
+
+void StepControl::accept(const double h, const double err) {
+    ++state_.taken;
+    if (!adaptive()) return;
+    const double h_opt = err > 0.0 ? h * 0.9 * std::sqrt(tol_ / err) :
+        std::numeric_limits<double>::infinity();
+    const double h_next = std::clamp(h_opt, 0.5 * h, 2.0 * state_.h);
+    state_.h = std::clamp(h_next, h_min_, h_max_);
+}
@@ -0,0 +1,52 @@
+#ifndef STEP_CONTROL_H
+#define STEP_CONTROL_H
+#include <cstdint>
+#include <vector>
+#include "params.h"
+
+/// Step size of the time loop. Positions s are in units of dt_sec (step k of
+/// the fixed loop starts at s = k), so outputs keep their step numbers.
+/// Fixed (dt_tol = 0): every step is dt_sec. Adaptive (dt_tol > 0): after
+/// each step the local error max_i |m_corrector - m_predictor| (the Euler
+/// predictor against the Heun or Depondt result, O(dt^2)) sets the next
+/// step, dt *= clamp(0.9 sqrt(dt_tol / err), 1/2, 2) within [dt_min_sec,
+/// dt_max_sec] (landing steps may be shorter). Steps are not repeated: a
+/// rejected step would need the same thermal noise path at the shorter dt.
+/// A step is further limited to
+/// - land on the next event (output, snapshot or checkpoint step, end of
+///   the pre-steps or of the run), and
+/// - change the temperature by at most dt_max_dT_kelvin; T is the series
+///   interpolated at s, so a step never jumps over a pulse.
+class StepControl {
+public:
+    /// Carried by checkpoints, so a restart takes the same steps.
+    struct State {
+        double h{1.0};       // next step in units of dt_sec
+        int64_t taken{0};    // steps taken so far (Philox counter)
+    };
+
+    StepControl(const ControlParams& control,
+        const std::vector<double>& Te_kelvin_arr);
+
+    bool adaptive() const { return tol_ > 0.0; }
+    /// Temperature at position s: pre_Te_kelvin in the pre-steps, then the
+    /// series interpolated linearly (clamped at its end).
+    double T_kelvin(double s) const;
+    /// Length of the step from s (units of dt_sec), given the next event
+    /// (a whole position > s). Fixed: 1.
+    double next(double s, int event) const;
+    /// Count the step h just taken; adaptive: its err sets the next step.
+    void accept(double h, double err);
+
+    const State& state() const { return state_; }
+    void restore(const State& s) { state_ = s; }
+
+private:
+    const std::vector<double>& Te_kelvin_arr_;
+    int pre_steps_;
+    double pre_Te_kelvin_;
+    double tol_, h_min_, h_max_, max_dT_kelvin_;
+    State state_;
+};
+
+#endif //STEP_CONTROL_H
@@ -0,0 +1,202 @@
+#include "sweep.h"
+#include "binary_file.h"
+#include "shutdown.h"
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <iomanip>
+#include <locale>
+#include <numeric>
+#include <thread>
+
+namespace sweep {
+    void run_jobs(const std::span<const double> cost, const int workers,
+        const int threads, const std::function<void(int job, int threads)>& fn)
+    {
+        const int n_jobs = static_cast<int>(cost.size());
+        std::vector<int> order(n_jobs);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+            return cost[a] > cost[b];
+        });
+
+        struct Queue {
+            std::mutex mutex;
+            std::deque<int> jobs;
+            double queued{0.0};
+        };
+        std::vector<Queue> queues(workers);
+        for (int k = 0; k < n_jobs; ++k) {
+            Queue& q = queues[k % workers];
+            q.jobs.push_back(order[k]);
+            q.queued += cost[order[k]];
+        }
+        // Own deque first (front), else the back of the fullest other one.
+        // Jobs are never added, so an empty pass means all are taken.
+        const auto take = [&](const int w, int& job) {
+            for (int victim = w; victim >= 0; ) {
+                {
+                    Queue& q = queues[victim];
+                    std::lock_guard lock(q.mutex);
+                    if (!q.jobs.empty()) {
+                        job = victim == w ? q.jobs.front() : q.jobs.back();
+                        if (victim == w) q.jobs.pop_front();
+                        else q.jobs.pop_back();
+                        q.queued -= cost[job];
+                        return true;
+                    }
+                }
+                victim = -1;
+                double most = 0.0;
+                for (int v = 0; v < workers; ++v) {
+                    if (v == w) continue;
+                    std::lock_guard lock(queues[v].mutex);
+                    if (!queues[v].jobs.empty() && (victim < 0 ||
+                        queues[v].queued > most)) {
+                        victim = v;
+                        most = queues[v].queued;
+                    }
+                }
+            }
+            return false;
+        };
+
+        std::mutex budget_mutex;
+        int free_threads = threads;
+        int idle_workers = workers;
+        std::vector<std::exception_ptr> errors(workers);
+        std::vector<std::thread> pool;
+        for (int w = 0; w < workers; ++w) {
+            pool.emplace_back([&, w] {
+                int job;
+                while (!shutdown::requested() && take(w, job)) {
+                    int claimed;
+                    {
+                        std::lock_guard lock(budget_mutex);
+                        claimed = std::max(1, free_threads / idle_workers);
+                        free_threads -= claimed;
+                        --idle_workers;
+                    }
+                    try {
+                        fn(job, claimed);
+                    }
+                    catch (...) {
+                        if (!errors[w]) errors[w] = std::current_exception();
+                    }
+                    std::lock_guard lock(budget_mutex);
+                    free_threads += claimed;
+                    ++idle_workers;
+                }
+                std::lock_guard lock(budget_mutex);
+                --idle_workers;
+            });
+        }
+        for (std::thread& t : pool) t.join();
+        for (const std::exception_ptr& e : errors) {
+            if (e) std::rethrow_exception(e);
+        }
+    }
+
+    Geometries::Geometries(const std::span<const Key> uses) {
+        for (const Key& k : uses) ++entries_[k].uses;
+    }
+
+    std::shared_ptr<const Geometry> Geometries::get(const Key& key) {
+        std::promise<std::shared_ptr<const Geometry>> built;
+        std::shared_future<std::shared_ptr<const Geometry>> ready;
+        bool build = false;
+        {
+            std::lock_guard lock(mutex_);
+            Entry& e = entries_[key];
+            if (!e.ready.valid()) {
+                e.ready = built.get_future().share();
+                build = true;
+            }
+            ready = e.ready;
+            if (--e.uses <= 0) entries_.erase(key);
+        }
+        if (build) {
+            try {
+                const auto [nx, ny, nz, order] = key;
+                auto g = std::make_shared<Geometry>();
+                std::vector<FccNeighbors::List> nn;
+                build_fcc_nn(nx, ny, nz, nn, order, &g->perm);
+                g->table = site_memory::SiteArray<FccNeighbors::List>(
+                    std::span<const FccNeighbors::List>(nn),
+                    static_cast<std::size_t>(nz) * constants::FCC_BASIS_COUNT);
+                built.set_value(std::move(g));
+            }
+            catch (...) {
+                built.set_exception(std::current_exception());
+            }
+        }
+        return ready.get();
+    }
+
+    namespace {
+        const char* status_name(const Status s) {
+            switch (s) {
+                case Status::PENDING: return "pending";
+                case Status::RUNNING: return "running";
+                case Status::DONE:    return "done";
+                case Status::FAILED:  return "failed";
+                case Status::STOPPED: return "stopped";
+            }
+            return "";
+        }
+    }
+
+    Index::Index(const std::string& path, const InputSweep& input,
+        const std::vector<std::string>& run_dirs)
+        : path_(path)
+    {
+        std::vector<std::size_t> varying;
+        for (std::size_t c = 0; c < input.columns.size(); ++c) {
+            if (std::find(PROCESS_WIDE_COLUMNS.begin(),
+                PROCESS_WIDE_COLUMNS.end(), input.columns[c]) !=
+                PROCESS_WIDE_COLUMNS.end()) {
+                continue;
+            }
+            for (const InputSweep::Job& job : input.jobs) {
+                if (job.values[c] != input.jobs.front().values[c]) {
+                    varying.push_back(c);
+                    break;
+                }
+            }
+        }
+        header_ = "job,row,run_dir,sites,steps,threads,status,seconds";
+        for (const std::size_t c : varying) header_ += "," + input.columns[c];
+        for (std::size_t k = 0; k < input.jobs.size(); ++k) {
+            const InputSweep::Job& job = input.jobs[k];
+            Row r;
+            r.head = std::to_string(k) + "," + std::to_string(job.row) + "," +
+                run_dirs[k] + "," + std::to_string(job.lat.N) + "," +
+                std::to_string(job.control.pre_steps + job.control.run_steps);
+            for (const std::size_t c : varying) r.values += "," + job.values[c];
+            rows_.push_back(std::move(r));
+        }
+        write();
+    }
+
+    void Index::set(const int job, const Status status, const int threads,
+        const double seconds)
+    {
+        std::lock_guard lock(mutex_);
+        rows_[job].status = status;
+        if (threads > 0) rows_[job].threads = threads;
+        rows_[job].seconds = seconds;
+        write();
+    }
+
+    void Index::write() const {
+        binary_file::AtomicWriter out(path_, "sweep:Index");
+        std::ofstream& os = out.stream();
+        os.imbue(std::locale::classic());
+        os << header_ << "\n" << std::fixed << std::setprecision(3);
+        for (const Row& r : rows_) {
+            os << r.head << "," << r.threads << "," << status_name(r.status)
+               << "," << r.seconds << r.values << "\n";
+        }
+        out.commit();
+    }
+}
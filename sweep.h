@@ -0,0 +1,92 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "io.h"
+#include "lattice.h"
+#include "site_memory.h"
+
+/// Parameter sweeps in one process: input.csv with several value rows or
+/// sweep cells (io.h, read_input_jobs) is a list of jobs, each a complete
+/// run in its own directory. The jobs run side by side on a work-stealing
+/// scheduler, jobs of the same geometry share one neighbor table, and
+/// sweep_index.csv maps the job directories to their parameters.
+namespace sweep {
+    /// Run fn(job, threads) for the jobs 0 .. cost.size()-1 on `workers`
+    /// threads. The jobs are dealt largest cost first, round robin, to one
+    /// deque per worker; a worker runs the front (largest) job of its own
+    /// deque, and when that is empty it steals the back (smallest) job of
+    /// the deque with the most queued cost, so big and small jobs even out.
+    /// Each job gets a share of the `threads` budget: the free threads over
+    /// the workers about to start a job (at least 1), so the last jobs get
+    /// the threads the finished ones released. No new job starts after a
+    /// stop signal. Rethrows the first exception of fn after all workers
+    /// have finished.
+    void run_jobs(std::span<const double> cost, int workers, int threads,
+        const std::function<void(int job, int threads)>& fn);
+
+    /// Neighbor table and cell order of one lattice size and cell order.
+    struct Geometry {
+        site_memory::SiteArray<FccNeighbors::List> table;
+        SitePermutation perm;   // cell order only (no species order)
+    };
+
+    /// Geometries shared by the jobs of a sweep. The first job that asks for
+    /// a geometry builds it and the others wait for it; the cache drops it
+    /// after its last job asked, so it is freed when that job is done.
+    class Geometries {
+    public:
+        using Key = std::tuple<int, int, int, CellOrder>; // nx, ny, nz, order
+
+        /// uses: the geometry of every job that will call get.
+        explicit Geometries(std::span<const Key> uses);
+        std::shared_ptr<const Geometry> get(const Key& key);
+
+    private:
+        struct Entry {
+            int uses{0};
+            std::shared_future<std::shared_ptr<const Geometry>> ready;
+        };
+        std::mutex mutex_;
+        std::map<Key, Entry> entries_;
+    };
+
+    enum class Status { PENDING, RUNNING, DONE, FAILED, STOPPED };
+
+    /// sweep_index.csv: one row per job with job, row (of input.csv),
+    /// run_dir, sites, steps, threads, status, seconds, then the columns of
+    /// input.csv whose value differs between the jobs. Rewritten atomically
+    /// whenever a job changes status, so it also shows a running sweep.
+    /// Throws std::runtime_error("sweep:Index: ...").
+    class Index {
+    public:
+        Index(const std::string& path, const InputSweep& input,
+            const std::vector<std::string>& run_dirs);
+        void set(int job, Status status, int threads = 0,
+            double seconds = 0.0);
+
+    private:
+        void write() const;
+
+        struct Row {
+            std::string head;    // job, row, run_dir, sites, steps
+            std::string values;  // the varying columns
+            Status status{Status::PENDING};
+            int threads{0};
+            double seconds{0.0};
+        };
+        std::string path_;
+        std::string header_;
+        std::vector<Row> rows_;
+        std::mutex mutex_;
+    };
+}
+
+#endif //SWEEP_H
@@ -2,11 +2,11 @@
 #include <iostream>
 
 void count_atoms(const std::vector<uint8_t>& species) {
-    int cnt_Fe = 0, cnt_Gd = 0;
-    const int N = static_cast<int>(species.size());
+    SiteIndex cnt_Fe = 0, cnt_Gd = 0;
+    const SiteIndex N = static_cast<SiteIndex>(species.size());
 
     std::cout << "N = " << N << "\n";
-    for (int i = 0; i < N; ++i) {
+    for (SiteIndex i = 0; i < N; ++i) {
         if (species[i] == 0) {
             ++cnt_Fe;
         }
@@ -0,0 +1,177 @@
+#include "topology.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    constexpr char MAGIC[8] = {'G', 'D', 'F', 'E', 'T', 'O', 'P', '\0'};
+    constexpr uint32_t VERSION = 1;
+    // Sites per streamed chunk of the table (12 MiB); also the unit of its
+    // checksum, so reader and writer hash the same pieces.
+    constexpr SiteIndex CHUNK_SITES = SiteIndex(1) << 18;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t header_bytes;
+        int32_t nx, ny, nz;
+        int32_t nn_count;       // FCC_NN_COUNT
+        int64_t n_sites;
+        int64_t n_Gd;
+        uint64_t table_offset, species_offset;
+        uint64_t file_bytes;
+        uint64_t table_checksum;   // chunk hashes combined, see table_hash()
+        uint64_t species_checksum;
+    };
+
+    using binary_file::align_up;
+
+    Header layout(const int nx, const int ny, const int nz) {
+        Header h{};
+        std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+        h.version = VERSION;
+        h.header_bytes = sizeof(Header);
+        h.nx = nx; h.ny = ny; h.nz = nz;
+        h.nn_count = constants::FCC_NN_COUNT;
+        h.n_sites = count_fcc_sites(nx, ny, nz);
+        const uint64_t n = static_cast<uint64_t>(h.n_sites);
+        h.table_offset = align_up(sizeof(Header));
+        h.species_offset = align_up(h.table_offset +
+            n*sizeof(FccNeighbors::List));
+        h.file_bytes = h.species_offset + (n + 7) / 8;
+        return h;
+    }
+
+    /// Hash of the table chunk [a, a + n) combined into h.
+    uint64_t add_chunk(const uint64_t h, const FccNeighbors::List* chunk,
+        const SiteIndex n)
+    {
+        return binary_file::hash_combine(h, binary_file::hash(chunk,
+            static_cast<std::size_t>(n)*sizeof(FccNeighbors::List)));
+    }
+}
+
+namespace topology {
+    void write(const std::string& path, const FccNeighbors& neighbors,
+        std::span<const uint8_t> species, const SitePermutation* perm)
+    {
+        const SiteIndex N = static_cast<SiteIndex>(species.size());
+        if (N != count_fcc_sites(neighbors.nx, neighbors.ny, neighbors.nz)) {
+            throw std::runtime_error(
+                "topology:write: species size differs from the lattice");
+        }
+        if (N > INT_MAX) {
+            throw std::runtime_error("topology:write: " + std::to_string(N) +
+                " sites exceed the int32 neighbor table");
+        }
+        const bool permuted = perm && !perm->is_identity();
+        Header h = layout(neighbors.nx, neighbors.ny, neighbors.nz);
+
+        // Species in lattice order, 8 sites per byte.
+        std::vector<uint8_t> bits(static_cast<std::size_t>((N + 7) / 8), 0);
+        const long long n_bytes = static_cast<long long>(bits.size());
+        long long n_Gd = 0;
+        #pragma omp parallel for schedule(static) reduction(+:n_Gd)
+        for (long long byte = 0; byte < n_bytes; ++byte) {
+            uint8_t v = 0;
+            const SiteIndex p0 = static_cast<SiteIndex>(byte)*8;
+            for (SiteIndex p = p0; p < std::min(p0 + 8, N); ++p) {
+                const SiteIndex s = permuted ? perm->to_site[p] : p;
+                if (species[s]) { v |= uint8_t(1u << (p - p0)); ++n_Gd; }
+            }
+            bits[byte] = v;
+        }
+        h.n_Gd = n_Gd;
+        h.species_checksum = binary_file::hash(bits.data(), bits.size());
+
+        binary_file::AtomicWriter file(path, "topology:write");
+        std::ofstream& ofs = file.stream();
+        ofs.write(reinterpret_cast<const char*>(&h), sizeof(h)); // final below
+        const std::vector<char> pad(h.table_offset - sizeof(h), 0);
+        ofs.write(pad.data(), static_cast<std::streamsize>(pad.size()));
+
+        // Row p of the lattice-order table is the list of storage site
+        // to_site[p], renumbered to lattice indices.
+        std::vector<FccNeighbors::List> chunk(static_cast<std::size_t>(
+            std::min(CHUNK_SITES, N)));
+        uint64_t table_hash = 0;
+        for (SiteIndex a = 0; a < N; a += CHUNK_SITES) {
+            const SiteIndex n = std::min(CHUNK_SITES, N - a);
+            #pragma omp parallel for schedule(static)
+            for (SiteIndex p = a; p < a + n; ++p) {
+                const SiteIndex s = permuted ? perm->to_site[p] : p;
+                FccNeighbors::WideList scratch;
+                FccNeighbors::List& row = chunk[p - a];
+                neighbors.visit_site(s, scratch, [&](const auto& nb) {
+                    for (int q = 0; q < constants::FCC_NN_COUNT; ++q) {
+                        const auto t = static_cast<int>(nb[q]);
+                        row[q] = permuted ? perm->to_lattice[t] : t;
+                    }
+                });
+            }
+            table_hash = add_chunk(table_hash, chunk.data(), n);
+            ofs.write(reinterpret_cast<const char*>(chunk.data()),
+                static_cast<std::streamsize>(n*sizeof(FccNeighbors::List)));
+        }
+        h.table_checksum = table_hash;
+
+        const uint64_t table_end = h.table_offset +
+            static_cast<uint64_t>(N)*sizeof(FccNeighbors::List);
+        const std::vector<char> pad2(h.species_offset - table_end, 0);
+        ofs.write(pad2.data(), static_cast<std::streamsize>(pad2.size()));
+        ofs.write(reinterpret_cast<const char*>(bits.data()),
+            static_cast<std::streamsize>(bits.size()));
+        ofs.seekp(0);
+        ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        file.commit();
+    }
+
+    Mapping::Mapping(const std::string& path) : file_(path) {
+        const auto fail = [&](const std::string& why) {
+            throw std::runtime_error("topology:read: " + path + ": " + why);
+        };
+        if (!file_.valid()) fail("cannot open or map file");
+        if (file_.size() < sizeof(Header)) fail("truncated header");
+        Header h;
+        std::memcpy(&h, file_.data(), sizeof(h));
+        if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            h.version != VERSION || h.header_bytes != sizeof(Header) ||
+            h.nn_count != constants::FCC_NN_COUNT) {
+            fail("unknown format or version");
+        }
+        if (h.nx <= 0 || h.ny <= 0 || h.nz <= 0) fail("corrupt header");
+        const Header expect = layout(h.nx, h.ny, h.nz);
+        if (h.n_sites != expect.n_sites ||
+            h.table_offset != expect.table_offset ||
+            h.species_offset != expect.species_offset ||
+            h.file_bytes != expect.file_bytes ||
+            h.file_bytes != file_.size()) {
+            fail("corrupt layout");
+        }
+        nx_ = h.nx; ny_ = h.ny; nz_ = h.nz;
+        N_ = h.n_sites;
+        n_Gd_ = h.n_Gd;
+        table_ = {reinterpret_cast<const FccNeighbors::List*>(
+            file_.data() + h.table_offset), static_cast<std::size_t>(N_)};
+        species_bits_ = file_.data() + h.species_offset;
+
+        uint64_t table_hash = 0;
+        for (SiteIndex a = 0; a < N_; a += CHUNK_SITES) {
+            table_hash = add_chunk(table_hash, table_.data() + a,
+                std::min(CHUNK_SITES, N_ - a));
+        }
+        if (table_hash != h.table_checksum ||
+            binary_file::hash(species_bits_, static_cast<std::size_t>(
+                (N_ + 7) / 8)) != h.species_checksum) {
+            fail("checksum mismatch");
+        }
+    }
+
+    std::vector<uint8_t> Mapping::species() const {
+        std::vector<uint8_t> out(static_cast<std::size_t>(N_));
+        #pragma omp parallel for schedule(static)
+        for (SiteIndex p = 0; p < N_; ++p) out[p] = is_Gd(p) ? 1 : 0;
+        return out;
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+#include "binary_file.h"
+#include "lattice.h"
+#include "params.h"
+
+/// Binary export of the lattice topology of a run, in row-major lattice
+/// order p = (((i*ny + j)*nz + k)*4 + b) whatever the storage order: the
+/// neighbor table (N x 12 int32, lattice indices, the order of
+/// build_fcc_nn) and the species bit-packed (bit p % 8 of byte p / 8 is 1
+/// for Gd). The file is a fixed header (magic, version, nx, ny, nz, N, n_Gd,
+/// section offsets, checksums) followed by page-aligned sections, native
+/// byte order; about 48 bytes/site against about 300 for the text files of
+/// write_nearest_neighbors and write_site_species, which topology_to_text
+/// produces from it on demand.
+namespace topology {
+    /// Write path atomically, the table streamed in chunks filled in
+    /// parallel (no second copy of the table in memory). neighbors and
+    /// species are in site order. Throws std::runtime_error (also above
+    /// INT32_MAX sites, the range of the int32 table).
+    void write(const std::string& path, const FccNeighbors& neighbors,
+        std::span<const uint8_t> species, const SitePermutation* perm);
+
+    /// Read-only mapping of a topology file.
+    class Mapping {
+    public:
+        /// Checks header and checksums. Throws
+        /// std::runtime_error("topology:read: ...").
+        explicit Mapping(const std::string& path);
+
+        int nx() const { return nx_; }
+        int ny() const { return ny_; }
+        int nz() const { return nz_; }
+        SiteIndex n_sites() const { return N_; }
+        SiteIndex n_Gd() const { return n_Gd_; }
+        /// Neighbor lists of the lattice sites.
+        std::span<const FccNeighbors::List> table() const { return table_; }
+        bool is_Gd(const SiteIndex p) const {
+            return (species_bits_[p >> 3] >> (p & 7)) & 1;
+        }
+        /// Species of the lattice sites, one byte each (0 = Fe, 1 = Gd).
+        std::vector<uint8_t> species() const;
+
+    private:
+        binary_file::Mapping file_;
+        int nx_{0}, ny_{0}, nz_{0};
+        SiteIndex N_{0}, n_Gd_{0};
+        std::span<const FccNeighbors::List> table_;
+        const uint8_t* species_bits_{nullptr};
+    };
+}
+
+#endif //TOPOLOGY_H
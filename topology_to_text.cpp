@@ -0,0 +1,40 @@
+// Convert a binary topology export (topology.bin) to the text files of
+// write_nearest_neighbors and write_site_species.
+// Usage: topology_to_text <topology.bin> [nearest_neighbors.txt] [Gd_sites.txt]
+//        (default: next to the input file)
+#include "io.h"
+#include "topology.h"
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 4) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <topology.bin> [nearest_neighbors.txt] [Gd_sites.txt]\n";
+        return 2;
+    }
+    try {
+        const topology::Mapping topo(argv[1]);
+        const std::filesystem::path dir =
+            std::filesystem::path(argv[1]).parent_path();
+        const std::string nn_path = argc > 2 ? argv[2] :
+            (dir / "nearest_neighbors.txt").string();
+        const std::string gd_path = argc > 3 ? argv[3] :
+            (dir / "Gd_sites.txt").string();
+        write_nearest_neighbors(nn_path, topo.nx(), topo.ny(), topo.nz(),
+            constants::FCC_BASIS_COUNT, topo.table());
+        write_site_species(gd_path, topo.nx(), topo.ny(), topo.nz(),
+            constants::FCC_BASIS_COUNT, topo.species());
+        std::cout << topo.nx() << "x" << topo.ny() << "x" << topo.nz()
+                  << " cells, " << topo.n_sites() << " sites, "
+                  << topo.n_Gd() << " Gd -> " << nn_path << ", "
+                  << gd_path << "\n";
+    }
+    catch (const std::exception& e) {
+        std::cerr << "topology_to_text: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
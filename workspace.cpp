@@ -0,0 +1,46 @@
+#include "workspace.h"
+#include "site_memory.h"
+
+namespace {
+    constexpr std::size_t ALIGN_BYTES = 64;
+
+    /// Values per buffer: N rounded up to a whole number of 64-byte lines.
+    template <typename Real>
+    std::size_t stride_for(const SiteIndex N) {
+        constexpr std::size_t per_line = ALIGN_BYTES / sizeof(Real);
+        return (static_cast<std::size_t>(N) + per_line - 1) / per_line * per_line;
+    }
+}
+
+template <typename Real>
+std::size_t HeunWorkspace<Real>::bytes_for(const SiteIndex N) {
+    return N_BUFFERS * stride_for<Real>(N) * sizeof(Real);
+}
+
+template <typename Real>
+HeunWorkspace<Real>::HeunWorkspace(const SiteIndex N, const int row_sites)
+    : bytes_(bytes_for(N))
+{
+    arena_ = static_cast<Real*>(site_memory::allocate(bytes_));
+    const std::size_t stride = stride_for<Real>(N);
+    std::span<Real>* views[N_BUFFERS] = {
+        &mx, &my, &mz,
+        &mx_mid, &my_mid, &mz_mid,
+        &mx_pred, &my_pred, &mz_pred,
+        &dmx_dt_st1, &dmy_dt_st1, &dmz_dt_st1,
+        &Hx_ther_tesla, &Hy_ther_tesla, &Hz_ther_tesla};
+    for (int b = 0; b < N_BUFFERS; ++b) {
+        *views[b] = std::span<Real>(arena_ + b*stride,
+            static_cast<std::size_t>(N));
+        site_memory::first_touch(views[b]->data(), views[b]->size(),
+            static_cast<std::size_t>(row_sites), Real(0));
+    }
+}
+
+template <typename Real>
+HeunWorkspace<Real>::~HeunWorkspace() {
+    site_memory::release(arena_, bytes_);
+}
+
+template class HeunWorkspace<double>;
+template class HeunWorkspace<float>;
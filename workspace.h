@@ -0,0 +1,43 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+#include <cstddef>
+#include <span>
+#include "params.h"
+
+/** Per-site arrays of the fused Heun time loop, carved out of one arena in
+ *  site memory (site_memory.h; each buffer N values of Real, 64-byte
+ *  aligned, zeroed by a parallel first touch in rows of row_sites sites,
+ *  i.e. 4*nz for the kernels' cell-row loops):
+ *  - m, m_mid          : state carried from step to step
+ *  - m_pred, dm_dt_st1 : predictor -> corrector
+ *  - H_ther            : thermal field of the current step
+ *  All five are live during the corrector, so none can share storage. The
+ *  per-term exchange/anisotropy fields are not kept at all: on save steps
+ *  compute_bulk_fields_from_m reduces them block by block. The views convert
+ *  to the span parameters of the kernels. */
+template <typename Real>
+class HeunWorkspace {
+public:
+    static constexpr int N_BUFFERS = 15;
+
+    explicit HeunWorkspace(SiteIndex N, int row_sites = 1);
+    ~HeunWorkspace();
+    HeunWorkspace(const HeunWorkspace&) = delete;
+    HeunWorkspace& operator=(const HeunWorkspace&) = delete;
+
+    /// Arena size for N sites, including the alignment padding.
+    static std::size_t bytes_for(SiteIndex N);
+    std::size_t bytes() const { return bytes_; }
+
+    std::span<Real> mx, my, mz;
+    std::span<Real> mx_mid, my_mid, mz_mid;
+    std::span<Real> mx_pred, my_pred, mz_pred;
+    std::span<Real> dmx_dt_st1, dmy_dt_st1, dmz_dt_st1;
+    std::span<Real> Hx_ther_tesla, Hy_ther_tesla, Hz_ther_tesla;
+
+private:
+    Real* arena_{nullptr};
+    std::size_t bytes_{0};
+};
+
+#endif //WORKSPACE_H